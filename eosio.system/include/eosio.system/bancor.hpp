@@ -0,0 +1,162 @@
+/**
+ *  @file
+ *  @copyright defined in eos/LICENSE.txt
+ */
+#pragma once
+
+#include <cstdint>
+
+namespace eosiosystem { namespace bancor {
+
+   typedef unsigned __int128 uint128_t;
+
+   /**
+    *  Integer implementation of the 50/50 Bancor relay used by the RAM market.
+    *
+    *  Every function here is pure integer arithmetic with no dependency on eosiolib so that the
+    *  same code runs inside the contract and in native tests. Results are the exact floor of the
+    *  real-valued Bancor formulas, which is what the double implementation approximates.
+    */
+
+   /// minimal 256-bit unsigned integer, only supports what the relay needs: products and comparison
+   struct uint256_t {
+      uint128_t hi = 0;
+      uint128_t lo = 0;
+
+      friend bool operator<=( const uint256_t& a, const uint256_t& b ) {
+         return a.hi < b.hi || ( a.hi == b.hi && a.lo <= b.lo );
+      }
+   };
+
+   inline uint256_t mul( uint128_t a, uint128_t b ) {
+      const uint128_t mask = ~uint64_t(0);
+      uint128_t a0 = a & mask, a1 = a >> 64;
+      uint128_t b0 = b & mask, b1 = b >> 64;
+
+      uint128_t p00 = a0 * b0;
+      uint128_t p01 = a0 * b1;
+      uint128_t p10 = a1 * b0;
+      uint128_t p11 = a1 * b1;
+
+      uint128_t mid = ( p00 >> 64 ) + ( p01 & mask ) + ( p10 & mask );
+
+      uint256_t r;
+      r.lo = ( p00 & mask ) | ( mid << 64 );
+      r.hi = p11 + ( p01 >> 64 ) + ( p10 >> 64 ) + ( mid >> 64 );
+      return r;
+   }
+
+   inline uint32_t bit_length( uint128_t n ) {
+      uint64_t hi = uint64_t(n >> 64);
+      uint64_t lo = uint64_t(n);
+      if( hi ) return 128 - __builtin_clzll( hi );
+      if( lo ) return 64 - __builtin_clzll( lo );
+      return 0;
+   }
+
+   /// floor( sqrt(n) )
+   inline uint128_t isqrt( uint128_t n ) {
+      if( n < 2 ) return n;
+      uint128_t x = uint128_t(1) << ( ( bit_length( n ) + 1 ) / 2 ); // x >= sqrt(n)
+      while( true ) {
+         uint128_t y = ( x + n / x ) >> 1;
+         if( y >= x ) return x;
+         x = y;
+      }
+   }
+
+   /**
+    *  Smart tokens issued for depositing `in` into a connector of weight 0.5:
+    *
+    *     E = R * ( sqrt( 1 + T/C ) - 1 ),  C = balance + in
+    *
+    *  evaluated as R*T / ( C + sqrt( C*(C+T) ) ) to keep every intermediate in integer range.
+    *
+    *  @pre 0 <= in, 0 < balance + in, balance + 2*in < 2^64
+    */
+   inline int64_t to_exchange( int64_t supply, int64_t balance, int64_t in ) {
+      if( in <= 0 ) return 0;
+
+      const uint128_t R = uint64_t(supply);
+      const uint128_t T = uint64_t(in);
+      const uint128_t C = uint128_t(uint64_t(balance)) + T;
+      const uint128_t N = R * T;
+      const uint128_t P = C * ( C + T );
+
+      // estimate with k fractional bits in the square root, then correct to the exact floor
+      uint32_t k = ( 128 - bit_length( P ) ) / 2;
+      if( k > 62 ) k = 62;
+      const uint128_t D = ( C << k ) + isqrt( P << ( 2 * k ) );
+      uint128_t e = ( ( N / D ) << k ) + ( ( ( N % D ) << k ) / D );
+
+      // e is the largest integer with e * ( C + sqrt(P) ) <= N
+      auto fits = [&]( uint128_t e ) {
+         const uint128_t ec = e * C;
+         if( ec > N ) return false;
+         const uint128_t rest = N - ec;
+         return mul( e * e, P ) <= mul( rest, rest );
+      };
+      while( e > 0 && !fits( e ) ) --e;
+      while( fits( e + 1 ) ) ++e;
+
+      return int64_t(e);
+   }
+
+   /**
+    *  Connector tokens released for returning `in` smart tokens to a connector of weight 0.5:
+    *
+    *     T = C * ( ( 1 + E/R )^2 - 1 ) = C * E * ( 2R + E ) / R^2,  R = supply - in
+    *
+    *  @pre 0 <= in < supply, 0 <= balance
+    */
+   inline int64_t from_exchange( int64_t supply, int64_t balance, int64_t in ) {
+      if( in <= 0 ) return 0;
+
+      const uint128_t R = uint64_t(supply - in);
+      const uint128_t C = uint64_t(balance);
+      const uint128_t E = uint64_t(in);
+      const uint128_t CE = C * E;
+      const uint128_t F  = 2 * R + E;
+      const uint128_t R2 = R * R;
+      const uint256_t X  = mul( CE, F );
+
+      // estimate floor( floor(CE/R) * F / R ), then correct to the exact floor of X / R^2
+      const uint128_t q = CE / R;
+      uint128_t t = ( q / R ) * F + ( ( q % R ) * F ) / R;
+
+      while( t > 0 && !( mul( t, R2 ) <= X ) ) --t;
+      while( mul( t + 1, R2 ) <= X ) ++t;
+
+      return int64_t(t);
+   }
+
+   /**
+    *  Closed form of a trade through both connectors of a 50/50 relay (connector in -> smart token
+    *  -> connector out). The smart token supply cancels out and the trade reduces to
+    *
+    *     out = out_reserve * inp / ( inp_reserve + inp )
+    *
+    *  @pre 0 <= inp, 0 <= out_reserve, 0 < inp_reserve + inp
+    */
+   inline int64_t output( int64_t inp_reserve, int64_t out_reserve, int64_t inp ) {
+      const uint128_t num = uint128_t(uint64_t(out_reserve)) * uint64_t(inp);
+      return int64_t( num / ( uint128_t(uint64_t(inp_reserve)) + uint64_t(inp) ) );
+   }
+
+   /**
+    *  Inverse of output(): the smallest input that buys at least `out` from the relay
+    *
+    *     inp = ceil( inp_reserve * out / ( out_reserve - out ) )
+    *
+    *  Saturates at the largest int64_t when `out` is close to draining the reserve.
+    *
+    *  @pre 0 <= out < out_reserve, 0 <= inp_reserve
+    */
+   inline int64_t input( int64_t out_reserve, int64_t inp_reserve, int64_t out ) {
+      const uint128_t num = uint128_t(uint64_t(inp_reserve)) * uint64_t(out);
+      const uint128_t den = uint64_t(out_reserve - out);
+      const uint128_t inp = ( num + den - 1 ) / den;
+      return inp > uint64_t(INT64_MAX) ? INT64_MAX : int64_t(inp);
+   }
+
+} } /// namespace eosiosystem::bancor
@@ -9,8 +9,13 @@
 #include <eosiolib/time.hpp>
 #include <eosiolib/privileged.hpp>
 #include <eosiolib/singleton.hpp>
+#include <eosiolib/binary_extension.hpp>
 #include <eosio.system/exchange_state.hpp>
+#include <eosio.system/vote_weight.hpp>
+#include <eosio.system/producer_pay_math.hpp>
+#include <eosio.system/producer_slots.hpp>
 
+#include <algorithm>
 #include <string>
 #include <type_traits>
 #include <optional>
@@ -47,14 +52,80 @@ namespace eosiosystem {
          return ( flags & ~static_cast<F>(field) );
    }
 
+   /**
+    *  One receiver of delegatebatch or undelbatch and the net and cpu stake moved for it.
+    */
+   struct bandwidth_delta {
+      name          receiver;
+      asset         net_quantity;
+      asset         cpu_quantity;
+
+      EOSLIB_SERIALIZE( bandwidth_delta, (receiver)(net_quantity)(cpu_quantity) )
+   };
+
+   /**
+    *  One account of batchacctram, batchacctnet or batchacctcpu. An empty value returns the resource
+    *  to the management of the system contract, as in setacctram, setacctnet and setacctcpu.
+    */
+   struct account_resource {
+      name                     account;
+      std::optional<int64_t>   value;
+
+      EOSLIB_SERIALIZE( account_resource, (account)(value) )
+   };
+
+   /**
+    *  One account of batchalimits.
+    */
+   struct account_limits {
+      name          account;
+      int64_t       ram_bytes  = 0;
+      int64_t       net_weight = 0;
+      int64_t       cpu_weight = 0;
+
+      EOSLIB_SERIALIZE( account_limits, (account)(ram_bytes)(net_weight)(cpu_weight) )
+   };
+
+   /**
+    *  One receiver of buyrambatch.
+    */
+   struct ram_purchase {
+      name          receiver;
+      uint32_t      bytes = 0;
+
+      EOSLIB_SERIALIZE( ram_purchase, (receiver)(bytes) )
+   };
+
+   // *bos*
+   /**
+    *  One list update of namelists, with the arguments of namelist.
+    */
+   struct name_list_update {
+      std::string         list;
+      std::string         action;
+      std::vector<name>   names;
+
+      EOSLIB_SERIALIZE( name_list_update, (list)(action)(names) )
+   };
+
    struct [[eosio::table, eosio::contract("eosio.system")]] name_bid {
      name            newname;
      name            high_bidder;
      int64_t         high_bid = 0; ///< negative high_bid == closed auction waiting to be claimed
      time_point      last_bid_time;
 
+     static constexpr int16_t base_length = 4; ///< shorter names are only closed as the highest bid of all
+     static constexpr int64_t close_delay = 24 * 3600 * int64_t(1000000); ///< without new bids before an auction can close
+
      uint64_t primary_key()const { return newname.value;                    }
      uint64_t by_high_bid()const { return static_cast<uint64_t>(-high_bid); }
+
+     /// open auctions of names the daily settlement may close, by the time they can close and then by bid
+     uint128_t by_close_time()const {
+        if( high_bid <= 0 || newname.length() < base_length )
+           return ~uint128_t(0);
+        return (uint128_t(last_bid_time.time_since_epoch().count() + close_delay) << 64) | static_cast<uint64_t>(-high_bid);
+     }
    };
 
    struct [[eosio::table, eosio::contract("eosio.system")]] bid_refund {
@@ -65,11 +136,33 @@ namespace eosiosystem {
    };
 
    typedef eosio::multi_index< "namebids"_n, name_bid,
-                               indexed_by<"highbid"_n, const_mem_fun<name_bid, uint64_t, &name_bid::by_high_bid>  >
+                               indexed_by<"highbid"_n, const_mem_fun<name_bid, uint64_t, &name_bid::by_high_bid>  >,
+                               indexed_by<"closetime"_n, const_mem_fun<name_bid, uint128_t, &name_bid::by_close_time>  >
                              > name_bid_table;
 
+   /**
+    * Progress of migratebids, which rewrites the name_bid rows written before the closetime index
+    * existed so that they get an entry in it. Until it is done such rows are rewritten before they
+    * change and the daily settlement uses the highbid index only.
+    */
+   struct [[eosio::table("bidmigrate"), eosio::contract("eosio.system")]] bid_migration_state {
+      name                  next; /// first name_bid row not visited yet
+      bool                  done = false;
+
+      EOSLIB_SERIALIZE( bid_migration_state, (next)(done) )
+   };
+
+   /**
+    * Outbid amounts per bidder in the scope of the contract. Rows in the scope of a name are refunds
+    * recorded before, each paid by its own deferred bidrefund.
+    */
    typedef eosio::multi_index< "bidrefunds"_n, bid_refund > bid_refund_table;
 
+   /**
+    * The ram totals, buckets, unpaid blocks, schedule/activation/name close timestamps and the
+    * producer vote total are maintained in eosio_global_hot_state, their copies here are kept for
+    * serialization only.
+    */
    struct [[eosio::table("global"), eosio::contract("eosio.system")]] eosio_global_state : eosio::blockchain_parameters {
       uint64_t free_ram()const { return max_ram_size - total_ram_bytes_reserved; }
 
@@ -120,6 +213,57 @@ namespace eosiosystem {
       EOSLIB_SERIALIZE( eosio_global_state3, (last_vpay_state_update)(total_vpay_share_change_rate) )
    };
 
+   /// blocks produced by one producer since its producer_info row was last updated
+   struct unpaid_blocks_counter {
+      name      producer;
+      uint32_t  blocks = 0;
+
+      EOSLIB_SERIALIZE( unpaid_blocks_counter, (producer)(blocks) )
+   };
+
+   /**
+    * Counters updated by onblock and the RAM market, kept apart from eosio_global_state so that the
+    * frequent actions neither read nor rewrite the blockchain parameters. Once this row exists the
+    * fields of the same name in eosio_global_state and eosio_global_state2 are no longer maintained.
+    */
+   struct [[eosio::table("globalhot"), eosio::contract("eosio.system")]] eosio_global_hot_state {
+      eosio_global_hot_state(){}
+
+      uint64_t free_ram()const { return max_ram_size - total_ram_bytes_reserved; }
+
+      uint64_t             max_ram_size = 64ll*1024 * 1024 * 1024;
+      uint64_t             total_ram_bytes_reserved = 0;
+      int64_t              total_ram_stake = 0;
+      block_timestamp      last_ram_increase;
+
+      block_timestamp      last_producer_schedule_update;
+      uint16_t             last_producer_schedule_size = 0;
+      time_point           last_pervote_bucket_fill;
+      int64_t              pervote_bucket = 0;
+      int64_t              perblock_bucket = 0;
+      uint32_t             total_unpaid_blocks = 0; /// all blocks which have been produced but not paid
+      time_point           thresh_activated_stake_time;
+      block_timestamp      last_name_close;
+
+      /// per-round unpaid blocks, merged into producer_info::unpaid_blocks on schedule updates and claimrewards
+      std::vector<unpaid_blocks_counter> round_unpaid_blocks;
+
+      uint32_t             vote_weight_week = 0; /// weeks since the block timestamp epoch that vote_weight is for
+      votes::fixed         vote_weight = votes::one; /// 2^(vote_weight_week/52), vote weight of one staked token
+
+      symbol               core_symbol;          /// symbol of the core token, read from the ram market once
+      int64_t              core_supply = 0;      /// core token supply as issued by claimrewards, 0 until the first claim reads it
+      bool                 compact_votes = false; /// whether voter rows store their producers as producer slots, see setcompact
+      int64_t              ram_fee = 0;          /// ram trade fees held by eosio.ram until sweepramfee pays them to eosio.ramfee
+      votes::fixed         total_producer_vote_weight = 0; /// the sum of all producer votes
+
+      EOSLIB_SERIALIZE( eosio_global_hot_state, (max_ram_size)(total_ram_bytes_reserved)(total_ram_stake)(last_ram_increase)
+                        (last_producer_schedule_update)(last_producer_schedule_size)(last_pervote_bucket_fill)
+                        (pervote_bucket)(perblock_bucket)(total_unpaid_blocks)(thresh_activated_stake_time)(last_name_close)
+                        (round_unpaid_blocks)(vote_weight_week)(vote_weight)(core_symbol)(core_supply)(compact_votes)(ram_fee)
+                        (total_producer_vote_weight) )
+   };
+
    struct [[eosio::table, eosio::contract("eosio.system")]] producer_info {
       name                  owner;
       double                total_votes = 0;
@@ -140,6 +284,89 @@ namespace eosiosystem {
                         (unpaid_blocks)(last_claim_time)(location) )
    };
 
+   /**
+    * Vote tally and vote pay accounting of a producer, the only producer row written when votes
+    * change. The key, url and location stay in producer_info, which is read by regproducer,
+    * update_elected_producers and claimrewards only. Once a producer has a tally the total_votes,
+    * is_active and last_claim_time fields of its producer_info row and its producer_info2 row are
+    * no longer authoritative.
+    */
+   struct [[eosio::table("prodtally"), eosio::contract("eosio.system")]] producer_tally {
+      name                  owner;
+      votes::fixed          total_votes = 0; /// fixed point, see vote_weight.hpp
+      bool                  is_active = true;
+      time_point            last_claim_time;
+      double                votepay_share = 0;
+      time_point            last_votepay_share_update; /// unset until vote pay is tracked for the producer
+
+      uint64_t     primary_key()const { return owner.value;                                   }
+      votes::fixed by_votes()const    { return votes::index_key( total_votes, is_active );    }
+      double       vote_weight()const { return votes::to_double( total_votes );              }
+      bool         active()const      { return is_active;                                     }
+      bool         has_votepay()const { return last_votepay_share_update != time_point();     }
+
+      pay::producer_votepay votepay()const {
+         return { votepay_share, last_votepay_share_update.time_since_epoch().count() };
+      }
+      void set_votepay( const pay::producer_votepay& vp ) {
+         votepay_share             = vp.share;
+         last_votepay_share_update = time_point( microseconds( vp.last_update ) );
+      }
+      pay::votepay_status votepay_status( time_point ct )const {
+         return pay::get_votepay_status( has_votepay(), last_claim_time.time_since_epoch().count(),
+                                         last_votepay_share_update.time_since_epoch().count(),
+                                         ct.time_since_epoch().count() );
+      }
+
+      // explicit serialization macro is not necessary, used here only to improve compilation time
+      EOSLIB_SERIALIZE( producer_tally, (owner)(total_votes)(is_active)(last_claim_time)
+                        (votepay_share)(last_votepay_share_update) )
+   };
+
+   /**
+    * Progress of migrateprods, which creates the tallies of the producers registered before the
+    * prodtally table existed. Until it is done producer_info::total_votes is kept up to date and
+    * the schedule is computed from it. Afterwards migrateprods erases the producers2 rows.
+    */
+   struct [[eosio::table("prodmigrate"), eosio::contract("eosio.system")]] producer_migration_state {
+      name                  next; /// first producer_info row not visited yet
+      bool                  done = false;
+
+      EOSLIB_SERIALIZE( producer_migration_state, (next)(done) )
+   };
+
+   /**
+    * Producers elected by the last schedule update. Vote changes that may move a producer across
+    * the top 21 boundary mark it dirty, update_elected_producers walks the vote index only then.
+    */
+   struct [[eosio::table("topprods"), eosio::contract("eosio.system")]] top_producers_state {
+      std::vector<name>     producers;      /// elected producers, by votes
+      votes::fixed          threshold = 0;  /// votes of the last elected producer if 21 were elected, 0 otherwise
+      capi_checksum256      schedule_hash{}; /// sha256 of the last proposed packed schedule
+      bool                  dirty = true;
+
+      bool     elected( name producer )const {
+         return std::find( producers.begin(), producers.end(), producer ) != producers.end();
+      }
+
+      EOSLIB_SERIALIZE( top_producers_state, (producers)(threshold)(schedule_hash)(dirty) )
+   };
+
+   /**
+    * Small id of a registered producer. Voters store the producers they vote for as a delta
+    * encoded list of these ids when compact votes are enabled, see producer_slots.hpp.
+    */
+   struct [[eosio::table("prodslots"), eosio::contract("eosio.system")]] producer_slot {
+      uint64_t        slot;
+      name            owner;
+
+      uint64_t primary_key()const { return slot;        }
+      uint64_t by_owner()const    { return owner.value; }
+
+      // explicit serialization macro is not necessary, used here only to improve compilation time
+      EOSLIB_SERIALIZE( producer_slot, (slot)(owner) )
+   };
+
    struct [[eosio::table, eosio::contract("eosio.system")]] producer_info2 {
       name            owner;
       double          votepay_share = 0;
@@ -151,6 +378,14 @@ namespace eosiosystem {
       EOSLIB_SERIALIZE( producer_info2, (owner)(votepay_share)(last_votepay_share_update) )
    };
 
+   /// vote weights of a voter in fixed point, see vote_weight.hpp
+   struct voter_weights {
+      votes::fixed        last_vote_weight = 0;
+      votes::fixed        proxied_vote_weight = 0;
+
+      EOSLIB_SERIALIZE( voter_weights, (last_vote_weight)(proxied_vote_weight) )
+   };
+
    struct [[eosio::table, eosio::contract("eosio.system")]] voter_info {
       name                owner;     /// the voter
       name                proxy;     /// the proxy set by the voter, if any
@@ -176,7 +411,47 @@ namespace eosiosystem {
       uint32_t            reserved2 = 0;
       eosio::asset        reserved3;
 
+      /// the producers approved by this voter as encoded producer slots, used instead of producers when not empty
+      eosio::binary_extension< std::vector<uint8_t> > producer_slots;
+
+      /// last_vote_weight and proxied_vote_weight in fixed point, used instead of them when present
+      eosio::binary_extension< voter_weights > weights;
+
       uint64_t primary_key()const { return owner.value; }
+      bool     compact()const     { return producer_slots.has_value() && !producer_slots.value().empty(); }
+      bool     has_producers()const { return compact() || !producers.empty(); }
+
+      votes::fixed last_weight()const {
+         return weights.has_value() ? weights.value().last_vote_weight : votes::from_double( last_vote_weight );
+      }
+      votes::fixed proxied_weight()const {
+         return weights.has_value() ? weights.value().proxied_vote_weight : votes::from_double( proxied_vote_weight );
+      }
+
+      /// the double fields keep a rounded copy of the weights for readers of the table
+      void set_weights( votes::fixed last, votes::fixed proxied ) {
+         if( !producer_slots.has_value() )
+            producer_slots.emplace(); // extensions are written in order, the weights follow the slots
+         weights.emplace( voter_weights{ last, proxied } );
+         last_vote_weight    = votes::to_double( last );
+         proxied_vote_weight = votes::to_double( proxied );
+      }
+      void set_last_weight( votes::fixed last ) { set_weights( last, proxied_weight() ); }
+
+      /**
+       *  Like set_weights without growing the row: a row without the fixed point weights keeps
+       *  only the rounded double fields. Used for rows written without the authority of their owner,
+       *  who pays for the row.
+       */
+      void update_weights( votes::fixed last, votes::fixed proxied ) {
+         if( weights.has_value() ) {
+            set_weights( last, proxied );
+            return;
+         }
+         last_vote_weight    = votes::to_double( last );
+         proxied_vote_weight = votes::to_double( proxied );
+      }
+      void update_last_weight( votes::fixed last ) { update_weights( last, proxied_weight() ); }
 
       enum class flags1_fields : uint32_t {
          ram_managed = 1,
@@ -185,7 +460,7 @@ namespace eosiosystem {
       };
 
       // explicit serialization macro is not necessary, used here only to improve compilation time
-      EOSLIB_SERIALIZE( voter_info, (owner)(proxy)(producers)(staked)(last_vote_weight)(proxied_vote_weight)(is_proxy)(flags1)(reserved2)(reserved3) )
+      EOSLIB_SERIALIZE( voter_info, (owner)(proxy)(producers)(staked)(last_vote_weight)(proxied_vote_weight)(is_proxy)(flags1)(reserved2)(reserved3)(producer_slots)(weights) )
    };
 
    // *bos*
@@ -206,11 +481,111 @@ namespace eosiosystem {
                              > producers_table;
    typedef eosio::multi_index< "producers2"_n, producer_info2 > producers_table2;
 
+   typedef eosio::multi_index< "prodslots"_n, producer_slot,
+                               indexed_by<"byowner"_n, const_mem_fun<producer_slot, uint64_t, &producer_slot::by_owner>  >
+                             > producer_slot_table;
+
+   typedef eosio::multi_index< "prodtally"_n, producer_tally,
+                               indexed_by<"prototalvote"_n, const_mem_fun<producer_tally, votes::fixed, &producer_tally::by_votes>  >
+                             > producer_tally_table;
+
    typedef eosio::singleton< "global"_n, eosio_global_state >   global_state_singleton;
    typedef eosio::singleton< "global2"_n, eosio_global_state2 > global_state2_singleton;
    typedef eosio::singleton< "global3"_n, eosio_global_state3 > global_state3_singleton;
+   typedef eosio::singleton< "globalhot"_n, eosio_global_hot_state > global_hot_state_singleton;
+   typedef eosio::singleton< "prodmigrate"_n, producer_migration_state > producer_migration_singleton;
+   typedef eosio::singleton< "bidmigrate"_n, bid_migration_state > bid_migration_singleton;
+   typedef eosio::singleton< "topprods"_n, top_producers_state > top_producers_singleton;
    typedef eosio::singleton< "guaranminres"_n, eosio_guaranteed_min_res > guaranteed_min_res_singleton;      // *bos*
 
+   /**
+    *  In-memory copy of a singleton row that is read on first access only and written back by
+    *  save() only if it was accessed through modify().
+    */
+   template<typename Singleton, typename T>
+   class lazy_singleton {
+      public:
+         typedef T (*default_factory)( name code );
+
+         lazy_singleton( name code, uint64_t scope, default_factory make_default )
+         :_code(code), _singleton(code, scope), _make_default(make_default) {}
+
+         const T& get() {
+            load();
+            return _state;
+         }
+
+         T& modify() {
+            load();
+            _dirty = true;
+            return _state;
+         }
+
+         void save( name payer ) {
+            if( _dirty ) {
+               _singleton.set( _state, payer );
+               _dirty = false;
+            }
+         }
+
+      private:
+         void load() {
+            if( !_loaded ) {
+               _state  = _singleton.exists() ? _singleton.get() : _make_default( _code );
+               _loaded = true;
+            }
+         }
+
+         name             _code;
+         Singleton        _singleton;
+         default_factory  _make_default;
+         T                _state;
+         bool             _loaded = false;
+         bool             _dirty  = false;
+   };
+
+   /**
+    *  Resource limits of the accounts touched by one action. The limits of an account are read on
+    *  first access and changed in memory; flush() sets them once per account and only if they differ
+    *  from what was read, since every set_resource_limits marks the account dirty in the chain.
+    */
+   class resource_limits_cache {
+      public:
+         struct limits {
+            int64_t ram_bytes  = 0;
+            int64_t net_weight = 0;
+            int64_t cpu_weight = 0;
+
+            bool operator == ( const limits& o )const {
+               return ram_bytes == o.ram_bytes && net_weight == o.net_weight && cpu_weight == o.cpu_weight;
+            }
+         };
+
+         limits& get( name account ) {
+            auto itr = _accounts.find( account );
+            if( itr == _accounts.end() ) {
+               limits current;
+               get_resource_limits( account.value, &current.ram_bytes, &current.net_weight, &current.cpu_weight );
+               itr = _accounts.emplace( account, std::make_pair( current, current ) ).first;
+            }
+            return itr->second.second;
+         }
+
+         void flush() {
+            for( const auto& a : _accounts ) {
+               const auto& [read, current] = a.second;
+               if( !(read == current) ) {
+                  set_resource_limits( a.first.value, current.ram_bytes, current.net_weight, current.cpu_weight );
+               }
+            }
+            _accounts.clear();
+         }
+
+      private:
+         /// account -> limits as read and as changed by the action
+         boost::container::flat_map< name, std::pair<limits, limits> > _accounts;
+   };
+
    //   static constexpr uint32_t     max_inflation_rate = 5;  // 5% annual inflation
    static constexpr uint32_t     seconds_per_day = 24 * 3600;
 
@@ -219,14 +594,18 @@ namespace eosiosystem {
          voters_table            _voters;
          producers_table         _producers;
          producers_table2        _producers2;
-         global_state_singleton  _global;
-         global_state2_singleton _global2;
-         global_state3_singleton _global3;
+         producer_tally_table    _tallies;
+         producer_slot_table     _prodslots;
+         lazy_singleton<global_state_singleton, eosio_global_state>          _gstate;
+         lazy_singleton<global_state2_singleton, eosio_global_state2>        _gstate2;
+         lazy_singleton<global_state3_singleton, eosio_global_state3>        _gstate3;
+         lazy_singleton<global_hot_state_singleton, eosio_global_hot_state>  _ghot;
+         lazy_singleton<producer_migration_singleton, producer_migration_state>  _prodmigrate;
+         lazy_singleton<bid_migration_singleton, bid_migration_state>        _bidmigrate;
+         lazy_singleton<top_producers_singleton, top_producers_state>        _topprods;
          guaranteed_min_res_singleton  _guarantee;     // *bos*
-         eosio_global_state      _gstate;
-         eosio_global_state2     _gstate2;
-         eosio_global_state3     _gstate3;
          rammarket               _rammarket;
+         resource_limits_cache   _limits;
 
       public:
          static constexpr eosio::name active_permission{"active"_n};
@@ -242,7 +621,7 @@ namespace eosiosystem {
          static constexpr eosio::name gov_account{"bos.gov"_n};
          static constexpr symbol ramcore_symbol = symbol(symbol_code("RAMCORE"), 4);
          static constexpr symbol ram_symbol     = symbol(symbol_code("RAM"), 0);
-         static const int16_t BASE_LENGTH = 4;
+         static const int16_t BASE_LENGTH = name_bid::base_length;
          system_contract( name s, name code, datastream<const char*> ds );
          ~system_contract();
 
@@ -270,6 +649,22 @@ namespace eosiosystem {
          [[eosio::action]]
          void setacctcpu( name account, std::optional<int64_t> cpu_weight );
 
+         /**
+          *  Variants of setalimits and setacctram/net/cpu that apply to many accounts in one action.
+          *  The limits of every account are written once at the end of the action.
+          */
+         [[eosio::action]]
+         void batchalimits( const std::vector<account_limits>& accounts );
+
+         [[eosio::action]]
+         void batchacctram( const std::vector<account_resource>& accounts );
+
+         [[eosio::action]]
+         void batchacctnet( const std::vector<account_resource>& accounts );
+
+         [[eosio::action]]
+         void batchacctcpu( const std::vector<account_resource>& accounts );
+
          // functions defined in delegate_bandwidth.cpp
 
          /**
@@ -302,6 +697,28 @@ namespace eosiosystem {
          void undelegatebw( name from, name receiver,
                             asset unstake_net_quantity, asset unstake_cpu_quantity );
 
+         /**
+          *  Stakes for every receiver like delegatebw without transfer. The voting power of 'from'
+          *  is updated once and the tokens are moved by a single transfer for the whole batch.
+          */
+         [[eosio::action]]
+         void delegatebatch( name from, const std::vector<bandwidth_delta>& receivers );
+
+         /**
+          *  Unstakes from every receiver like undelegatebw. The voting power of 'from' is updated
+          *  once and the refund request is updated once for the whole batch.
+          */
+         [[eosio::action]]
+         void undelbatch( name from, const std::vector<bandwidth_delta>& receivers );
+
+         /**
+          *  Creates newact like newaccount and gives it ram_bytes of ram paid by the creator and
+          *  the stake, delegated by the creator as delegatebw without transfer would.
+          */
+         [[eosio::action]]
+         void newacctres( name creator, name newact, const authority& owner, const authority& active,
+                          uint32_t ram_bytes, asset stake_net_quantity, asset stake_cpu_quantity );
+
     
          /**
           * Increases receiver's ram quota based upon current price and quantity of
@@ -312,6 +729,8 @@ namespace eosiosystem {
          void buyram( name payer, name receiver, asset quant );
          [[eosio::action]]
          void buyrambytes( name payer, name receiver, uint32_t bytes );
+         [[eosio::action]]
+         void buyrambatch( name payer, const std::vector<ram_purchase>& purchases );
 
          /**
           *  Reduces quota my bytes and then performs an inline transfer of tokens
@@ -320,6 +739,13 @@ namespace eosiosystem {
          [[eosio::action]]
          void sellram( name account, int64_t bytes );
 
+         /**
+          *  Pays the fees of the ram trades since the last call from eosio.ram to eosio.ramfee with
+          *  one transfer. Anyone may call it.
+          */
+         [[eosio::action]]
+         void sweepramfee();
+
          /**
           *  This action is called after the delegation-period to claim all pending
           *  unstaked tokens belonging to owner
@@ -327,6 +753,14 @@ namespace eosiosystem {
          [[eosio::action]]
          void refund( name owner );
 
+         /**
+          *  Pays out up to max refunds whose delegation-period has passed, oldest first, starting at
+          *  the refund of owner cursor or at the oldest one if cursor is empty. Anyone may call it,
+          *  an owner refusing the transfer can be skipped with the cursor.
+          */
+         [[eosio::action]]
+         void procrefunds( name cursor, uint32_t max );
+
          // functions defined in voting.cpp
 
          [[eosio::action]]
@@ -346,6 +780,39 @@ namespace eosiosystem {
          [[eosio::action]]
          void regproxy( const name proxy, bool isproxy );
 
+         /**
+          *  Creates the vote tallies of up to max_rows producers registered before the prodtally
+          *  table existed, continuing where the previous call stopped.
+          */
+         [[eosio::action]]
+         void migrateprods( uint32_t max_rows );
+
+         /**
+          *  Recomputes the vote weight of up to max_rows voters, starting at the voter named cursor.
+          *  Anyone may call it. The changes are summed per producer and per proxy so every affected
+          *  row is written once per call. Voter rows without fixed point weights are not converted,
+          *  which would grow rows their owners pay for; migratevoter does that.
+          */
+         [[eosio::action]]
+         void refreshvotes( const name cursor, uint32_t max_rows );
+
+         /**
+          *  Stores the weights of up to max_rows voters in fixed point, starting at the voter named
+          *  cursor. Rows written before are converted when they are written next anyway.
+          */
+         [[eosio::action]]
+         void migratevoter( const name cursor, uint32_t max_rows );
+
+         /**
+          *  Enables or disables storing the producers of voter rows as encoded producer slots. Rows
+          *  are converted when they are written next, by a vote, a stake change or refreshvotes.
+          *
+          *  Compact rows trade cpu for ram: every vote, stake change and refresh of such a row looks
+          *  up the slot of each of its producers, up to 30 table reads more than with names.
+          */
+         [[eosio::action]]
+         void setcompact( bool compact );
+
          [[eosio::action]]
          void setparams( const eosio::blockchain_parameters& params );
 
@@ -353,6 +820,14 @@ namespace eosiosystem {
          [[eosio::action]]
          void namelist(std::string list, std::string action, const std::vector<name>& names );
 
+         // *bos*
+         /**
+          *  Applies several namelist updates, each list and action at most once, so that every
+          *  list is packed and handed to the chain once.
+          */
+         [[eosio::action]]
+         void namelists( const std::vector<name_list_update>& updates );
+
          // *bos*
          [[eosio::action]]
          void setguaminres(uint32_t ram, uint32_t cpu, uint32_t net);
@@ -361,6 +836,14 @@ namespace eosiosystem {
          [[eosio::action]]
          void claimrewards( const name owner );
 
+         /**
+          *  Sets the core token supply that claimrewards computes inflation from to the supply in the
+          *  eosio.token stats, after tokens were issued or retired other than by claimrewards. Anyone
+          *  may call it.
+          */
+         [[eosio::action]]
+         void syncsupply();
+
          [[eosio::action]]
          void setpriv( name account, uint8_t is_priv );
 
@@ -370,12 +853,44 @@ namespace eosiosystem {
          [[eosio::action]]
          void updtrevision( uint8_t revision );
 
+         /**
+          *  Moves the counters of eosio_global_state and eosio_global_state2 that are maintained in
+          *  eosio_global_hot_state into the globalhot row and clears the stale copies. The row is also
+          *  created on first use, running this action once after the upgrade makes it explicit.
+          */
+         [[eosio::action]]
+         void splitgstate();
+
          [[eosio::action]]
          void bidname( name bidder, name newname, asset bid );
 
+         /**
+          *  Pays a refund of an outbid bid on newname recorded before outbid amounts were kept per
+          *  bidder, it is sent by the deferred transaction scheduled when the bid was outbid.
+          */
          [[eosio::action]]
          void bidrefund( name bidder, name newname );
 
+         /**
+          *  Rewrites up to max_rows name bids placed before the closetime index existed, continuing
+          *  where the previous call stopped.
+          */
+         [[eosio::action]]
+         void migratebids( uint32_t max_rows );
+
+         /**
+          *  Pays bidder everything it was outbid by on any name in one transfer.
+          */
+         [[eosio::action]]
+         void claimbidref( name bidder );
+
+         /**
+          *  Pays the outbid amounts of up to max_rows bidders, starting at the bidder named cursor.
+          *  Anyone may call it, a bidder refusing the transfer can be skipped with the cursor.
+          */
+         [[eosio::action]]
+         void sweepbidrefs( name cursor, uint32_t max_rows );
+
       private:
          // Implementation details:
 
@@ -387,27 +902,54 @@ namespace eosiosystem {
 
          //defined in eosio.system.cpp
          static eosio_global_state get_default_parameters();
+         static eosio_global_hot_state get_default_hot_state( name self );
          static time_point current_time_point();
          static block_timestamp current_block_time();
 
-         symbol core_symbol()const;
+         symbol core_symbol();
 
          void update_ram_supply();
+         void set_account_limits( name account, int64_t ram_bytes, int64_t net_weight, int64_t cpu_weight );
+         void set_account_ram( name account, const std::optional<int64_t>& ram_bytes );
+         void set_account_net( name account, const std::optional<int64_t>& net_weight );
+         void set_account_cpu( name account, const std::optional<int64_t>& cpu_weight );
+         void set_name_list( const std::string& list, const std::string& action, const std::vector<name>& names );
+         name_bid_table::const_iterator index_bid( name_bid_table& bids, name_bid_table::const_iterator bid );
+
+         //defined in producer_pay.cpp
+         void flush_unpaid_blocks();
+         uint32_t take_unpaid_blocks( name producer );
 
          //defined in delegate_bandwidth.cpp
          void changebw( name from, name receiver,
                         asset stake_net_quantity, asset stake_cpu_quantity, bool transfer );
+         void update_delegated_bandwidth( name from, name receiver,
+                                          const asset stake_net_delta, const asset stake_cpu_delta );
+         void update_refund( name from, asset& net_balance, asset& cpu_balance );
+         int64_t purchase_ram_bytes( name payer, int64_t bytes );
+         void add_ram_bytes( name receiver, int64_t bytes );
+         void update_voter_stake( name from, const asset total_update );
 
          //defined in voting.hpp
          void update_elected_producers( block_timestamp timestamp );
          void update_votes( const name voter, const name proxy, const std::vector<name>& producers, bool voting );
 
          // defined in voting.cpp
+         votes::fixed stake2vote( int64_t staked );
          void propagate_weight_change( const voter_info& voter );
-
-         double update_producer_votepay_share( const producers_table2::const_iterator& prod_itr,
-                                               time_point ct,
-                                               double shares_rate, bool reset_to_zero = false );
+         void apply_producer_deltas( const boost::container::flat_map<name, std::pair<votes::change, bool /*new*/> >& producer_deltas,
+                                     bool voting );
+         producer_tally_table::const_iterator get_tally( const name producer );
+         void sync_legacy_votes( const producer_tally& tally );
+         void check_top_producers( const producer_tally& tally, votes::fixed init_votes );
+         void invalidate_top_producers();
+         uint64_t get_producer_slot( const name producer, const name payer );
+         std::vector<name> voted_producers( const voter_info& voter );
+         void set_voted_producers( voter_info& voter, const std::vector<name>& producers );
+         bool needs_reencoding( const voter_info& voter );
+
+         pay::votepay_totals get_votepay_totals();
+         void set_votepay_totals( const pay::votepay_totals& totals );
          double update_total_votepay_share( time_point ct,
                                             double additional_shares_delta = 0.0, double shares_rate_delta = 0.0 );
    };
@@ -12,6 +12,9 @@ namespace eosiosystem {
     *  Uses Bancor math to create a 50/50 relay between two asset types. The state of the
     *  bancor exchange is entirely contained within this struct. There are no external
     *  side effects associated with using this API.
+    *
+    *  Connectors with a weight of .5 are priced exactly with integer math (see bancor.hpp),
+    *  other weights fall back to the floating point formulas.
     */
    struct [[eosio::table, eosio::contract("eosio.system")]] exchange_state {
       asset    supply;
@@ -32,6 +35,17 @@ namespace eosiosystem {
       asset convert_from_exchange( connector& c, asset in );
       asset convert( asset from, const symbol& to );
 
+      /**
+       *  Single pass conversion between the two connectors of a 50/50 relay, equivalent to
+       *  convert() through the smart token without the intermediate rounding.
+       */
+      asset direct_convert( const asset& from, const symbol& to );
+
+      /// connector tokens received for selling `inp` to a 50/50 relay with the given reserves
+      static int64_t get_bancor_output( int64_t inp_reserve, int64_t out_reserve, int64_t inp );
+      /// connector tokens needed to buy exactly `out` from a 50/50 relay with the given reserves
+      static int64_t get_bancor_input( int64_t out_reserve, int64_t inp_reserve, int64_t out );
+
       EOSLIB_SERIALIZE( exchange_state, (supply)(base)(quote) )
    };
 
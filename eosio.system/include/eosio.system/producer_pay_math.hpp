@@ -0,0 +1,234 @@
+/**
+ *  @file
+ *  @copyright defined in eos/LICENSE.txt
+ */
+#pragma once
+
+#include <eosio.system/vote_weight.hpp>
+
+#include <cstdint>
+
+namespace eosiosystem { namespace pay {
+
+   /**
+    *  Producer pay arithmetic of onblock, claimrewards and the vote pay accounting in voting.cpp.
+    *
+    *  Times are microseconds since the epoch and amounts are in the smallest unit of the core
+    *  token. Like bancor.hpp this has no dependency on eosiolib, the native tests and the economics
+    *  simulator in tests/sim run the same code as the contract.
+    */
+   static constexpr uint32_t seconds_per_year  = 52*7*24*3600;
+   static constexpr uint32_t blocks_per_day    = 2 * 24 * 3600;
+   static constexpr int64_t  useconds_per_day  = 24 * 3600 * int64_t(1000000);
+   static constexpr int64_t  useconds_per_year = seconds_per_year*1000000ll;
+
+   static constexpr double   continuous_rate       = 0.0198;   /// 2% annual rate, 0.04879 would be 5%
+   static constexpr int64_t  min_pervote_daily_pay = 100'0000;
+   static constexpr uint32_t names_per_close       = 10;       /// name auctions closed by onblock per day
+
+   /// claimrewards fills the buckets from the second claim after the chain is activated
+   inline bool bucket_fill_due( int64_t last_fill, int64_t now ) {
+      return last_fill > 0 && now > last_fill;
+   }
+
+   /// tokens issued for `usecs` of inflation at the continuous `rate` on `supply`
+   inline int64_t inflation( double rate, int64_t supply, int64_t usecs ) {
+      return static_cast<int64_t>( (rate * double(supply) * double(usecs)) / double(useconds_per_year) );
+   }
+
+   struct inflation_split {
+      int64_t per_block = 0; /// to eosio.bpay
+      int64_t per_vote  = 0; /// to eosio.vpay
+      int64_t gov_fund  = 0;
+      int64_t dev_fund  = 0;
+   };
+
+   /// half of the new tokens pay producers, a quarter of that for blocks, the rest goes to the funds
+   inline inflation_split split_inflation( int64_t new_tokens ) {
+      const int64_t to_producers = new_tokens / 2;
+      const int64_t to_savings   = new_tokens - to_producers;
+
+      inflation_split s;
+      s.per_block = to_producers / 4;
+      s.per_vote  = to_producers - s.per_block;
+      s.gov_fund  = to_savings / 5;
+      s.dev_fund  = to_savings - s.gov_fund;
+      return s;
+   }
+
+   /// share of the per-block bucket earned by `unpaid_blocks` of `total_unpaid_blocks`
+   inline int64_t per_block_pay( int64_t perblock_bucket, uint32_t unpaid_blocks, uint32_t total_unpaid_blocks ) {
+      if( total_unpaid_blocks == 0 )
+         return 0;
+      return (perblock_bucket * unpaid_blocks) / total_unpaid_blocks;
+   }
+
+   /// share of the per-vote bucket earned by `votepay_share`, nothing below `min_pay`
+   inline int64_t per_vote_pay( double votepay_share, int64_t pervote_bucket, double total_votepay_share, int64_t min_pay ) {
+      int64_t pay = 0;
+      if( total_votepay_share > 0 ) {
+         pay = int64_t((votepay_share * pervote_bucket) / total_votepay_share);
+         if( pay > pervote_bucket )
+            pay = pervote_bucket;
+      }
+      return pay < min_pay ? 0 : pay;
+   }
+
+   /// vote pay share accrued at `shares_rate` per second between `last_update` and `now`
+   inline double accrued_share( double shares_rate, int64_t last_update, int64_t now ) {
+      if( shares_rate > 0.0 && now > last_update )
+         return shares_rate * double( (now - last_update) / 1E6 ); // cannot be negative
+      return 0.0;
+   }
+
+   /**
+    *  The global vote pay accounting, kept in global2 and global3 by the contract: the vote pay
+    *  share of all producers together and the rate it grows at.
+    */
+   struct votepay_totals {
+      double   total_share = 0; /// total_producer_votepay_share
+      double   change_rate = 0; /// total_vpay_share_change_rate
+      int64_t  last_update = 0; /// last_vpay_state_update
+   };
+
+   /// brings `totals` up to `now` and applies the changes, neither total goes below zero
+   inline double update_totals( votepay_totals& totals, int64_t now,
+                                double additional_shares_delta, double shares_rate_delta )
+   {
+      double delta_total_share = 0.0;
+      if( now > totals.last_update ) {
+         delta_total_share = totals.change_rate * double( (now - totals.last_update) / 1E6 );
+      }
+
+      delta_total_share += additional_shares_delta;
+      if( delta_total_share < 0 && totals.total_share < -delta_total_share ) {
+         totals.total_share = 0.0;
+      } else {
+         totals.total_share += delta_total_share;
+      }
+
+      if( shares_rate_delta < 0 && totals.change_rate < -shares_rate_delta ) {
+         totals.change_rate = 0.0;
+      } else {
+         totals.change_rate += shares_rate_delta;
+      }
+
+      totals.last_update = now;
+      return totals.total_share;
+   }
+
+   /// a producer claims at most once a day
+   inline bool claim_allowed( int64_t last_claim_time, int64_t now ) {
+      return now - last_claim_time > useconds_per_day;
+   }
+
+   /// vote pay is only accrued while a producer claims at least every three days
+   inline bool crossed_claim_threshold( int64_t last_claim_time, int64_t now ) {
+      return last_claim_time + 3 * useconds_per_day <= now;
+   }
+
+   /// vote pay accounting of one producer, kept in its producer_tally row by the contract
+   struct producer_votepay {
+      double   share       = 0; /// votepay_share
+      int64_t  last_update = 0; /// last_votepay_share_update
+   };
+
+   /// accrues the share of `p` up to `now` at `shares_rate` and returns it, the stored share is reset if asked
+   inline double update_share( producer_votepay& p, int64_t now, double shares_rate, bool reset_to_zero ) {
+      const double new_share = p.share + accrued_share( shares_rate, p.last_update, now );
+      p.share       = reset_to_zero ? 0.0 : new_share;
+      p.last_update = now;
+      return new_share;
+   }
+
+   struct votepay_status {
+      bool tracked                 = false; /// vote pay is tracked for the producer
+      bool crossed_threshold       = false; /// the producer has not claimed for three days
+      bool updated_after_threshold = false; /// its share was updated since, implies crossed_threshold
+   };
+
+   /**
+    *  Where a producer stands in the vote pay accounting at `now`. A producer without tracked vote
+    *  pay counts as updated after the threshold: its first claim pays no vote pay either way and
+    *  only adds its votes to the global rate.
+    */
+   inline votepay_status get_votepay_status( bool tracked, int64_t last_claim_time, int64_t last_update, int64_t now ) {
+      votepay_status st;
+      st.tracked                 = tracked;
+      st.crossed_threshold       = crossed_claim_threshold( last_claim_time, now );
+      st.updated_after_threshold = !tracked || crossed_claim_threshold( last_claim_time, last_update );
+      return st;
+   }
+
+   /**
+    *  Vote pay accounting of claimrewards for a producer with `votes`: its share is accrued and
+    *  reset, its votes count towards the global rate again if they had dropped out of it. Returns
+    *  its part of `pervote_bucket`, nothing if it let three days pass without claiming.
+    */
+   inline int64_t claim_vote_pay( producer_votepay& p, votepay_totals& totals, int64_t pervote_bucket,
+                                  double votes, const votepay_status& st, int64_t now )
+   {
+      const double new_share   = update_share( p, now, st.updated_after_threshold ? 0.0 : votes, true );
+      const double total_share = update_totals( totals, now, 0.0, 0.0 );
+      const int64_t vote_pay   = st.crossed_threshold ? 0 : per_vote_pay( new_share, pervote_bucket, total_share, min_pervote_daily_pay );
+      update_totals( totals, now, -new_share, st.updated_after_threshold ? votes : 0.0 );
+      return vote_pay;
+   }
+
+   /// changes of the vote pay totals collected over the producers of one vote, applied once
+   struct votepay_changes {
+      votes::change rate_delta     = 0;
+      double        inactive_share = 0;
+   };
+
+   /**
+    *  Vote pay accounting of a change of the votes of a producer from `old_votes` to `new_votes`.
+    *  Its share accrues at the old votes, once it let three days pass without claiming the share
+    *  is reset and its votes leave the global rate until its next claim.
+    */
+   inline void change_votes( producer_votepay& p, votepay_changes& changes, votes::fixed old_votes, votes::fixed new_votes,
+                             const votepay_status& st, int64_t now )
+   {
+      if( !st.tracked )
+         return;
+      const double new_share = update_share( p, now, st.updated_after_threshold ? 0.0 : votes::to_double( old_votes ),
+                                             st.crossed_threshold && !st.updated_after_threshold );
+      if( !st.crossed_threshold ) {
+         changes.rate_delta += votes::change( new_votes ) - votes::change( old_votes );
+      } else if( !st.updated_after_threshold ) {
+         changes.inactive_share += new_share;
+         changes.rate_delta     -= votes::change( old_votes );
+      }
+   }
+
+   inline double apply_changes( votepay_totals& totals, const votepay_changes& changes, int64_t now ) {
+      return update_totals( totals, now, -changes.inactive_share, votes::to_double( changes.rate_delta ) );
+   }
+
+   /// onblock looks for a name auction to close at most once a day
+   inline bool name_close_due( uint32_t slot, uint32_t last_close_slot ) {
+      return slot - last_close_slot > blocks_per_day;
+   }
+
+   /// an auction closes a day after its last bid, once the chain has been active for two weeks
+   inline bool name_auction_closes( int64_t high_bid, int64_t last_bid_time, int64_t activated_time, int64_t now ) {
+      return high_bid > 0
+             && now - last_bid_time > useconds_per_day
+             && activated_time > 0
+             && now - activated_time > 14 * useconds_per_day;
+   }
+
+   /**
+    *  Closes the auctions of one daily close after the highest bid: `close_next` closes the next
+    *  auction without a bid for a day and returns false once there is none. The highest bid counts
+    *  towards names_per_close unless `highest_counts` is false. Returns the names counted.
+    */
+   template<typename CloseNext>
+   inline uint32_t close_names( bool highest_counts, CloseNext&& close_next ) {
+      uint32_t closed = highest_counts ? 1 : 0;
+      while( closed < names_per_close && close_next() )
+         ++closed;
+      return closed;
+   }
+
+} } /// namespace eosiosystem::pay
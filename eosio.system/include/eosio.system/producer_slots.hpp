@@ -0,0 +1,57 @@
+/**
+ *  @file
+ *  @copyright defined in eos/LICENSE.txt
+ */
+#pragma once
+
+#include <algorithm>
+#include <cstdint>
+#include <vector>
+
+namespace eosiosystem { namespace slots {
+
+   /**
+    *  Compact list of the producers a voter votes for.
+    *
+    *  Every producer has a small slot id, see producer_slot. A list of producers is stored as its
+    *  slot ids in ascending order, each written as the LEB128 varint of its distance to the previous
+    *  one, so 30 producers among the first few hundred slots take about 30 bytes instead of 240.
+    *  Like vote_weight.hpp this has no dependency on eosiolib and is also used by the native tests.
+    */
+   inline std::vector<uint8_t> encode( std::vector<uint64_t> ids ) {
+      std::sort( ids.begin(), ids.end() );
+
+      std::vector<uint8_t> bytes;
+      bytes.reserve( ids.size() + ids.size() / 2 );
+      uint64_t prev = 0;
+      for( uint64_t id : ids ) {
+         uint64_t gap = id - prev;
+         prev = id;
+         do {
+            uint8_t b = gap & 0x7f;
+            gap >>= 7;
+            bytes.push_back( gap ? b | 0x80 : b );
+         } while( gap );
+      }
+      return bytes;
+   }
+
+   /// slot ids in ascending order
+   inline std::vector<uint64_t> decode( const std::vector<uint8_t>& bytes ) {
+      std::vector<uint64_t> ids;
+      uint64_t prev = 0, gap = 0;
+      uint32_t shift = 0;
+      for( uint8_t b : bytes ) {
+         gap |= uint64_t( b & 0x7f ) << shift;
+         shift += 7;
+         if( !(b & 0x80) ) {
+            prev += gap;
+            ids.push_back( prev );
+            gap   = 0;
+            shift = 0;
+         }
+      }
+      return ids;
+   }
+
+} } /// namespace eosiosystem::slots
@@ -0,0 +1,96 @@
+/**
+ *  @file
+ *  @copyright defined in eos/LICENSE.txt
+ */
+#pragma once
+
+#include <cstdint>
+
+#ifdef __wasm__
+#include <eosiolib/system.h>
+#else
+#include <stdexcept>
+#endif
+
+namespace eosiosystem { namespace votes {
+
+   /**
+    *  Fixed point vote weights with 32 fractional bits.
+    *
+    *  Voter weights, producer vote totals and their sum are kept in this representation so that
+    *  adding, subtracting and comparing them is integer arithmetic and the vote index orders
+    *  producers exactly. Like bancor.hpp this has no dependency on eosiolib apart from the range
+    *  check and is also used by the native tests.
+    */
+   typedef unsigned __int128 fixed;
+   typedef __int128          change; /// difference of two weights
+
+   static constexpr uint32_t fraction_bits = 32;
+   static constexpr double   scale         = 4294967296.0; /// 2^fraction_bits
+   static constexpr fixed    one           = fixed(1) << fraction_bits;
+
+   /**
+    *  Largest weight. A weight is stake * 2^(weeks since 2000 / 52) * 2^32, a total stake of 1e14
+    *  units reaches this around 2048. Changes that would go past it fail instead of wrapping, which
+    *  would also let active and inactive producers overlap in index_key.
+    */
+   static constexpr fixed    max_weight    = ( fixed(1) << 127 ) - 1;
+
+   /// fails the action in the contract, throws in native code
+   inline void check_range( bool in_range ) {
+#ifdef __wasm__
+      eosio_assert( in_range, "vote weight out of range" );
+#else
+      if( !in_range ) throw std::out_of_range( "vote weight out of range" );
+#endif
+   }
+
+   /// negative weights are clamped to zero
+   inline fixed from_double( double weight ) {
+      if( !( weight > 0 ) )
+         return 0;
+      check_range( weight * scale < double( max_weight ) );
+      return fixed( weight * scale );
+   }
+
+   inline double to_double( fixed weight ) {
+      return double( weight ) / scale;
+   }
+
+   inline double to_double( change weight ) {
+      return double( weight ) / scale;
+   }
+
+   /**
+    *  Weight of `staked` tokens at a weight of `per_token` each. The product is exact, the rounding
+    *  is in `per_token`: the weekly 2^(weeks since 2000 / 52) cut to a multiple of 2^-32 by
+    *  from_double, a relative error below 2^-52 from 2020 on. Every stake of a week is weighted with
+    *  the same rounded value, so weights and their sums stay consistent.
+    */
+   inline fixed stake_weight( int64_t staked, fixed per_token ) {
+      if( staked <= 0 )
+         return 0;
+      check_range( per_token <= max_weight / uint64_t(staked) );
+      return per_token * uint64_t(staked);
+   }
+
+   /// adds a (possibly negative) weight change, the total never goes below zero
+   inline fixed add( fixed total, change delta ) {
+      if( delta >= 0 ) {
+         check_range( fixed(delta) <= max_weight - total );
+         return total + fixed(delta);
+      }
+      const fixed d = fixed(-delta);
+      return d < total ? total - d : 0;
+   }
+
+   /**
+    *  Key of the vote index: active producers first by descending votes, then inactive producers
+    *  by ascending votes. No weight exceeds max_weight, which keeps both halves apart.
+    */
+   inline fixed index_key( fixed weight, bool active ) {
+      const fixed half = fixed(1) << 127;
+      return active ? half - 1 - weight : half + weight;
+   }
+
+} } /// namespace eosiosystem::votes
@@ -66,7 +66,8 @@ namespace eosiosystem {
       eosio::asset    net_amount;
       eosio::asset    cpu_amount;
 
-      uint64_t  primary_key()const { return owner.value; }
+      uint64_t  primary_key()const     { return owner.value; }
+      uint64_t  by_request_time()const { return request_time.utc_seconds; }
 
       // explicit serialization macro is not necessary, used here only to improve compilation time
       EOSLIB_SERIALIZE( refund_request, (owner)(request_time)(net_amount)(cpu_amount) )
@@ -80,18 +81,47 @@ namespace eosiosystem {
    typedef eosio::multi_index< "delband"_n, delegated_bandwidth > del_bandwidth_table;
    typedef eosio::multi_index< "refunds"_n, refund_request >      refunds_table;
 
+   /**
+    *  Pending refunds of all accounts in the scope of the contract, ordered by request time so that
+    *  procrefunds finds the matured ones first. Replaces the per account refunds table and the
+    *  deferred refund transaction that came with every row of it.
+    */
+   typedef eosio::multi_index< "refundqueue"_n, refund_request,
+                               indexed_by<"byreqtime"_n, const_mem_fun<refund_request, uint64_t, &refund_request::by_request_time> >
+                             > refund_queue_table;
+
+   /**
+    *  Resources bought by newacctres for an account that does not exist yet. The inline
+    *  newaccount that follows in the same transaction creates the account's resource row from it
+    *  and erases it, so rows never outlive the transaction.
+    */
+   struct [[eosio::table("pendacctres"), eosio::contract("eosio.system")]] pending_account_resources {
+      name            account;
+      int64_t         ram_bytes = 0;
+      asset           net_weight;
+      asset           cpu_weight;
+
+      uint64_t  primary_key()const { return account.value; }
+
+      // explicit serialization macro is not necessary, used here only to improve compilation time
+      EOSLIB_SERIALIZE( pending_account_resources, (account)(ram_bytes)(net_weight)(cpu_weight) )
+   };
+   typedef eosio::multi_index< "pendacctres"_n, pending_account_resources > pending_account_resources_table;
+
 
 
    /**
     *  This action will buy an exact amount of ram and bill the payer the current market price.
     */
    void system_contract::buyrambytes( name payer, name receiver, uint32_t bytes ) {
+      update_ram_supply();
 
-      auto itr = _rammarket.find(ramcore_symbol.raw());
-      auto tmp = *itr;
-      auto eosout = tmp.convert( asset(bytes, ram_symbol), core_symbol() );
+      const auto& market = _rammarket.get(ramcore_symbol.raw(), "ram market does not exist");
+      const int64_t cost = exchange_state::get_bancor_input( market.base.balance.amount, market.quote.balance.amount, bytes );
+      /// buyram takes a .5% fee rounded up, cost + ceil(cost/199) leaves at least cost after the fee
+      const int64_t cost_plus_fee = cost + ( cost + 198 ) / 199;
 
-      buyram( payer, receiver, eosout );
+      buyram( payer, receiver, asset{ cost_plus_fee, core_symbol() } );
    }
 
 
@@ -119,32 +149,87 @@ namespace eosiosystem {
       auto quant_after_fee = quant;
       quant_after_fee.amount -= fee.amount;
       // quant_after_fee.amount should be > 0 if quant.amount > 1.
-      // If quant.amount == 1, then quant_after_fee.amount == 0 and the next inline transfer will fail causing the buyram action to fail.
+      // If quant.amount == 1, then quant_after_fee.amount == 0 and no bytes are reserved, causing the buyram action to fail.
 
+      // the fee is paid to eosio.ram together with the purchase and accrued until sweepramfee
       INLINE_ACTION_SENDER(eosio::token, transfer)(
          token_account, { {payer, active_permission}, {ram_account, active_permission} },
-         { payer, ram_account, quant_after_fee, std::string("buy ram") }
+         { payer, ram_account, quant, std::string("buy ram") }
       );
 
-      if( fee.amount > 0 ) {
-         INLINE_ACTION_SENDER(eosio::token, transfer)(
-            token_account, { {payer, active_permission} },
-            { payer, ramfee_account, fee, std::string("ram fee") }
-         );
-      }
-
       int64_t bytes_out;
 
       const auto& market = _rammarket.get(ramcore_symbol.raw(), "ram market does not exist");
       _rammarket.modify( market, same_payer, [&]( auto& es ) {
-          bytes_out = es.convert( quant_after_fee,  ram_symbol ).amount;
+          bytes_out = es.direct_convert( quant_after_fee, ram_symbol ).amount;
       });
 
       eosio_assert( bytes_out > 0, "must reserve a positive amount" );
 
-      _gstate.total_ram_bytes_reserved += uint64_t(bytes_out);
-      _gstate.total_ram_stake          += quant_after_fee.amount;
+      auto& ghot = _ghot.modify();
+      ghot.total_ram_bytes_reserved += uint64_t(bytes_out);
+      ghot.total_ram_stake          += quant_after_fee.amount;
+      ghot.ram_fee                  += fee.amount;
+
+      add_ram_bytes( receiver, bytes_out );
+   }
+
+   /**
+    *  Buys an exact amount of ram for each receiver, priced as one purchase of the bytes of all of
+    *  them. The payer is billed with one transfer and the ram market row is written once. The few
+    *  bytes the market returns beyond the requested total go to the first receiver.
+    */
+   void system_contract::buyrambatch( name payer, const std::vector<ram_purchase>& purchases ) {
+      require_auth( payer );
+      eosio_assert( !purchases.empty(), "no receivers given" );
+
+      int64_t total_bytes = 0;
+      for( const auto& p : purchases ) {
+         eosio_assert( p.bytes > 0, "must purchase a positive amount" );
+         total_bytes += p.bytes; // at most 2^32 per receiver, a transaction cannot hold enough receivers to overflow
+      }
+
+      const int64_t bytes_out = purchase_ram_bytes( payer, total_bytes );
+      int64_t rest = bytes_out - total_bytes;
+      for( const auto& p : purchases ) {
+         add_ram_bytes( p.receiver, p.bytes + rest );
+         rest = 0;
+      }
+   }
+
+   /**
+    *  Buys at least `bytes` from the ram market for the price and fee of buyrambytes, paid by
+    *  `payer` with one transfer. The caller adds the bytes returned to the quotas.
+    */
+   int64_t system_contract::purchase_ram_bytes( name payer, int64_t bytes ) {
+      update_ram_supply();
+
+      const auto& market = _rammarket.get(ramcore_symbol.raw(), "ram market does not exist");
+      const int64_t cost = exchange_state::get_bancor_input( market.base.balance.amount, market.quote.balance.amount, bytes );
+      const asset quant( cost + ( cost + 198 ) / 199, core_symbol() );
+      const asset fee( ( quant.amount + 199 ) / 200, core_symbol() );
+      const asset quant_after_fee = quant - fee;
+
+      INLINE_ACTION_SENDER(eosio::token, transfer)(
+         token_account, { {payer, active_permission}, {ram_account, active_permission} },
+         { payer, ram_account, quant, std::string("buy ram") }
+      );
+
+      int64_t bytes_out;
+      _rammarket.modify( market, same_payer, [&]( auto& es ) {
+          bytes_out = es.direct_convert( quant_after_fee, ram_symbol ).amount;
+      });
+      eosio_assert( bytes_out >= bytes, "must reserve the requested amount" ); // get_bancor_input is exact
 
+      auto& ghot = _ghot.modify();
+      ghot.total_ram_bytes_reserved += uint64_t(bytes_out);
+      ghot.total_ram_stake          += quant_after_fee.amount;
+      ghot.ram_fee                  += fee.amount;
+      return bytes_out;
+   }
+
+   /// adds bought bytes to the ram quota of `receiver`, who pays for its resource row
+   void system_contract::add_ram_bytes( name receiver, int64_t bytes ) {
       user_resources_table  userres( _self, receiver.value );
       auto res_itr = userres.find( receiver.value );
       if( res_itr ==  userres.end() ) {
@@ -152,19 +237,17 @@ namespace eosiosystem {
                res.owner = receiver;
                res.net_weight = asset( 0, core_symbol() );
                res.cpu_weight = asset( 0, core_symbol() );
-               res.ram_bytes = bytes_out;
+               res.ram_bytes = bytes;
             });
       } else {
          userres.modify( res_itr, receiver, [&]( auto& res ) {
-               res.ram_bytes += bytes_out;
+               res.ram_bytes += bytes;
             });
       }
 
       auto voter_itr = _voters.find( res_itr->owner.value );
       if( voter_itr == _voters.end() || !has_field( voter_itr->flags1, voter_info::flags1_fields::ram_managed ) ) {
-         int64_t ram_bytes, net, cpu;
-         get_resource_limits( res_itr->owner.value, &ram_bytes, &net, &cpu );
-         set_resource_limits( res_itr->owner.value, res_itr->ram_bytes + ram_gift_bytes, net, cpu );
+         _limits.get( res_itr->owner ).ram_bytes = res_itr->ram_bytes + ram_gift_bytes;
       }
    }
 
@@ -189,16 +272,21 @@ namespace eosiosystem {
       auto itr = _rammarket.find(ramcore_symbol.raw());
       _rammarket.modify( itr, same_payer, [&]( auto& es ) {
           /// the cast to int64_t of bytes is safe because we certify bytes is <= quota which is limited by prior purchases
-          tokens_out = es.convert( asset(bytes, ram_symbol), core_symbol());
+          tokens_out = es.direct_convert( asset(bytes, ram_symbol), core_symbol());
       });
 
       eosio_assert( tokens_out.amount > 1, "token amount received from selling ram is too low" );
 
-      _gstate.total_ram_bytes_reserved -= static_cast<decltype(_gstate.total_ram_bytes_reserved)>(bytes); // bytes > 0 is asserted above
-      _gstate.total_ram_stake          -= tokens_out.amount;
+      auto fee = ( tokens_out.amount + 199 ) / 200; /// .5% fee (round up)
+      // since tokens_out.amount was asserted to be at least 2 earlier, fee < tokens_out.amount
+
+      auto& ghot = _ghot.modify();
+      ghot.total_ram_bytes_reserved -= static_cast<decltype(ghot.total_ram_bytes_reserved)>(bytes); // bytes > 0 is asserted above
+      ghot.total_ram_stake          -= tokens_out.amount;
+      ghot.ram_fee                  += fee;
 
       //// this shouldn't happen, but just in case it does we should prevent it
-      eosio_assert( _gstate.total_ram_stake >= 0, "error, attempt to unstake more tokens than previously staked" );
+      eosio_assert( ghot.total_ram_stake >= 0, "error, attempt to unstake more tokens than previously staked" );
 
       userres.modify( res_itr, account, [&]( auto& res ) {
           res.ram_bytes -= bytes;
@@ -206,24 +294,25 @@ namespace eosiosystem {
 
       auto voter_itr = _voters.find( res_itr->owner.value );
       if( voter_itr == _voters.end() || !has_field( voter_itr->flags1, voter_info::flags1_fields::ram_managed ) ) {
-         int64_t ram_bytes, net, cpu;
-         get_resource_limits( res_itr->owner.value, &ram_bytes, &net, &cpu );
-         set_resource_limits( res_itr->owner.value, res_itr->ram_bytes + ram_gift_bytes, net, cpu );
+         _limits.get( res_itr->owner ).ram_bytes = res_itr->ram_bytes + ram_gift_bytes;
       }
 
+      // the fee stays with eosio.ram until sweepramfee
       INLINE_ACTION_SENDER(eosio::token, transfer)(
          token_account, { {ram_account, active_permission}, {account, active_permission} },
-         { ram_account, account, asset(tokens_out), std::string("sell ram") }
+         { ram_account, account, asset(tokens_out.amount - fee, core_symbol()), std::string("sell ram") }
       );
+   }
 
-      auto fee = ( tokens_out.amount + 199 ) / 200; /// .5% fee (round up)
-      // since tokens_out.amount was asserted to be at least 2 earlier, fee.amount < tokens_out.amount
-      if( fee > 0 ) {
-         INLINE_ACTION_SENDER(eosio::token, transfer)(
-            token_account, { {account, active_permission} },
-            { account, ramfee_account, asset(fee, core_symbol()), std::string("sell ram fee") }
-         );
-      }
+   void system_contract::sweepramfee() {
+      const int64_t fee = _ghot.get().ram_fee;
+      eosio_assert( fee > 0, "no ram fee to sweep" );
+      _ghot.modify().ram_fee = 0;
+
+      INLINE_ACTION_SENDER(eosio::token, transfer)(
+         token_account, { {ram_account, active_permission} },
+         { ram_account, ramfee_account, asset(fee, core_symbol()), std::string("ram fee") }
+      );
    }
 
    void validate_bos_vesting( int64_t stake ) {
@@ -248,6 +337,37 @@ namespace eosiosystem {
          from = receiver;
       }
 
+      update_delegated_bandwidth( from, receiver, stake_net_delta, stake_cpu_delta );
+
+      // create refund or update from existing refund
+      if ( stake_account != source_stake_from ) { //for eosio both transfer and refund make no sense
+         auto net_balance = stake_net_delta;
+         auto cpu_balance = stake_cpu_delta;
+
+         // net and cpu are same sign by assertions in delegatebw and undelegatebw
+         // redundant assertion also at start of changebw to protect against misuse of changebw
+         bool is_undelegating = (net_balance.amount + cpu_balance.amount ) < 0;
+         bool is_delegating_to_self = (!transfer && from == receiver);
+
+         if( is_delegating_to_self || is_undelegating ) {
+            update_refund( from, net_balance, cpu_balance );
+         }
+
+         auto transfer_amount = net_balance + cpu_balance;
+         if ( 0 < transfer_amount.amount ) {
+            INLINE_ACTION_SENDER(eosio::token, transfer)(
+               token_account, { {source_stake_from, active_permission} },
+               { source_stake_from, stake_account, asset(transfer_amount), std::string("stake bandwidth") }
+            );
+         }
+      }
+
+      update_voter_stake( from, stake_net_delta + stake_cpu_delta );
+   }
+
+   void system_contract::update_delegated_bandwidth( name from, name receiver,
+                                                     const asset stake_net_delta, const asset stake_cpu_delta )
+   {
       // update stake delegated from "from" to "receiver"
       {
          del_bandwidth_table     del_tbl( _self, from.value );
@@ -305,13 +425,16 @@ namespace eosiosystem {
             }
 
             if( !(net_managed && cpu_managed) ) {
-               int64_t ram_bytes, net, cpu;
-               get_resource_limits( receiver.value, &ram_bytes, &net, &cpu );
-
-               set_resource_limits( receiver.value,
-                                    ram_managed ? ram_bytes : std::max( tot_itr->ram_bytes + ram_gift_bytes, ram_bytes ),
-                                    net_managed ? net : tot_itr->net_weight.amount,
-                                    cpu_managed ? cpu : tot_itr->cpu_weight.amount );
+               auto& limits = _limits.get( receiver );
+               if( !ram_managed ) {
+                  limits.ram_bytes = std::max( tot_itr->ram_bytes + ram_gift_bytes, limits.ram_bytes );
+               }
+               if( !net_managed ) {
+                  limits.net_weight = tot_itr->net_weight.amount;
+               }
+               if( !cpu_managed ) {
+                  limits.cpu_weight = tot_itr->cpu_weight.amount;
+               }
             }
          }
 
@@ -319,120 +442,98 @@ namespace eosiosystem {
             totals_tbl.erase( tot_itr );
          }
       } // tot_itr can be invalid, should go out of scope
+   }
 
-      // create refund or update from existing refund
-      if ( stake_account != source_stake_from ) { //for eosio both transfer and refund make no sense
-         refunds_table refunds_tbl( _self, from.value );
-         auto req = refunds_tbl.find( from.value );
-
-         //create/update/delete refund
-         auto net_balance = stake_net_delta;
-         auto cpu_balance = stake_cpu_delta;
-         bool need_deferred_trx = false;
-
-
-         // net and cpu are same sign by assertions in delegatebw and undelegatebw
-         // redundant assertion also at start of changebw to protect against misuse of changebw
-         bool is_undelegating = (net_balance.amount + cpu_balance.amount ) < 0;
-         bool is_delegating_to_self = (!transfer && from == receiver);
+   /**
+    *  Folds a stake change of from into its pending refund. Unstaked amounts are added to the refund,
+    *  staked amounts are taken from it first; whatever the refund does not cover is left in the balances.
+    */
+   void system_contract::update_refund( name from, asset& net_balance, asset& cpu_balance )
+   {
+      refund_queue_table refunds_tbl( _self, _self.value );
+      auto req = refunds_tbl.find( from.value );
+
+      if ( req == refunds_tbl.end() ) {
+         refunds_table legacy_tbl( _self, from.value );
+         auto legacy = legacy_tbl.find( from.value );
+         if ( legacy != legacy_tbl.end() ) {
+            // requested before the refund queue existed, the queue takes over from its deferred refund
+            req = refunds_tbl.emplace( from, [&]( refund_request& r ) {
+               r = *legacy;
+            });
+            legacy_tbl.erase( legacy );
+            cancel_deferred( from.value );
+         }
+      }
 
-         if( is_delegating_to_self || is_undelegating ) {
-            if ( req != refunds_tbl.end() ) { //need to update refund
-               refunds_tbl.modify( req, same_payer, [&]( refund_request& r ) {
-                  if ( net_balance.amount < 0 || cpu_balance.amount < 0 ) {
-                     r.request_time = current_time_point();
-                  }
-                  r.net_amount -= net_balance;
-                  if ( r.net_amount.amount < 0 ) {
-                     net_balance = -r.net_amount;
-                     r.net_amount.amount = 0;
-                  } else {
-                     net_balance.amount = 0;
-                  }
-                  r.cpu_amount -= cpu_balance;
-                  if ( r.cpu_amount.amount < 0 ){
-                     cpu_balance = -r.cpu_amount;
-                     r.cpu_amount.amount = 0;
-                  } else {
-                     cpu_balance.amount = 0;
-                  }
-               });
+      if ( req != refunds_tbl.end() ) { //need to update refund
+         refunds_tbl.modify( req, same_payer, [&]( refund_request& r ) {
+            if ( net_balance.amount < 0 || cpu_balance.amount < 0 ) {
+               r.request_time = current_time_point();
+            }
+            r.net_amount -= net_balance;
+            if ( r.net_amount.amount < 0 ) {
+               net_balance = -r.net_amount;
+               r.net_amount.amount = 0;
+            } else {
+               net_balance.amount = 0;
+            }
+            r.cpu_amount -= cpu_balance;
+            if ( r.cpu_amount.amount < 0 ){
+               cpu_balance = -r.cpu_amount;
+               r.cpu_amount.amount = 0;
+            } else {
+               cpu_balance.amount = 0;
+            }
+         });
 
-               eosio_assert( 0 <= req->net_amount.amount, "negative net refund amount" ); //should never happen
-               eosio_assert( 0 <= req->cpu_amount.amount, "negative cpu refund amount" ); //should never happen
+         eosio_assert( 0 <= req->net_amount.amount, "negative net refund amount" ); //should never happen
+         eosio_assert( 0 <= req->cpu_amount.amount, "negative cpu refund amount" ); //should never happen
 
-               if ( req->net_amount.amount == 0 && req->cpu_amount.amount == 0 ) {
-                  refunds_tbl.erase( req );
-                  need_deferred_trx = false;
-               } else {
-                  need_deferred_trx = true;
-               }
-            } else if ( net_balance.amount < 0 || cpu_balance.amount < 0 ) { //need to create refund
-               refunds_tbl.emplace( from, [&]( refund_request& r ) {
-                  r.owner = from;
-                  if ( net_balance.amount < 0 ) {
-                     r.net_amount = -net_balance;
-                     net_balance.amount = 0;
-                  } else {
-                     r.net_amount = asset( 0, core_symbol() );
-                  }
-                  if ( cpu_balance.amount < 0 ) {
-                     r.cpu_amount = -cpu_balance;
-                     cpu_balance.amount = 0;
-                  } else {
-                     r.cpu_amount = asset( 0, core_symbol() );
-                  }
-                  r.request_time = current_time_point();
-               });
-               need_deferred_trx = true;
-            } // else stake increase requested with no existing row in refunds_tbl -> nothing to do with refunds_tbl
-         } /// end if is_delegating_to_self || is_undelegating
-
-         if ( need_deferred_trx ) {
-            eosio::transaction out;
-            out.actions.emplace_back( permission_level{from, active_permission},
-                                      _self, "refund"_n,
-                                      from
-            );
-            out.delay_sec = refund_delay_sec;
-            cancel_deferred( from.value ); // TODO: Remove this line when replacing deferred trxs is fixed
-            out.send( from.value, from, true );
-         } else {
-            cancel_deferred( from.value );
+         if ( req->net_amount.amount == 0 && req->cpu_amount.amount == 0 ) {
+            refunds_tbl.erase( req );
          }
+      } else if ( net_balance.amount < 0 || cpu_balance.amount < 0 ) { //need to create refund
+         refunds_tbl.emplace( from, [&]( refund_request& r ) {
+            r.owner = from;
+            if ( net_balance.amount < 0 ) {
+               r.net_amount = -net_balance;
+               net_balance.amount = 0;
+            } else {
+               r.net_amount = asset( 0, core_symbol() );
+            }
+            if ( cpu_balance.amount < 0 ) {
+               r.cpu_amount = -cpu_balance;
+               cpu_balance.amount = 0;
+            } else {
+               r.cpu_amount = asset( 0, core_symbol() );
+            }
+            r.request_time = current_time_point();
+         });
+      } // else stake increase requested with no existing row in refunds_tbl -> nothing to do with refunds_tbl
+   }
 
-         auto transfer_amount = net_balance + cpu_balance;
-         if ( 0 < transfer_amount.amount ) {
-            INLINE_ACTION_SENDER(eosio::token, transfer)(
-               token_account, { {source_stake_from, active_permission} },
-               { source_stake_from, stake_account, asset(transfer_amount), std::string("stake bandwidth") }
-            );
-         }
+   void system_contract::update_voter_stake( name from, const asset total_update )
+   {
+      auto from_voter = _voters.find( from.value );
+      if( from_voter == _voters.end() ) {
+         from_voter = _voters.emplace( from, [&]( auto& v ) {
+               v.owner  = from;
+               v.staked = total_update.amount;
+            });
+      } else {
+         _voters.modify( from_voter, same_payer, [&]( auto& v ) {
+               v.staked += total_update.amount;
+            });
       }
+      eosio_assert( 0 <= from_voter->staked, "stake for voting cannot be negative");
 
-      // update voting power
-      {
-         asset total_update = stake_net_delta + stake_cpu_delta;
-         auto from_voter = _voters.find( from.value );
-         if( from_voter == _voters.end() ) {
-            from_voter = _voters.emplace( from, [&]( auto& v ) {
-                  v.owner  = from;
-                  v.staked = total_update.amount;
-               });
-         } else {
-            _voters.modify( from_voter, same_payer, [&]( auto& v ) {
-                  v.staked += total_update.amount;
-               });
-         }
-         eosio_assert( 0 <= from_voter->staked, "stake for voting cannot be negative");
-         
-         if( from == "bos"_n ) {
-            validate_bos_vesting( from_voter->staked );
-         }
+      if( from == "bos"_n ) {
+         validate_bos_vesting( from_voter->staked );
+      }
 
-         if( from_voter->producers.size() || from_voter->proxy ) {
-            update_votes( from, from_voter->proxy, from_voter->producers, false );
-         }
+      if( from_voter->has_producers() || from_voter->proxy ) {
+         update_votes( from, from_voter->proxy, voted_producers( *from_voter ), false );
       }
    }
 
@@ -458,29 +559,186 @@ namespace eosiosystem {
       eosio_assert( unstake_cpu_quantity.amount + unstake_net_quantity.amount > 0, "must unstake a positive amount" );
       // eosio_assert( _gstate.total_activated_stake >= min_activated_stake,
       //               "cannot undelegate bandwidth until the chain is activated (at least 15% of all tokens participate in voting)" );
-      eosio_assert( _gstate.thresh_activated_stake_time != time_point(),
+      eosio_assert( _ghot.get().thresh_activated_stake_time != time_point(),
                     "cannot undelegate bandwidth until the chain is activated " );
 
 
       changebw( from, receiver, -unstake_net_quantity, -unstake_cpu_quantity, false);
    } // undelegatebw
 
+   void system_contract::delegatebatch( name from, const std::vector<bandwidth_delta>& receivers )
+   {
+      require_auth( from );
+      eosio_assert( !receivers.empty(), "no receivers to delegate to" );
+
+      const asset zero_asset( 0, core_symbol() );
+      asset self_net = zero_asset, self_cpu = zero_asset, others = zero_asset;
+      for( const auto& d : receivers ) {
+         eosio_assert( d.cpu_quantity >= zero_asset, "must stake a positive amount" );
+         eosio_assert( d.net_quantity >= zero_asset, "must stake a positive amount" );
+         eosio_assert( d.net_quantity.amount + d.cpu_quantity.amount > 0, "must stake a positive amount" );
+
+         update_delegated_bandwidth( from, d.receiver, d.net_quantity, d.cpu_quantity );
+         if( d.receiver == from ) {
+            self_net += d.net_quantity;
+            self_cpu += d.cpu_quantity;
+         } else {
+            others += d.net_quantity + d.cpu_quantity;
+         }
+      }
+
+      const asset total_update = self_net + self_cpu + others;
+      if ( stake_account != from ) {
+         // only stake delegated to self is taken from a pending refund, as in delegatebw
+         if( self_net.amount + self_cpu.amount > 0 ) {
+            update_refund( from, self_net, self_cpu );
+         }
+
+         auto transfer_amount = self_net + self_cpu + others;
+         if ( 0 < transfer_amount.amount ) {
+            INLINE_ACTION_SENDER(eosio::token, transfer)(
+               token_account, { {from, active_permission} },
+               { from, stake_account, asset(transfer_amount), std::string("stake bandwidth") }
+            );
+         }
+      }
+
+      update_voter_stake( from, total_update );
+   } // delegatebatch
+
+   /**
+    *  Creates an account with ram and delegated stake in one action instead of newaccount,
+    *  buyrambytes and delegatebw. The ram and the stake are paid and accounted here. The account
+    *  does not exist before the inline newaccount sent last, which creates its resource row and
+    *  sets its limits once from the pending_account_resources row left for it.
+    */
+   void system_contract::newacctres( name creator, name newact, const authority& owner, const authority& active,
+                                     uint32_t ram_bytes, asset stake_net_quantity, asset stake_cpu_quantity )
+   {
+      require_auth( creator );
+      eosio_assert( !is_account( newact ), "account already exists" );
+
+      const asset zero_asset( 0, core_symbol() );
+      eosio_assert( ram_bytes > 0, "must purchase a positive amount" );
+      eosio_assert( stake_cpu_quantity >= zero_asset, "must stake a positive amount" );
+      eosio_assert( stake_net_quantity >= zero_asset, "must stake a positive amount" );
+
+      const int64_t bytes_out = purchase_ram_bytes( creator, ram_bytes );
+
+      const asset stake = stake_net_quantity + stake_cpu_quantity;
+      if( stake.amount > 0 ) {
+         // the stake stays with the creator as with delegatebw without transfer
+         del_bandwidth_table del_tbl( _self, creator.value );
+         del_tbl.emplace( creator, [&]( auto& dbo ){
+               dbo.from          = creator;
+               dbo.to            = newact;
+               dbo.net_weight    = stake_net_quantity;
+               dbo.cpu_weight    = stake_cpu_quantity;
+            });
+
+         if ( stake_account != creator ) {
+            INLINE_ACTION_SENDER(eosio::token, transfer)(
+               token_account, { {creator, active_permission} },
+               { creator, stake_account, stake, std::string("stake bandwidth") }
+            );
+         }
+         update_voter_stake( creator, stake );
+      }
+
+      pending_account_resources_table pending( _self, _self.value );
+      pending.emplace( creator, [&]( auto& p ) {
+            p.account    = newact;
+            p.ram_bytes  = bytes_out;
+            p.net_weight = stake_net_quantity;
+            p.cpu_weight = stake_cpu_quantity;
+         });
+
+      eosio::action( permission_level{ creator, active_permission }, _self, "newaccount"_n,
+                     std::make_tuple( creator, newact, owner, active ) ).send();
+   } // newacctres
+
+   void system_contract::undelbatch( name from, const std::vector<bandwidth_delta>& receivers )
+   {
+      require_auth( from );
+      eosio_assert( !receivers.empty(), "no receivers to undelegate from" );
+      eosio_assert( _ghot.get().thresh_activated_stake_time != time_point(),
+                    "cannot undelegate bandwidth until the chain is activated " );
+
+      const asset zero_asset( 0, core_symbol() );
+      asset net_balance = zero_asset, cpu_balance = zero_asset;
+      for( const auto& d : receivers ) {
+         eosio_assert( d.cpu_quantity >= zero_asset, "must unstake a positive amount" );
+         eosio_assert( d.net_quantity >= zero_asset, "must unstake a positive amount" );
+         eosio_assert( d.net_quantity.amount + d.cpu_quantity.amount > 0, "must unstake a positive amount" );
+
+         update_delegated_bandwidth( from, d.receiver, -d.net_quantity, -d.cpu_quantity );
+         net_balance -= d.net_quantity;
+         cpu_balance -= d.cpu_quantity;
+      }
+
+      const asset total_update = net_balance + cpu_balance;
+      if ( stake_account != from ) {
+         update_refund( from, net_balance, cpu_balance );
+      }
+
+      update_voter_stake( from, total_update );
+   } // undelbatch
+
  
    void system_contract::refund( const name owner ) {
       require_auth( owner );
 
-      refunds_table refunds_tbl( _self, owner.value );
+      auto pay = [&]( auto& refunds_tbl, auto req ) {
+         eosio_assert( req->request_time + seconds(refund_delay_sec) <= current_time_point(),
+                       "refund is not available yet" );
+
+         INLINE_ACTION_SENDER(eosio::token, transfer)(
+            token_account, { {stake_account, active_permission}, {req->owner, active_permission} },
+            { stake_account, req->owner, req->net_amount + req->cpu_amount, std::string("unstake") }
+         );
+
+         refunds_tbl.erase( req );
+      };
+
+      refund_queue_table refunds_tbl( _self, _self.value );
       auto req = refunds_tbl.find( owner.value );
-      eosio_assert( req != refunds_tbl.end(), "refund request not found" );
-      eosio_assert( req->request_time + seconds(refund_delay_sec) <= current_time_point(),
-                    "refund is not available yet" );
+      if ( req != refunds_tbl.end() ) {
+         pay( refunds_tbl, req );
+         return;
+      }
 
-      INLINE_ACTION_SENDER(eosio::token, transfer)(
-         token_account, { {stake_account, active_permission}, {req->owner, active_permission} },
-         { stake_account, req->owner, req->net_amount + req->cpu_amount, std::string("unstake") }
-      );
+      // requested before the refund queue existed, also reached by its deferred refund
+      refunds_table legacy_tbl( _self, owner.value );
+      auto legacy = legacy_tbl.find( owner.value );
+      eosio_assert( legacy != legacy_tbl.end(), "refund request not found" );
+      pay( legacy_tbl, legacy );
+   }
+
+   void system_contract::procrefunds( name cursor, uint32_t max ) {
+      eosio_assert( max > 0, "max must be positive" );
 
-      refunds_tbl.erase( req );
+      refund_queue_table refunds_tbl( _self, _self.value );
+      auto idx = refunds_tbl.get_index<"byreqtime"_n>();
+      const auto ct = current_time_point();
+
+      // an owner refusing the transfer would stop every call at the head of the queue
+      auto req = idx.begin();
+      if ( cursor != name() ) {
+         auto it = refunds_tbl.find( cursor.value );
+         eosio_assert( it != refunds_tbl.end(), "refund request not found" );
+         req = idx.iterator_to( *it );
+      }
+
+      uint32_t settled = 0;
+      for ( ; req != idx.end() && settled < max
+                                    && req->request_time + seconds(refund_delay_sec) <= ct; ++settled ) {
+         INLINE_ACTION_SENDER(eosio::token, transfer)(
+            token_account, { {stake_account, active_permission} },
+            { stake_account, req->owner, req->net_amount + req->cpu_amount, std::string("unstake") }
+         );
+         req = idx.erase( req );
+      }
+      eosio_assert( settled > 0, "no matured refunds" );
    }
 
 
@@ -6,7 +6,7 @@
 #include "delegate_bandwidth.cpp"
 #include "voting.cpp"
 #include "exchange_state.cpp"
-#include <map>
+#include <string_view>
 
 namespace eosiosystem {
 
@@ -15,17 +15,19 @@ namespace eosiosystem {
     _voters(_self, _self.value),
     _producers(_self, _self.value),
     _producers2(_self, _self.value),
-    _global(_self, _self.value),
-    _global2(_self, _self.value),
-    _global3(_self, _self.value),
+    _tallies(_self, _self.value),
+    _prodslots(_self, _self.value),
+    _gstate(_self, _self.value, []( name ) { return get_default_parameters(); }),
+    _gstate2(_self, _self.value, []( name ) { return eosio_global_state2{}; }),
+    _gstate3(_self, _self.value, []( name ) { return eosio_global_state3{}; }),
+    _ghot(_self, _self.value, &system_contract::get_default_hot_state),
+    _prodmigrate(_self, _self.value, []( name ) { return producer_migration_state{}; }),
+    _bidmigrate(_self, _self.value, []( name ) { return bid_migration_state{}; }),
+    _topprods(_self, _self.value, []( name ) { return top_producers_state{}; }),
     _guarantee(_self, _self.value),
     _rammarket(_self, _self.value)
    {
-
       //print( "construct system\n" );
-      _gstate  = _global.exists() ? _global.get() : get_default_parameters();
-      _gstate2 = _global2.exists() ? _global2.get() : eosio_global_state2{};
-      _gstate3 = _global3.exists() ? _global3.get() : eosio_global_state3{};
    }
 
    eosio_global_state system_contract::get_default_parameters() {
@@ -34,6 +36,38 @@ namespace eosiosystem {
       return dp;
    }
 
+   /**
+    *  Rows written before the hot/cold split still carry the counters in global and global2,
+    *  they are taken over the first time the globalhot row is needed.
+    */
+   eosio_global_hot_state system_contract::get_default_hot_state( name self ) {
+      eosio_global_hot_state hs;
+
+      global_state_singleton global( self, self.value );
+      if( global.exists() ) {
+         const auto gs = global.get();
+         hs.max_ram_size                  = gs.max_ram_size;
+         hs.total_ram_bytes_reserved      = gs.total_ram_bytes_reserved;
+         hs.total_ram_stake               = gs.total_ram_stake;
+         hs.last_producer_schedule_update = gs.last_producer_schedule_update;
+         hs.last_producer_schedule_size   = gs.last_producer_schedule_size;
+         hs.last_pervote_bucket_fill      = gs.last_pervote_bucket_fill;
+         hs.pervote_bucket                = gs.pervote_bucket;
+         hs.perblock_bucket               = gs.perblock_bucket;
+         hs.total_unpaid_blocks           = gs.total_unpaid_blocks;
+         hs.thresh_activated_stake_time   = gs.thresh_activated_stake_time;
+         hs.last_name_close               = gs.last_name_close;
+         hs.total_producer_vote_weight    = votes::from_double( gs.total_producer_vote_weight );
+      }
+
+      global_state2_singleton global2( self, self.value );
+      if( global2.exists() ) {
+         hs.last_ram_increase = global2.get().last_ram_increase;
+      }
+
+      return hs;
+   }
+
    time_point system_contract::current_time_point() {
       const static time_point ct{ microseconds{ static_cast<int64_t>( current_time() ) } };
       return ct;
@@ -44,25 +78,33 @@ namespace eosiosystem {
       return cbt;
    }
 
-   symbol system_contract::core_symbol()const {
-      const static auto sym = get_core_symbol( _rammarket );
-      return sym;
+   symbol system_contract::core_symbol() {
+      if( _ghot.get().core_symbol == symbol() ) {
+         _ghot.modify().core_symbol = get_core_symbol( _rammarket );
+      }
+      return _ghot.get().core_symbol;
    }
 
    system_contract::~system_contract() {
-      _global.set( _gstate, _self );
-      _global2.set( _gstate2, _self );
-      _global3.set( _gstate3, _self );
+      _gstate.save( _self );
+      _gstate2.save( _self );
+      _gstate3.save( _self );
+      _ghot.save( _self );
+      _prodmigrate.save( _self );
+      _bidmigrate.save( _self );
+      _topprods.save( _self );
+      _limits.flush();
    }
 
    void system_contract::setram( uint64_t max_ram_size ) {
       require_auth( _self );
 
-      eosio_assert( _gstate.max_ram_size < max_ram_size, "ram may only be increased" ); /// decreasing ram might result market maker issues
+      auto& ghot = _ghot.modify();
+      eosio_assert( ghot.max_ram_size < max_ram_size, "ram may only be increased" ); /// decreasing ram might result market maker issues
       eosio_assert( max_ram_size < 1024ll*1024*1024*1024*1024, "ram size is unrealistic" );
-      eosio_assert( max_ram_size > _gstate.total_ram_bytes_reserved, "attempt to set max below reserved" );
+      eosio_assert( max_ram_size > ghot.total_ram_bytes_reserved, "attempt to set max below reserved" );
 
-      auto delta = int64_t(max_ram_size) - int64_t(_gstate.max_ram_size);
+      auto delta = int64_t(max_ram_size) - int64_t(ghot.max_ram_size);
       auto itr = _rammarket.find(ramcore_symbol.raw());
 
       /**
@@ -72,17 +114,21 @@ namespace eosiosystem {
          m.base.balance.amount += delta;
       });
 
-      _gstate.max_ram_size = max_ram_size;
+      ghot.max_ram_size = max_ram_size;
    }
 
    void system_contract::update_ram_supply() {
       auto cbt = current_block_time();
 
-      if( cbt <= _gstate2.last_ram_increase ) return;
+      if( cbt <= _ghot.get().last_ram_increase ) return;
+
+      auto& ghot = _ghot.modify();
+      auto new_ram = (cbt.slot - ghot.last_ram_increase.slot)*_gstate2.get().new_ram_per_block;
+      ghot.last_ram_increase = cbt;
+      if( new_ram == 0 ) return;
 
       auto itr = _rammarket.find(ramcore_symbol.raw());
-      auto new_ram = (cbt.slot - _gstate2.last_ram_increase.slot)*_gstate2.new_ram_per_block;
-      _gstate.max_ram_size += new_ram;
+      ghot.max_ram_size += new_ram;
 
       /**
        *  Increase the amount of ram for sale based upon the change in max ram size.
@@ -90,7 +136,6 @@ namespace eosiosystem {
       _rammarket.modify( itr, same_payer, [&]( auto& m ) {
          m.base.balance.amount += new_ram;
       });
-      _gstate2.last_ram_increase = cbt;
    }
 
    /**
@@ -104,57 +149,88 @@ namespace eosiosystem {
       require_auth( _self );
 
       update_ram_supply();
-      _gstate2.new_ram_per_block = bytes_per_block;
+      _gstate2.modify().new_ram_per_block = bytes_per_block;
    }
 
    void system_contract::setparams( const eosio::blockchain_parameters& params ) {
       require_auth( _self );
-      (eosio::blockchain_parameters&)(_gstate) = params;
-      eosio_assert( 3 <= _gstate.max_authority_depth, "max_authority_depth should be at least 3" );
+      auto& gstate = _gstate.modify();
+      (eosio::blockchain_parameters&)(gstate) = params;
+      eosio_assert( 3 <= gstate.max_authority_depth, "max_authority_depth should be at least 3" );
       set_blockchain_parameters( params );
    }
 
    // *bos begin*
+   /**
+    *  List and action arguments of namelist and the values set_name_list_packed takes for them.
+    *  The list strings are too long for a name, the tables are searched without allocating.
+    */
+   struct name_list_key {
+      std::string_view text;
+      int64_t          value;
+   };
+
+   constexpr name_list_key name_list_types[] = {
+      { "actor_blacklist",    1 },
+      { "contract_blacklist", 2 },
+      { "resource_greylist",  3 }
+   };
+
+   constexpr name_list_key name_list_actions[] = {
+      { "insert", 1 },
+      { "remove", 2 }
+   };
+
+   /// value of `text` in `keys`, 0 if it is unknown
+   template<std::size_t N>
+   constexpr int64_t find_name_list_key( const name_list_key (&keys)[N], std::string_view text ) {
+      for( const auto& k : keys ) {
+         if( k.text == text )
+            return k.value;
+      }
+      return 0;
+   }
+
+   static_assert( find_name_list_key( name_list_types, "resource_greylist" ) == 3 );
+   static_assert( find_name_list_key( name_list_actions, "erase" ) == 0 );
+
    void system_contract::namelist(std::string list, std::string action, const std::vector<name> &names)
    {
-      const int MAX_LIST_LENGTH = 30;
-      const int MAX_ACTION_LENGTH = 10;
-      enum  class list_type:int64_t
-      {
-         actor_blacklist_type = 1,
-         contract_blacklist_type,
-         resource_greylist_type,
-         list_type_count
-      };
-      enum class list_action_type:int64_t
-      {
-         insert_type = 1,
-         remove_type,
-         list_action_type_count
-      };
+      require_auth(_self);
+      eosio_assert(3 <= _gstate.get().max_authority_depth, "max_authority_depth should be at least 3");
+      set_name_list(list, action, names);
+   }
 
-      std::map<std::string, list_type> list_type_string_to_enum = {
-              {"actor_blacklist", list_type::actor_blacklist_type},
-              {"contract_blacklist", list_type::contract_blacklist_type},
-              {"resource_greylist", list_type::resource_greylist_type}};
+   void system_contract::namelists( const std::vector<name_list_update>& updates )
+   {
+      require_auth(_self);
+      eosio_assert(!updates.empty(), "no list updates given");
+      eosio_assert(3 <= _gstate.get().max_authority_depth, "max_authority_depth should be at least 3");
 
-      std::map<std::string, list_action_type> list_action_type_string_to_enum = {
-          {"insert", list_action_type::insert_type},
-          {"remove", list_action_type::remove_type}};
+      for( auto u = updates.begin(); u != updates.end(); ++u ) {
+         // every update before u is a valid and distinct one, there are at most six of them
+         for( auto prev = updates.begin(); prev != u; ++prev ) {
+            eosio_assert(prev->list != u->list || prev->action != u->action, "duplicate list update");
+         }
+         set_name_list(u->list, u->action, u->names);
+      }
+   }
 
-      std::map<std::string, list_type>::iterator itlt = list_type_string_to_enum.find(list);
-      std::map<std::string, list_action_type>::iterator itlat = list_action_type_string_to_enum.find(action);
+   void system_contract::set_name_list( const std::string& list, const std::string& action, const std::vector<name>& names )
+   {
+      const int MAX_LIST_LENGTH = 30;
+      const int MAX_ACTION_LENGTH = 10;
 
-      require_auth(_self);
-      eosio_assert(3 <= _gstate.max_authority_depth, "max_authority_depth should be at least 3");
       eosio_assert(list.length() < MAX_LIST_LENGTH, "list string is greater than max length 30");
       eosio_assert(action.length() < MAX_ACTION_LENGTH, " action string is greater than max length 10");
-      eosio_assert(itlt != list_type_string_to_enum.end(), " unknown list type string  support 'actor_blacklist' ,'contract_blacklist', 'resource_greylist'");
-      eosio_assert(itlat != list_action_type_string_to_enum.end(), " unknown list type string support 'insert' or 'remove'");
+      const int64_t list_type = find_name_list_key(name_list_types, list);
+      const int64_t list_action = find_name_list_key(name_list_actions, action);
+      eosio_assert(list_type != 0, " unknown list type string  support 'actor_blacklist' ,'contract_blacklist', 'resource_greylist'");
+      eosio_assert(list_action != 0, " unknown list type string support 'insert' or 'remove'");
 
       auto packed_names = pack(names);
 
-      set_name_list_packed(static_cast<int64_t>(itlt->second), static_cast<int64_t>(itlat->second), packed_names.data(), packed_names.size());
+      set_name_list_packed(list_type, list_action, packed_names.data(), packed_names.size());
    }
 
    void system_contract::setguaminres(uint32_t ram, uint32_t cpu, uint32_t net)
@@ -166,7 +242,7 @@ namespace eosiosystem {
 
       const static uint32_t STEP_BYTE = 10*1024;
       const static uint32_t STEP_MICROSEC = 10*1000;
-      eosio_assert(3 <= _gstate.max_authority_depth, "max_authority_depth should be at least 3");
+      eosio_assert(3 <= _gstate.get().max_authority_depth, "max_authority_depth should be at least 3");
       eosio_assert(ram <= MAX_BYTE  && net <= MAX_BYTE, "the value of ram, cpu and net should not more then 100 kb");
       eosio_assert(cpu <= MAX_MICROSEC , "the value of  cpu  should not more then 100 ms");
 
@@ -192,7 +268,18 @@ namespace eosiosystem {
 
    void system_contract::setalimits( name account, int64_t ram, int64_t net, int64_t cpu ) {
       require_auth( _self );
+      set_account_limits( account, ram, net, cpu );
+   }
 
+   void system_contract::batchalimits( const std::vector<account_limits>& accounts ) {
+      require_auth( _self );
+      eosio_assert( !accounts.empty(), "no accounts given" );
+      for( const auto& a : accounts ) {
+         set_account_limits( a.account, a.ram_bytes, a.net_weight, a.cpu_weight );
+      }
+   }
+
+   void system_contract::set_account_limits( name account, int64_t ram, int64_t net, int64_t cpu ) {
       user_resources_table userres( _self, account.value );
       auto ritr = userres.find( account.value );
       eosio_assert( ritr == userres.end(), "only supports unlimited accounts" );
@@ -205,15 +292,26 @@ namespace eosiosystem {
          eosio_assert( !(ram_managed || net_managed || cpu_managed), "cannot use setalimits on an account with managed resources" );
       }
 
-      set_resource_limits( account.value, ram, net, cpu );
+      auto& limits = _limits.get( account );
+      limits.ram_bytes  = ram;
+      limits.net_weight = net;
+      limits.cpu_weight = cpu;
    }
 
    void system_contract::setacctram( name account, std::optional<int64_t> ram_bytes ) {
       require_auth( _self );
+      set_account_ram( account, ram_bytes );
+   }
 
-      int64_t current_ram, current_net, current_cpu;
-      get_resource_limits( account.value, &current_ram, &current_net, &current_cpu );
+   void system_contract::batchacctram( const std::vector<account_resource>& accounts ) {
+      require_auth( _self );
+      eosio_assert( !accounts.empty(), "no accounts given" );
+      for( const auto& a : accounts ) {
+         set_account_ram( a.account, a.value );
+      }
+   }
 
+   void system_contract::set_account_ram( name account, const std::optional<int64_t>& ram_bytes ) {
       int64_t ram = 0;
 
       if( !ram_bytes ) {
@@ -250,15 +348,23 @@ namespace eosiosystem {
          ram = *ram_bytes;
       }
 
-      set_resource_limits( account.value, ram, current_net, current_cpu );
+      _limits.get( account ).ram_bytes = ram;
    }
 
    void system_contract::setacctnet( name account, std::optional<int64_t> net_weight ) {
       require_auth( _self );
+      set_account_net( account, net_weight );
+   }
 
-      int64_t current_ram, current_net, current_cpu;
-      get_resource_limits( account.value, &current_ram, &current_net, &current_cpu );
+   void system_contract::batchacctnet( const std::vector<account_resource>& accounts ) {
+      require_auth( _self );
+      eosio_assert( !accounts.empty(), "no accounts given" );
+      for( const auto& a : accounts ) {
+         set_account_net( a.account, a.value );
+      }
+   }
 
+   void system_contract::set_account_net( name account, const std::optional<int64_t>& net_weight ) {
       int64_t net = 0;
 
       if( !net_weight ) {
@@ -294,15 +400,23 @@ namespace eosiosystem {
          net = *net_weight;
       }
 
-      set_resource_limits( account.value, current_ram, net, current_cpu );
+      _limits.get( account ).net_weight = net;
    }
 
    void system_contract::setacctcpu( name account, std::optional<int64_t> cpu_weight ) {
       require_auth( _self );
+      set_account_cpu( account, cpu_weight );
+   }
 
-      int64_t current_ram, current_net, current_cpu;
-      get_resource_limits( account.value, &current_ram, &current_net, &current_cpu );
+   void system_contract::batchacctcpu( const std::vector<account_resource>& accounts ) {
+      require_auth( _self );
+      eosio_assert( !accounts.empty(), "no accounts given" );
+      for( const auto& a : accounts ) {
+         set_account_cpu( a.account, a.value );
+      }
+   }
 
+   void system_contract::set_account_cpu( name account, const std::optional<int64_t>& cpu_weight ) {
       int64_t cpu = 0;
 
       if( !cpu_weight ) {
@@ -338,7 +452,7 @@ namespace eosiosystem {
          cpu = *cpu_weight;
       }
 
-      set_resource_limits( account.value, current_ram, current_net, cpu );
+      _limits.get( account ).cpu_weight = cpu;
    }
 
    void system_contract::rmvproducer( name producer ) {
@@ -348,15 +462,44 @@ namespace eosiosystem {
       _producers.modify( prod, same_payer, [&](auto& p) {
             p.deactivate();
          });
+      if( _topprods.get().elected( producer ) ) {
+         invalidate_top_producers();
+      }
+      _tallies.modify( get_tally( producer ), same_payer, [&](auto& t) {
+            t.is_active = false;
+         });
    }
 
    void system_contract::updtrevision( uint8_t revision ) {
       require_auth( _self );
-      eosio_assert( _gstate2.revision < 255, "can not increment revision" ); // prevent wrap around
-      eosio_assert( revision == _gstate2.revision + 1, "can only increment revision by one" );
+      auto& gstate2 = _gstate2.modify();
+      eosio_assert( gstate2.revision < 255, "can not increment revision" ); // prevent wrap around
+      eosio_assert( revision == gstate2.revision + 1, "can only increment revision by one" );
       eosio_assert( revision <= 1, // set upper bound to greatest revision supported in the code
                     "specified revision is not yet supported by the code" );
-      _gstate2.revision = revision;
+      gstate2.revision = revision;
+   }
+
+   void system_contract::splitgstate() {
+      require_auth( _self );
+
+      // materializes the globalhot row from the old rows before their copies are cleared
+      _ghot.modify();
+
+      auto& gstate = _gstate.modify();
+      gstate.total_ram_bytes_reserved      = 0;
+      gstate.total_ram_stake               = 0;
+      gstate.last_producer_schedule_update = block_timestamp();
+      gstate.last_producer_schedule_size   = 0;
+      gstate.last_pervote_bucket_fill      = time_point();
+      gstate.pervote_bucket                = 0;
+      gstate.perblock_bucket               = 0;
+      gstate.total_unpaid_blocks           = 0;
+      gstate.thresh_activated_stake_time   = time_point();
+      gstate.last_name_close               = block_timestamp();
+      gstate.total_producer_vote_weight    = 0;
+
+      _gstate2.modify().last_ram_increase  = block_timestamp();
    }
 
    void system_contract::bidname( name bidder, name newname, asset bid ) {
@@ -405,7 +548,8 @@ namespace eosiosystem {
          eosio_assert( bid.amount - current->high_bid > (current->high_bid / 10), "must increase bid by 10%" );
          eosio_assert( current->high_bidder != bidder, "account is already highest bidder" );
 
-         bid_refund_table refunds_table(_self, newname.value);
+         // outbid amounts of every name are kept together, the bidder claims them or a sweep pays them
+         bid_refund_table refunds_table(_self, _self.value);
 
          auto it = refunds_table.find( current->high_bidder.value );
          if ( it != refunds_table.end() ) {
@@ -419,16 +563,7 @@ namespace eosiosystem {
                });
          }
 
-         transaction t;
-         t.actions.emplace_back( permission_level{_self, active_permission},
-                                 _self, "bidrefund"_n,
-                                 std::make_tuple( current->high_bidder, newname )
-         );
-         t.delay_sec = 0;
-         uint128_t deferred_id = (uint128_t(newname.value) << 64) | current->high_bidder.value;
-         cancel_deferred( deferred_id );
-         t.send( deferred_id, bidder );
-
+         current = index_bid( bids, current );
          bids.modify( current, bidder, [&]( auto& b ) {
             b.high_bidder = bidder;
             b.high_bid = bid.amount;
@@ -448,6 +583,71 @@ namespace eosiosystem {
       refunds_table.erase( it );
    }
 
+   /**
+    *  Rows written before the closetime index existed have no entry in it, which modify cannot
+    *  update. They are erased and written again before they change, until migratebids is done.
+    */
+   name_bid_table::const_iterator system_contract::index_bid( name_bid_table& bids, name_bid_table::const_iterator bid ) {
+      const auto& state = _bidmigrate.get();
+      if ( state.done || bid->newname.value < state.next.value )
+         return bid;
+
+      const name_bid row = *bid;
+      bids.erase( bid );
+      // bids are paid for by the high bidder, closed ones included
+      return bids.emplace( row.high_bidder, [&]( auto& b ) {
+         b = row;
+      });
+   }
+
+   void system_contract::migratebids( uint32_t max_rows ) {
+      require_auth( _self );
+
+      auto& state = _bidmigrate.modify();
+      eosio_assert( !state.done, "name bids are already migrated" );
+
+      name_bid_table bids(_self, _self.value);
+      auto bid = bids.lower_bound( state.next.value );
+      for ( uint32_t rows = 0; bid != bids.end() && rows < max_rows; ++rows ) {
+         const name newname = bid->newname;
+         index_bid( bids, bid );
+         state.next = name( newname.value + 1 );
+         bid = bids.lower_bound( state.next.value );
+      }
+
+      if ( bid == bids.end() ) {
+         state.done = true;
+      }
+   }
+
+   void system_contract::claimbidref( name bidder ) {
+      require_auth( bidder );
+
+      bid_refund_table refunds_table(_self, _self.value);
+      auto it = refunds_table.find( bidder.value );
+      eosio_assert( it != refunds_table.end(), "refund not found" );
+      INLINE_ACTION_SENDER(eosio::token, transfer)(
+         token_account, { {names_account, active_permission}, {bidder, active_permission} },
+         { names_account, bidder, asset(it->amount), std::string("refund outbid name bids") }
+      );
+      refunds_table.erase( it );
+   }
+
+   void system_contract::sweepbidrefs( name cursor, uint32_t max_rows ) {
+      eosio_assert( max_rows > 0, "max_rows must be positive" );
+
+      bid_refund_table refunds_table(_self, _self.value);
+      auto it = refunds_table.lower_bound( cursor.value );
+      eosio_assert( it != refunds_table.end(), "no bid refunds to sweep" );
+      for ( uint32_t rows = 0; it != refunds_table.end() && rows < max_rows; ++rows ) {
+         INLINE_ACTION_SENDER(eosio::token, transfer)(
+            token_account, { {names_account, active_permission} },
+            { names_account, it->bidder, asset(it->amount), std::string("refund outbid name bids") }
+         );
+         it = refunds_table.erase( it );
+      }
+   }
+
    /**
     *  Called after a new account is created. This code enforces resource-limits rules
     *  for new accounts as well as new account naming conventions.
@@ -499,6 +699,22 @@ namespace eosiosystem {
 
       user_resources_table  userres( _self, newact.value);
 
+      pending_account_resources_table pending( _self, _self.value );
+      auto res_itr = pending.find( newact.value );
+      if( res_itr != pending.end() ) {
+         // sent by newacctres, which already bought the ram and delegated the stake
+         userres.emplace( newact, [&]( auto& res ) {
+           res.owner = newact;
+           res.net_weight = res_itr->net_weight;
+           res.cpu_weight = res_itr->cpu_weight;
+           res.ram_bytes = res_itr->ram_bytes;
+         });
+
+         set_resource_limits( newact.value, res_itr->ram_bytes + ram_gift_bytes, res_itr->net_weight.amount, res_itr->cpu_weight.amount );
+         pending.erase( res_itr );
+         return;
+      }
+
       userres.emplace( newact, [&]( auto& res ) {
         res.owner = newact;
         res.net_weight = asset( 0, system_contract::get_core_symbol() );
@@ -534,14 +750,24 @@ namespace eosiosystem {
       eosio_assert( system_token_supply.symbol == core, "specified core symbol does not exist (precision mismatch)" );
 
       eosio_assert( system_token_supply.amount > 0, "system token supply must be greater than 0" );
+      _ghot.modify().core_symbol = core;
       _rammarket.emplace( _self, [&]( auto& m ) {
          m.supply.amount = 100000000000000ll;
          m.supply.symbol = ramcore_symbol;
-         m.base.balance.amount = int64_t(_gstate.free_ram());
+         m.base.balance.amount = int64_t(_ghot.get().free_ram());
          m.base.balance.symbol = ram_symbol;
          m.quote.balance.amount = system_token_supply.amount / 1000;
          m.quote.balance.symbol = core;
       });
+
+      // every producer of a new chain gets its tally in regproducer, there is nothing to migrate
+      if( _producers.begin() == _producers.end() ) {
+         _prodmigrate.modify().done = true;
+      }
+      name_bid_table bids(_self, _self.value);
+      if( bids.begin() == bids.end() ) {
+         _bidmigrate.modify().done = true;
+      }
    }
 } /// eosio.system
 
@@ -550,12 +776,13 @@ EOSIO_DISPATCH( eosiosystem::system_contract,
      // native.hpp (newaccount definition is actually in eosio.system.cpp)
      (newaccount)(updateauth)(deleteauth)(linkauth)(unlinkauth)(canceldelay)(onerror)(setabi)
      // eosio.system.cpp
-     (init)(setram)(setramrate)(setparams)(namelist)(setguaminres)(setpriv)(setalimits)(setacctram)(setacctnet)(setacctcpu)
-     (rmvproducer)(updtrevision)(bidname)(bidrefund)
+     (init)(setram)(setramrate)(setparams)(namelist)(namelists)(setguaminres)(setpriv)(setalimits)(setacctram)(setacctnet)(setacctcpu)
+     (batchalimits)(batchacctram)(batchacctnet)(batchacctcpu)
+     (rmvproducer)(updtrevision)(splitgstate)(bidname)(bidrefund)(migratebids)(claimbidref)(sweepbidrefs)
      // delegate_bandwidth.cpp
-     (buyrambytes)(buyram)(sellram)(delegatebw)(undelegatebw)(refund)
+     (buyrambytes)(buyrambatch)(buyram)(sellram)(sweepramfee)(delegatebw)(undelegatebw)(delegatebatch)(undelbatch)(newacctres)(refund)(procrefunds)
      // voting.cpp
-     (regproducer)(unregprod)(voteproducer)(regproxy)
+     (regproducer)(unregprod)(voteproducer)(regproxy)(migrateprods)(refreshvotes)(migratevoter)(setcompact)
      // producer_pay.cpp
-     (onblock)(claimrewards)
+     (onblock)(claimrewards)(syncsupply)
 )
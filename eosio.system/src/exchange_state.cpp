@@ -1,7 +1,18 @@
 #include <eosio.system/exchange_state.hpp>
+#include <eosio.system/bancor.hpp>
 
 namespace eosiosystem {
    asset exchange_state::convert_to_exchange( connector& c, asset in ) {
+      if( c.weight == .5 ) {
+         /// 50/50 relays (the RAM market) are priced with integer math, no softfloat involved
+         eosio_assert( in.amount >= 0 && c.balance.amount + in.amount > 0, "invalid connector deposit" );
+         int64_t issued = bancor::to_exchange( supply.amount, c.balance.amount, in.amount );
+
+         supply.amount += issued;
+         c.balance.amount += in.amount;
+
+         return asset( issued, supply.symbol );
+      }
 
       real_type R(supply.amount);
       real_type C(c.balance.amount+in.amount);
@@ -21,6 +32,16 @@ namespace eosiosystem {
    asset exchange_state::convert_from_exchange( connector& c, asset in ) {
       eosio_assert( in.symbol== supply.symbol, "unexpected asset symbol input" );
 
+      if( c.weight == .5 ) {
+         eosio_assert( in.amount >= 0 && in.amount < supply.amount, "invalid smart token amount" );
+         int64_t out = bancor::from_exchange( supply.amount, c.balance.amount, in.amount );
+
+         supply.amount -= in.amount;
+         c.balance.amount -= out;
+
+         return asset( out, c.balance.symbol );
+      }
+
       real_type R(supply.amount - in.amount);
       real_type C(c.balance.amount);
       real_type F(1.0/c.weight);
@@ -78,6 +99,41 @@ namespace eosiosystem {
       return from;
    }
 
+   asset exchange_state::direct_convert( const asset& from, const symbol& to ) {
+      const auto& sell_symbol  = from.symbol;
+      const auto& base_symbol  = base.balance.symbol;
+      const auto& quote_symbol = quote.balance.symbol;
+      eosio_assert( base.weight == .5 && quote.weight == .5, "direct conversion requires a 50/50 relay" );
+
+      asset out( 0, to );
+      if( sell_symbol == base_symbol && to == quote_symbol ) {
+         out.amount = get_bancor_output( base.balance.amount, quote.balance.amount, from.amount );
+         base.balance  += from;
+         quote.balance -= out;
+      } else if( sell_symbol == quote_symbol && to == base_symbol ) {
+         out.amount = get_bancor_output( quote.balance.amount, base.balance.amount, from.amount );
+         quote.balance += from;
+         base.balance  -= out;
+      } else {
+         eosio_assert( false, "invalid conversion" );
+      }
+
+      return out;
+   }
+
+   int64_t exchange_state::get_bancor_output( int64_t inp_reserve, int64_t out_reserve, int64_t inp ) {
+      eosio_assert( inp_reserve > 0 && out_reserve > 0, "invalid reserves" );
+      eosio_assert( inp >= 0, "invalid input amount" );
+      return bancor::output( inp_reserve, out_reserve, inp );
+   }
+
+   int64_t exchange_state::get_bancor_input( int64_t out_reserve, int64_t inp_reserve, int64_t out ) {
+      eosio_assert( inp_reserve > 0 && out_reserve > 0, "invalid reserves" );
+      eosio_assert( out >= 0, "invalid output amount" );
+      eosio_assert( out < out_reserve, "insufficient reserve" );
+      return bancor::input( out_reserve, inp_reserve, out );
+   }
+
 
 
 } /// namespace eosiosystem
@@ -1,23 +1,22 @@
 #include <eosio.system/eosio.system.hpp>
+#include <eosio.system/producer_pay_math.hpp>
 
 #include <eosio.token/eosio.token.hpp>
 
+#include <algorithm>
 #include <vector>
 namespace eosiosystem {
 
-   const int64_t  min_pervote_daily_pay = 100'0000;
    const int64_t  min_activated_stake   = 10'000'0000;
-   // const double   continuous_rate       = 0.04879;          // 5% annual rate
-   const double   continuous_rate       = 0.0198;          // 2% annual rate
    const double   perblock_rate         = 0.0025;           // 0.25%
    const double   standby_rate          = 0.0075;           // 0.75%
    const uint32_t blocks_per_year       = 52*7*24*2*3600;   // half seconds per year
-   const uint32_t seconds_per_year      = 52*7*24*3600;
-   const uint32_t blocks_per_day        = 2 * 24 * 3600;
+   const uint32_t seconds_per_year      = pay::seconds_per_year;
+   const uint32_t blocks_per_day        = pay::blocks_per_day;
    const uint32_t blocks_per_hour       = 2 * 3600;
 
-   const int64_t  useconds_per_day      = 24 * 3600 * int64_t(1000000);
-   const int64_t  useconds_per_year     = seconds_per_year*1000000ll;
+   const int64_t  useconds_per_day      = pay::useconds_per_day;
+   const int64_t  useconds_per_year     = pay::useconds_per_year;
 
    void system_contract::onblock( ignore<block_header> ) {
       using namespace eosio;
@@ -28,38 +27,42 @@ namespace eosiosystem {
       name producer;
       _ds >> timestamp >> producer;
 
-      // _gstate2.last_block_num is not used anywhere in the system contract code anymore.
-      // Although this field is deprecated, we will continue updating it for now until the last_block_num field
-      // is eventually completely removed, at which point this line can be removed.
-      _gstate2.last_block_num = timestamp;
-   
+      // _gstate2.last_block_num is deprecated and no longer updated, onblock only writes the globalhot row.
+      auto& ghot = _ghot.modify();
+
       static const int64_t min_activated_time = 1547816400000000; /// 2019-01-18 21:00:00 UTC+8
       const static time_point at{ microseconds{ static_cast<int64_t>( min_activated_time) } };
 
-      if (current_time_point() >= at&& _gstate.thresh_activated_stake_time == time_point())
+      if (current_time_point() >= at&& ghot.thresh_activated_stake_time == time_point())
       {
-         _gstate.thresh_activated_stake_time = current_time_point();
+         ghot.thresh_activated_stake_time = current_time_point();
       }
 
       /** until activated stake crosses this threshold no new rewards are paid */
-      // if( _gstate.total_activated_stake < min_activated_stake )
-      if(_gstate.thresh_activated_stake_time == time_point())
+      // if( _gstate.get().total_activated_stake < min_activated_stake )
+      if(ghot.thresh_activated_stake_time == time_point())
          return;
 
-      if( _gstate.last_pervote_bucket_fill == time_point() )  /// start the presses
-         _gstate.last_pervote_bucket_fill = current_time_point();
+      if( ghot.last_pervote_bucket_fill == time_point() )  /// start the presses
+         ghot.last_pervote_bucket_fill = current_time_point();
 
 
       /**
        * At startup the initial producer may not be one that is registered / elected
        * and therefore there may be no producer object for them.
+       *
+       * Blocks are counted in the globalhot row, the producer row is only looked up for the first
+       * block of each producer in a round.
        */
-      auto prod = _producers.find( producer.value );
-      if ( prod != _producers.end() ) {
-         _gstate.total_unpaid_blocks++;
-         _producers.modify( prod, same_payer, [&](auto& p ) {
-               p.unpaid_blocks++;
-         });
+      auto& counters = ghot.round_unpaid_blocks;
+      auto counter = std::find_if( counters.begin(), counters.end(),
+                                   [&]( const auto& c ) { return c.producer == producer; } );
+      if ( counter != counters.end() ) {
+         ghot.total_unpaid_blocks++;
+         counter->blocks++;
+      } else if ( _producers.find( producer.value ) != _producers.end() ) {
+         ghot.total_unpaid_blocks++;
+         counters.push_back( unpaid_blocks_counter{ producer, 1 } );
       }
 
          auto modifybid = [&](auto &ns) {
@@ -70,6 +73,7 @@ namespace eosiosystem {
             if(highest != bids.end())
             {
             //  print( highest->last_bid_time.sec_since_epoch(), " dealed high_bid: ", highest->high_bid, " newname: ", name{highest->newname}, "\n" );
+            highest = index_bid(bids, highest);
             bids.modify(highest, same_payer, [&](auto &b) {
                b.high_bid = -b.high_bid;
             });
@@ -113,167 +117,202 @@ namespace eosiosystem {
 
          modifybid(names);
       };
+
+      /**
+       * Once every name bid is in the closetime index the auctions to close after the highest bid
+       * are read from its front: every entry before the current time has had no bid for a day.
+       */
+      auto closebids = [&](const name_bid &highest) {
+         std::vector<name> names{highest.newname};
+
+         name_bid_table bids(_self, _self.value);
+         auto idx = bids.get_index<"closetime"_n>();
+         const uint128_t now_key = uint128_t(current_time_point().time_since_epoch().count()) << 64;
+         auto it = idx.begin();
+         pay::close_names(highest.newname.length() >= BASE_LENGTH, [&]() {
+            for (; it != idx.end() && it->by_close_time() < now_key; ++it)
+            {
+               if (it->newname != highest.newname)
+               {
+                  names.push_back((it++)->newname);
+                  return true;
+               }
+            }
+            return false;
+         });
+
+         modifybid(names);
+      };
+
       /// only update block producers once every minute, block_timestamp is in half seconds
-      if (timestamp.slot - _gstate.last_producer_schedule_update.slot > 120) {
+      if (timestamp.slot - ghot.last_producer_schedule_update.slot > 120) {
+         flush_unpaid_blocks();
          update_elected_producers(timestamp);
 
-         if ((timestamp.slot - _gstate.last_name_close.slot) > blocks_per_day){
+         if (pay::name_close_due(timestamp.slot, ghot.last_name_close.slot)){
             name_bid_table bids(_self, _self.value);
             auto idx = bids.get_index<"highbid"_n>();
             auto highest = idx.lower_bound(std::numeric_limits<uint64_t>::max() / 2);
             if (highest != idx.end() &&
-                highest->high_bid > 0 &&
-                (current_time_point() - highest->last_bid_time) > microseconds(useconds_per_day) &&
-                _gstate.thresh_activated_stake_time > time_point() &&
-                (current_time_point() - _gstate.thresh_activated_stake_time) > microseconds(14*useconds_per_day)){
-               _gstate.last_name_close = timestamp;
-
-               checkbidname(highest, idx);
+                pay::name_auction_closes(highest->high_bid,
+                                         highest->last_bid_time.time_since_epoch().count(),
+                                         ghot.thresh_activated_stake_time.time_since_epoch().count(),
+                                         current_time_point().time_since_epoch().count())){
+               ghot.last_name_close = timestamp;
+
+               if (_bidmigrate.get().done)
+                  closebids(*highest);
+               else
+                  checkbidname(highest, idx);
             }
          }
       }
    }
 
+   void system_contract::flush_unpaid_blocks() {
+      auto& counters = _ghot.modify().round_unpaid_blocks;
+      for( const auto& c : counters ) {
+         auto prod = _producers.find( c.producer.value );
+         if( prod != _producers.end() ) {
+            _producers.modify( prod, same_payer, [&](auto& p ) {
+               p.unpaid_blocks += c.blocks;
+            });
+         }
+      }
+      counters.clear();
+   }
+
+   uint32_t system_contract::take_unpaid_blocks( name producer ) {
+      auto& counters = _ghot.modify().round_unpaid_blocks;
+      auto counter = std::find_if( counters.begin(), counters.end(),
+                                   [&]( const auto& c ) { return c.producer == producer; } );
+      if( counter == counters.end() )
+         return 0;
+
+      const uint32_t blocks = counter->blocks;
+      counters.erase( counter );
+      return blocks;
+   }
+
    using namespace eosio;
    void system_contract::claimrewards( const name owner ) {
       require_auth( owner );
 
-      const auto& prod = _producers.get( owner.value );
+      auto tally = get_tally( owner );
+      eosio_assert( tally != _tallies.end(), "unable to find key" );
+      const auto& prod = *tally;
       eosio_assert( prod.active(), "producer does not have an active key" );
 
-      // eosio_assert( _gstate.total_activated_stake >= min_activated_stake,
+      auto& ghot = _ghot.modify();
+
+      // eosio_assert( _gstate.get().total_activated_stake >= min_activated_stake,
       //               "cannot claim rewards until the chain is activated (at least 15% of all tokens participate in voting)" );
-      eosio_assert( _gstate.thresh_activated_stake_time != time_point(),
+      eosio_assert( ghot.thresh_activated_stake_time != time_point(),
                     "cannot claim rewards until the chain is activated " );
 
       const auto ct = current_time_point();
+      const auto& info = _producers.get( owner.value );
+      const uint32_t unpaid_blocks = info.unpaid_blocks + take_unpaid_blocks( owner );
 
-      eosio_assert( ct - prod.last_claim_time > microseconds(useconds_per_day), "already claimed rewards within past day" );
+      eosio_assert( pay::claim_allowed( prod.last_claim_time.time_since_epoch().count(), ct.time_since_epoch().count() ),
+                    "already claimed rewards within past day" );
 
-      const asset token_supply   = eosio::token::get_supply(token_account, core_symbol().code() );
-      const auto usecs_since_last_fill = (ct - _gstate.last_pervote_bucket_fill).count();
+      // every transfer of the claim is settled by a single inline eosio.token::transfers
+      std::vector<eosio::token::transfer_args> payouts;
+      std::vector<permission_level> payout_auth;
 
-      if( usecs_since_last_fill > 0 && _gstate.last_pervote_bucket_fill > time_point() ) {
-         auto new_tokens = static_cast<int64_t>( (continuous_rate * double(token_supply.amount) * double(usecs_since_last_fill)) / double(useconds_per_year) );
+      if( ghot.core_supply == 0 ) {
+         // tracked from the first claim on, syncsupply catches up with tokens issued elsewhere
+         ghot.core_supply = eosio::token::get_supply( token_account, core_symbol().code() ).amount;
+      }
+      const auto usecs_since_last_fill = (ct - ghot.last_pervote_bucket_fill).count();
 
-         // auto to_producers     = new_tokens / 5;
-         // auto to_savings       = new_tokens - to_producers;
-         auto to_producers     = new_tokens / 2;
-         auto to_savings       = new_tokens - to_producers;
-         auto to_per_block_pay = to_producers / 4;
-         auto to_per_vote_pay  = to_producers - to_per_block_pay;
-         auto to_gov_fund = to_savings / 5;
-         auto to_dev_fund  = to_savings - to_gov_fund;
+      if( pay::bucket_fill_due( ghot.last_pervote_bucket_fill.time_since_epoch().count(), ct.time_since_epoch().count() ) ) {
+         const auto new_tokens = pay::inflation( pay::continuous_rate, ghot.core_supply, usecs_since_last_fill );
+         const auto split      = pay::split_inflation( new_tokens );
+         const auto to_per_block_pay = split.per_block;
+         const auto to_per_vote_pay  = split.per_vote;
+         const auto to_gov_fund      = split.gov_fund;
+         const auto to_dev_fund      = split.dev_fund;
 
          INLINE_ACTION_SENDER(eosio::token, issue)(
             token_account, { {_self, active_permission} },
             { _self, asset(new_tokens, core_symbol()), std::string("issue tokens for producer pay and savings") }
          );
 
-         // INLINE_ACTION_SENDER(eosio::token, transfer)(
-         //    token_account, { {_self, active_permission} },
-         //    { _self, saving_account, asset(to_savings, core_symbol()), "unallocated inflation" }
-         // );
-
-         INLINE_ACTION_SENDER(eosio::token, transfer)(
-            token_account, { {_self, active_permission} },
-            { _self, dev_account, asset(to_dev_fund, core_symbol()), "unallocated inflation" }
-         );
-
-         INLINE_ACTION_SENDER(eosio::token, transfer)(
-            token_account, { {_self, active_permission} },
-            { _self, gov_account, asset(to_gov_fund, core_symbol()), "unallocated inflation" }
-         );
-
-         INLINE_ACTION_SENDER(eosio::token, transfer)(
-            token_account, { {_self, active_permission} },
-            { _self, bpay_account, asset(to_per_block_pay, core_symbol()), "fund per-block bucket" }
-         );
+         // payouts.push_back({ _self, saving_account, asset(to_savings, core_symbol()), "unallocated inflation" });
 
-         INLINE_ACTION_SENDER(eosio::token, transfer)(
-            token_account, { {_self, active_permission} },
-            { _self, vpay_account, asset(to_per_vote_pay, core_symbol()), "fund per-vote bucket" }
-         );
+         payout_auth.push_back( {_self, active_permission} );
+         payouts.push_back({ _self, dev_account, asset(to_dev_fund, core_symbol()), "unallocated inflation" });
+         payouts.push_back({ _self, gov_account, asset(to_gov_fund, core_symbol()), "unallocated inflation" });
+         payouts.push_back({ _self, bpay_account, asset(to_per_block_pay, core_symbol()), "fund per-block bucket" });
+         payouts.push_back({ _self, vpay_account, asset(to_per_vote_pay, core_symbol()), "fund per-vote bucket" });
 
-         _gstate.pervote_bucket          += to_per_vote_pay;
-         _gstate.perblock_bucket         += to_per_block_pay;
-         _gstate.last_pervote_bucket_fill = ct;
+         ghot.core_supply             += new_tokens;
+         ghot.pervote_bucket          += to_per_vote_pay;
+         ghot.perblock_bucket         += to_per_block_pay;
+         ghot.last_pervote_bucket_fill = ct;
       }
 
-      auto prod2 = _producers2.find( owner.value );
-
       /// New metric to be used in pervote pay calculation. Instead of vote weight ratio, we combine vote weight and
       /// time duration the vote weight has been held into one metric.
-      const auto last_claim_plus_3days = prod.last_claim_time + microseconds(3 * useconds_per_day);
-
-      bool crossed_threshold       = (last_claim_plus_3days <= ct);
-      bool updated_after_threshold = true;
-      if ( prod2 != _producers2.end() ) {
-         updated_after_threshold = (last_claim_plus_3days <= prod2->last_votepay_share_update);
-      } else {
-         prod2 = _producers2.emplace( owner, [&]( producer_info2& info  ) {
-            info.owner                     = owner;
-            info.last_votepay_share_update = ct;
-         });
-      }
+      const auto status = prod.votepay_status( ct );
 
-      // Note: updated_after_threshold implies cross_threshold (except if claiming rewards when the producers2 table row did not exist).
-      // The exception leads to updated_after_threshold to be treated as true regardless of whether the threshold was crossed.
-      // This is okay because in this case the producer will not get paid anything either way.
-      // In fact it is desired behavior because the producers votes need to be counted in the global total_producer_votepay_share for the first time.
-
-      int64_t producer_per_block_pay = 0;
-      if( _gstate.total_unpaid_blocks > 0 ) {
-         producer_per_block_pay = (_gstate.perblock_bucket * prod.unpaid_blocks) / _gstate.total_unpaid_blocks;
-      }
-
-      double new_votepay_share = update_producer_votepay_share( prod2,
-                                    ct,
-                                    updated_after_threshold ? 0.0 : prod.total_votes,
-                                    true // reset votepay_share to zero after updating
-                                 );
+      const int64_t producer_per_block_pay = pay::per_block_pay( ghot.perblock_bucket, unpaid_blocks, ghot.total_unpaid_blocks );
 
       int64_t producer_per_vote_pay = 0;
-      if( _gstate2.revision > 0 ) {
-         double total_votepay_share = update_total_votepay_share( ct );
-         if( total_votepay_share > 0 && !crossed_threshold ) {
-            producer_per_vote_pay = int64_t((new_votepay_share * _gstate.pervote_bucket) / total_votepay_share);
-            if( producer_per_vote_pay > _gstate.pervote_bucket )
-               producer_per_vote_pay = _gstate.pervote_bucket;
-         }
-      } else {
-         if( _gstate.total_producer_vote_weight > 0 ) {
-            producer_per_vote_pay = int64_t((_gstate.pervote_bucket * prod.total_votes) / _gstate.total_producer_vote_weight);
-         }
-      }
+      auto totals = get_votepay_totals();
+      _tallies.modify( prod, same_payer, [&](auto& t) {
+         auto vp = t.votepay();
+         producer_per_vote_pay = pay::claim_vote_pay( vp, totals, ghot.pervote_bucket, t.vote_weight(), status, ct.time_since_epoch().count() );
+         t.set_votepay( vp );
+         t.last_claim_time = ct;
+      });
+      set_votepay_totals( totals );
 
-      if( producer_per_vote_pay < min_pervote_daily_pay ) {
+      if( _gstate2.get().revision == 0 ) {
+         // before the vote pay shares are settled the pay is the vote weight ratio
          producer_per_vote_pay = 0;
+         if( ghot.total_producer_vote_weight > 0 ) {
+            producer_per_vote_pay = int64_t((ghot.pervote_bucket * prod.vote_weight()) / votes::to_double( ghot.total_producer_vote_weight ));
+         }
+         if( producer_per_vote_pay < pay::min_pervote_daily_pay ) {
+            producer_per_vote_pay = 0;
+         }
       }
 
-      _gstate.pervote_bucket      -= producer_per_vote_pay;
-      _gstate.perblock_bucket     -= producer_per_block_pay;
-      _gstate.total_unpaid_blocks -= prod.unpaid_blocks;
+      ghot.pervote_bucket      -= producer_per_vote_pay;
+      ghot.perblock_bucket     -= producer_per_block_pay;
+      ghot.total_unpaid_blocks -= unpaid_blocks;
 
-      update_total_votepay_share( ct, -new_votepay_share, (updated_after_threshold ? prod.total_votes : 0.0) );
-
-      _producers.modify( prod, same_payer, [&](auto& p) {
-         p.last_claim_time = ct;
-         p.unpaid_blocks   = 0;
-      });
+      if( info.unpaid_blocks > 0 ) {
+         _producers.modify( info, same_payer, [&](auto& p) {
+            p.unpaid_blocks = 0;
+         });
+      }
 
       if( producer_per_block_pay > 0 ) {
-         INLINE_ACTION_SENDER(eosio::token, transfer)(
-            token_account, { {bpay_account, active_permission}, {owner, active_permission} },
-            { bpay_account, owner, asset(producer_per_block_pay, core_symbol()), std::string("producer block pay") }
-         );
+         payout_auth.push_back( {bpay_account, active_permission} );
+         payouts.push_back({ bpay_account, owner, asset(producer_per_block_pay, core_symbol()), std::string("producer block pay") });
       }
       if( producer_per_vote_pay > 0 ) {
-         INLINE_ACTION_SENDER(eosio::token, transfer)(
-            token_account, { {vpay_account, active_permission}, {owner, active_permission} },
-            { vpay_account, owner, asset(producer_per_vote_pay, core_symbol()), std::string("producer vote pay") }
-         );
+         payout_auth.push_back( {vpay_account, active_permission} );
+         payouts.push_back({ vpay_account, owner, asset(producer_per_vote_pay, core_symbol()), std::string("producer vote pay") });
       }
+      if( producer_per_block_pay > 0 || producer_per_vote_pay > 0 ) {
+         // the producer pays for its balance row, as with the separate transfers
+         payout_auth.push_back( {owner, active_permission} );
+      }
+
+      if( !payouts.empty() ) {
+         INLINE_ACTION_SENDER(eosio::token, transfers)( token_account, payout_auth, { payouts } );
+      }
+   }
+
+   void system_contract::syncsupply() {
+      const int64_t supply = eosio::token::get_supply( token_account, core_symbol().code() ).amount;
+      eosio_assert( _ghot.get().core_supply != supply, "core supply is already in sync" );
+      _ghot.modify().core_supply = supply;
    }
 
 } //namespace eosiosystem
@@ -3,6 +3,7 @@
  *  @copyright defined in eos/LICENSE.txt
  */
 #include <eosio.system/eosio.system.hpp>
+#include <eosio.system/producer_pay_math.hpp>
 
 #include <eosiolib/eosio.hpp>
 #include <eosiolib/crypto.h>
@@ -11,6 +12,7 @@
 #include <eosiolib/serialize.hpp>
 #include <eosiolib/multi_index.hpp>
 #include <eosiolib/privileged.hpp>
+#include <eosiolib/producer_schedule.h>
 #include <eosiolib/singleton.hpp>
 #include <eosiolib/transaction.hpp>
 #include <eosio.token/eosio.token.hpp>
@@ -51,14 +53,24 @@ namespace eosiosystem {
                info.last_claim_time = ct;
          });
 
-         auto prod2 = _producers2.find( producer.value );
-         if ( prod2 == _producers2.end() ) {
-            _producers2.emplace( producer, [&]( producer_info2& info ){
-               info.owner                     = producer;
-               info.last_votepay_share_update = ct;
-            });
-            update_total_votepay_share( ct, 0.0, prod->total_votes );
-            // When introducing the producer2 table row for the first time, the producer's votes must also be accounted for in the global total_producer_votepay_share at the same time.
+         auto tally = get_tally( producer );
+         const bool track_votepay = !tally->has_votepay();
+         _tallies.modify( tally, same_payer, [&]( producer_tally& t ){
+            t.is_active = true;
+            if ( t.last_claim_time == time_point() )
+               t.last_claim_time = ct;
+            if ( track_votepay )
+               t.last_votepay_share_update = ct;
+         });
+
+         // the key, location or activation of a producer with votes may change the schedule
+         if ( tally->total_votes > 0 ) {
+            invalidate_top_producers();
+         }
+
+         if ( track_votepay ) {
+            update_total_votepay_share( ct, 0.0, tally->vote_weight() );
+            // When tracking vote pay for the producer for the first time, the producer's votes must also be accounted for in the global total_producer_votepay_share at the same time.
          }
       } else {
          _producers.emplace( producer, [&]( producer_info& info ){
@@ -70,10 +82,13 @@ namespace eosiosystem {
             info.location        = location;
             info.last_claim_time = ct;
          });
-         _producers2.emplace( producer, [&]( producer_info2& info ){
-            info.owner                     = producer;
-            info.last_votepay_share_update = ct;
+         _tallies.emplace( producer, [&]( producer_tally& t ){
+            t.owner                     = producer;
+            t.is_active                 = true;
+            t.last_claim_time           = ct;
+            t.last_votepay_share_update = ct;
          });
+         get_producer_slot( producer, producer );
       }
 
    }
@@ -85,21 +100,211 @@ namespace eosiosystem {
       _producers.modify( prod, same_payer, [&]( producer_info& info ){
          info.deactivate();
       });
+      _tallies.modify( get_tally( producer ), same_payer, [&]( producer_tally& t ){
+         t.is_active = false;
+      });
+      if ( _topprods.get().elected( producer ) ) {
+         invalidate_top_producers();
+      }
+   }
+
+   void system_contract::migrateprods( uint32_t max_rows ) {
+      require_auth( _self );
+
+      auto& state = _prodmigrate.modify();
+      if ( state.done ) {
+         // every tally has taken over its vote pay accounting, the producers2 rows are only released
+         auto prod2 = _producers2.begin();
+         eosio_assert( prod2 != _producers2.end(), "producers are already migrated" );
+         for ( uint32_t rows = 0; prod2 != _producers2.end() && rows < max_rows; ++rows ) {
+            prod2 = _producers2.erase( prod2 );
+         }
+         return;
+      }
+
+      auto prod = _producers.lower_bound( state.next.value );
+      for ( uint32_t rows = 0; prod != _producers.end() && rows < max_rows; ++prod, ++rows ) {
+         get_tally( prod->owner );
+      }
+
+      if ( prod == _producers.end() ) {
+         state.done = true;
+      } else {
+         state.next = prod->owner;
+      }
+   }
+
+   /**
+    *  Finds the vote tally of a producer. Producers registered before the prodtally table existed
+    *  get their tally from producer_info and producer_info2 on first use, until migrateprods has
+    *  visited every row.
+    */
+   producer_tally_table::const_iterator system_contract::get_tally( const name producer ) {
+      auto tally = _tallies.find( producer.value );
+      if ( tally != _tallies.end() || _prodmigrate.get().done )
+         return tally;
+
+      auto prod = _producers.find( producer.value );
+      if ( prod == _producers.end() )
+         return tally;
+
+      auto prod2 = _producers2.find( producer.value );
+      return _tallies.emplace( _self, [&]( producer_tally& t ){
+         t.owner           = prod->owner;
+         t.total_votes     = votes::from_double( prod->total_votes );
+         t.is_active       = prod->is_active;
+         t.last_claim_time = prod->last_claim_time;
+         if ( prod2 != _producers2.end() ) {
+            t.votepay_share             = prod2->votepay_share;
+            t.last_votepay_share_update = prod2->last_votepay_share_update;
+         }
+      });
+   }
+
+   /**
+    *  Marks the cached top producers dirty when a vote change may move `tally` across the top 21
+    *  boundary: an elected producer losing votes or another active producer reaching the votes of
+    *  the last elected one. Order changes within the top 21 do not change the schedule.
+    */
+   void system_contract::check_top_producers( const producer_tally& tally, votes::fixed init_votes ) {
+      const auto& top = _topprods.get();
+      if ( top.dirty )
+         return;
+
+      const bool changed = top.elected( tally.owner )
+                           ? tally.total_votes < init_votes
+                           : tally.active() && tally.total_votes > 0 && tally.total_votes >= top.threshold;
+      if ( changed ) {
+         invalidate_top_producers();
+      }
+   }
+
+   void system_contract::invalidate_top_producers() {
+      if ( !_topprods.get().dirty ) {
+         _topprods.modify().dirty = true;
+      }
+   }
+
+   /// the schedule is computed from producer_info until every producer has a tally
+   void system_contract::sync_legacy_votes( const producer_tally& tally ) {
+      if ( !_prodmigrate.get().done ) {
+         _producers.modify( _producers.get( tally.owner.value ), same_payer, [&]( producer_info& p ){
+            p.total_votes = tally.vote_weight();
+         });
+      }
+   }
+
+   /**
+    *  Finds the slot of a producer, creating it paid by `payer` if there is none. New producers
+    *  pay for their own slot, producers registered before the prodslots table existed get theirs
+    *  paid by the contract the first time a compact vote row refers to them.
+    */
+   uint64_t system_contract::get_producer_slot( const name producer, const name payer ) {
+      auto idx = _prodslots.get_index<"byowner"_n>();
+      auto itr = idx.find( producer.value );
+      if ( itr != idx.end() )
+         return itr->slot;
+
+      const uint64_t slot = _prodslots.available_primary_key();
+      _prodslots.emplace( payer, [&]( producer_slot& s ){
+         s.slot  = slot;
+         s.owner = producer;
+      });
+      return slot;
+   }
+
+   /// the producers approved by `voter`, sorted by name whichever way the row stores them
+   std::vector<name> system_contract::voted_producers( const voter_info& voter ) {
+      if ( !voter.compact() )
+         return voter.producers;
+
+      std::vector<name> producers;
+      for ( uint64_t slot : slots::decode( voter.producer_slots.value() ) ) {
+         producers.push_back( _prodslots.get( slot, "producer slot not found" ).owner ); //data corruption
+      }
+      std::sort( producers.begin(), producers.end() );
+      return producers;
+   }
+
+   /// stores `producers` in `voter` the way the compact_votes setting asks for
+   void system_contract::set_voted_producers( voter_info& voter, const std::vector<name>& producers ) {
+      if ( _ghot.get().compact_votes && !producers.empty() ) {
+         std::vector<uint64_t> ids;
+         ids.reserve( producers.size() );
+         for ( const auto& p : producers ) {
+            ids.push_back( get_producer_slot( p, _self ) );
+         }
+         voter.producers.clear();
+         voter.producer_slots.emplace( slots::encode( std::move(ids) ) );
+      } else {
+         voter.producers = producers;
+         if ( voter.weights.has_value() )
+            voter.producer_slots.emplace(); // the weights follow the slots
+         else
+            voter.producer_slots.reset();
+      }
+   }
+
+   /// whether the row stores its producers other than the compact_votes setting asks for
+   bool system_contract::needs_reencoding( const voter_info& voter ) {
+      return _ghot.get().compact_votes ? !voter.producers.empty() : voter.compact();
+   }
+
+   /// whether `producers` are the producers of the active schedule, in the same order
+   static bool is_active_schedule( const std::vector<eosio::producer_key>& producers ) {
+      const uint32_t size = get_active_producers( nullptr, 0 );
+      if ( size != producers.size() * sizeof(capi_name) ) {
+         return false;
+      }
+      std::vector<capi_name> active( producers.size() );
+      get_active_producers( active.data(), size );
+      for ( size_t i = 0; i < producers.size(); ++i ) {
+         if ( active[i] != producers[i].producer_name.value ) {
+            return false;
+         }
+      }
+      return true;
    }
 
    void system_contract::update_elected_producers( block_timestamp block_time ) {
-      _gstate.last_producer_schedule_update = block_time;
+      auto& ghot = _ghot.modify();
+      ghot.last_producer_schedule_update = block_time;
+
+      /// nothing that can change the elected producers happened since the last update
+      if ( !_topprods.get().dirty ) {
+         return;
+      }
 
-      auto idx = _producers.get_index<"prototalvote"_n>();
+      auto& top = _topprods.modify();
+      top.dirty = false;
+      top.producers.clear();
+      top.threshold = 0;
 
       std::vector< std::pair<eosio::producer_key,uint16_t> > top_producers;
       top_producers.reserve(21);
 
-      for ( auto it = idx.cbegin(); it != idx.cend() && top_producers.size() < 21 && 0 < it->total_votes && it->active(); ++it ) {
-         top_producers.emplace_back( std::pair<eosio::producer_key,uint16_t>({{it->owner, it->producer_key}, it->location}) );
+      if ( _prodmigrate.get().done ) {
+         auto idx = _tallies.get_index<"prototalvote"_n>();
+         for ( auto it = idx.cbegin(); it != idx.cend() && top_producers.size() < 21 && 0 < it->total_votes && it->active(); ++it ) {
+            const auto& prod = _producers.get( it->owner.value, "producer not found" ); //data corruption
+            top_producers.emplace_back( std::pair<eosio::producer_key,uint16_t>({{prod.owner, prod.producer_key}, prod.location}) );
+            top.producers.push_back( it->owner );
+            top.threshold = it->total_votes;
+         }
+      } else {
+         auto idx = _producers.get_index<"prototalvote"_n>();
+         for ( auto it = idx.cbegin(); it != idx.cend() && top_producers.size() < 21 && 0 < it->total_votes && it->active(); ++it ) {
+            top_producers.emplace_back( std::pair<eosio::producer_key,uint16_t>({{it->owner, it->producer_key}, it->location}) );
+            top.producers.push_back( it->owner );
+            top.threshold = votes::from_double( it->total_votes );
+         }
+      }
+
+      if ( top.producers.size() < 21 ) {
+         top.threshold = 0;
       }
 
-      if ( top_producers.size() < _gstate.last_producer_schedule_size ) {
+      if ( top_producers.size() < ghot.last_producer_schedule_size ) {
          return;
       }
 
@@ -120,66 +325,60 @@ namespace eosiosystem {
 
       auto packed_schedule = pack(producers);
 
-      if( set_proposed_producers( packed_schedule.data(),  packed_schedule.size() ) >= 0 ) {
-         _gstate.last_producer_schedule_size = static_cast<decltype(_gstate.last_producer_schedule_size)>( top_producers.size() );
-      }
-   }
-
-   double stake2vote( int64_t staked ) {
-      /// TODO subtract 2080 brings the large numbers closer to this decade
-      double weight = int64_t( (now() - (block_timestamp::block_timestamp_epoch / 1000)) / (seconds_per_day * 7) )  / double( 52 );
-      return double(staked) * std::pow( 2, weight );
-   }
-
-   double system_contract::update_total_votepay_share( time_point ct,
-                                                       double additional_shares_delta,
-                                                       double shares_rate_delta )
-   {
-      double delta_total_votepay_share = 0.0;
-      if( ct > _gstate3.last_vpay_state_update ) {
-         delta_total_votepay_share = _gstate3.total_vpay_share_change_rate
-                                       * double( (ct - _gstate3.last_vpay_state_update).count() / 1E6 );
+      /// the same producers as last time, possibly in a different vote order
+      capi_checksum256 schedule_hash;
+      sha256( packed_schedule.data(), packed_schedule.size(), &schedule_hash );
+      if ( std::equal( std::begin(schedule_hash.hash), std::end(schedule_hash.hash), std::begin(top.schedule_hash.hash) ) ) {
+         return;
       }
 
-      delta_total_votepay_share += additional_shares_delta;
-      if( delta_total_votepay_share < 0 && _gstate2.total_producer_votepay_share < -delta_total_votepay_share ) {
-         _gstate2.total_producer_votepay_share = 0.0;
+      // set_proposed_producers also refuses the schedule that is already active, as after an upgrade
+      // when no hash was stored yet; only a proposal still waiting to become pending is retried
+      if( set_proposed_producers( packed_schedule.data(),  packed_schedule.size() ) >= 0 || is_active_schedule( producers ) ) {
+         ghot.last_producer_schedule_size = static_cast<decltype(ghot.last_producer_schedule_size)>( top_producers.size() );
+         top.schedule_hash = schedule_hash;
       } else {
-         _gstate2.total_producer_votepay_share += delta_total_votepay_share;
+         top.dirty = true;
       }
+   }
 
-      if( shares_rate_delta < 0 && _gstate3.total_vpay_share_change_rate < -shares_rate_delta ) {
-         _gstate3.total_vpay_share_change_rate = 0.0;
-      } else {
-         _gstate3.total_vpay_share_change_rate += shares_rate_delta;
+   /**
+    *  The vote weight of a token only changes once a week, std::pow runs the first time it is
+    *  needed in a week and its result is kept in the globalhot row in fixed point, rounded down to
+    *  a multiple of 2^-32.
+    */
+   votes::fixed system_contract::stake2vote( int64_t staked ) {
+      /// TODO subtract 2080 brings the large numbers closer to this decade
+      const uint32_t week = uint32_t( (now() - (block_timestamp::block_timestamp_epoch / 1000)) / (seconds_per_day * 7) );
+      if ( _ghot.get().vote_weight_week != week ) {
+         auto& ghot = _ghot.modify();
+         ghot.vote_weight_week = week;
+         ghot.vote_weight      = votes::from_double( std::pow( 2, week / double( 52 ) ) );
       }
+      return votes::stake_weight( staked, _ghot.get().vote_weight );
+   }
 
-      _gstate3.last_vpay_state_update = ct;
+   pay::votepay_totals system_contract::get_votepay_totals() {
+      return { _gstate2.get().total_producer_votepay_share,
+               _gstate3.get().total_vpay_share_change_rate,
+               _gstate3.get().last_vpay_state_update.time_since_epoch().count() };
+   }
 
-      return _gstate2.total_producer_votepay_share;
+   void system_contract::set_votepay_totals( const pay::votepay_totals& totals ) {
+      _gstate2.modify().total_producer_votepay_share = totals.total_share;
+      auto& gstate3 = _gstate3.modify();
+      gstate3.total_vpay_share_change_rate = totals.change_rate;
+      gstate3.last_vpay_state_update       = time_point( microseconds( totals.last_update ) );
    }
 
-   double system_contract::update_producer_votepay_share( const producers_table2::const_iterator& prod_itr,
-                                                          time_point ct,
-                                                          double shares_rate,
-                                                          bool reset_to_zero )
+   double system_contract::update_total_votepay_share( time_point ct,
+                                                       double additional_shares_delta,
+                                                       double shares_rate_delta )
    {
-      double delta_votepay_share = 0.0;
-      if( shares_rate > 0.0 && ct > prod_itr->last_votepay_share_update ) {
-         delta_votepay_share = shares_rate * double( (ct - prod_itr->last_votepay_share_update).count() / 1E6 ); // cannot be negative
-      }
-
-      double new_votepay_share = prod_itr->votepay_share + delta_votepay_share;
-      _producers2.modify( prod_itr, same_payer, [&](auto& p) {
-         if( reset_to_zero )
-            p.votepay_share = 0.0;
-         else
-            p.votepay_share = new_votepay_share;
-
-         p.last_votepay_share_update = ct;
-      } );
-
-      return new_votepay_share;
+      auto totals = get_votepay_totals();
+      pay::update_totals( totals, ct.time_since_epoch().count(), additional_shares_delta, shares_rate_delta );
+      set_votepay_totals( totals );
+      return totals.total_share;
    }
 
    /**
@@ -225,32 +424,33 @@ namespace eosiosystem {
        * after total_activated_stake hits threshold, we can use last_vote_weight to determine that this is
        * their first vote and should consider their stake activated.
        */
-      if( voter->last_vote_weight <= 0.0 ) {
-         _gstate.total_activated_stake += voter->staked;
+      const votes::fixed last_vote_weight = voter->last_weight();
+      if( last_vote_weight == 0 ) {
+         _gstate.modify().total_activated_stake += voter->staked;
          /// modified
-         // if( _gstate.total_activated_stake >= min_activated_stake && _gstate.thresh_activated_stake_time == time_point() ) {
-         //    _gstate.thresh_activated_stake_time = current_time_point();
+         // if( _gstate.get().total_activated_stake >= min_activated_stake && _ghot.get().thresh_activated_stake_time == time_point() ) {
+         //    _ghot.modify().thresh_activated_stake_time = current_time_point();
          // }
       }
 
       auto new_vote_weight = stake2vote( voter->staked );
       if( voter->is_proxy ) {
-         new_vote_weight += voter->proxied_vote_weight;
+         new_vote_weight = votes::add( new_vote_weight, votes::change( voter->proxied_weight() ) );
       }
 
-      boost::container::flat_map<name, pair<double, bool /*new*/> > producer_deltas;
-      if ( voter->last_vote_weight > 0 ) {
+      boost::container::flat_map<name, pair<votes::change, bool /*new*/> > producer_deltas;
+      if ( last_vote_weight > 0 ) {
          if( voter->proxy ) {
             auto old_proxy = _voters.find( voter->proxy.value );
             eosio_assert( old_proxy != _voters.end(), "old proxy not found" ); //data corruption
             _voters.modify( old_proxy, same_payer, [&]( auto& vp ) {
-                  vp.proxied_vote_weight -= voter->last_vote_weight;
+                  vp.update_weights( vp.last_weight(), votes::add( vp.proxied_weight(), -votes::change( last_vote_weight ) ) );
                });
             propagate_weight_change( *old_proxy );
          } else {
-            for( const auto& p : voter->producers ) {
+            for( const auto& p : voted_producers( *voter ) ) {
                auto& d = producer_deltas[p];
-               d.first -= voter->last_vote_weight;
+               d.first -= votes::change( last_vote_weight );
                d.second = false;
             }
          }
@@ -260,69 +460,24 @@ namespace eosiosystem {
          auto new_proxy = _voters.find( proxy.value );
          eosio_assert( new_proxy != _voters.end(), "invalid proxy specified" ); //if ( !voting ) { data corruption } else { wrong vote }
          eosio_assert( !voting || new_proxy->is_proxy, "proxy not found" );
-         if ( new_vote_weight >= 0 ) {
-            _voters.modify( new_proxy, same_payer, [&]( auto& vp ) {
-                  vp.proxied_vote_weight += new_vote_weight;
-               });
-            propagate_weight_change( *new_proxy );
-         }
-      } else {
-         if( new_vote_weight >= 0 ) {
-            for( const auto& p : producers ) {
-               auto& d = producer_deltas[p];
-               d.first += new_vote_weight;
-               d.second = true;
-            }
-         }
-      }
-
-      const auto ct = current_time_point();
-      double delta_change_rate         = 0.0;
-      double total_inactive_vpay_share = 0.0;
-      for( const auto& pd : producer_deltas ) {
-         auto pitr = _producers.find( pd.first.value );
-         if( pitr != _producers.end() ) {
-            eosio_assert( !voting || pitr->active() || !pd.second.second /* not from new set */, "producer is not currently registered" );
-            double init_total_votes = pitr->total_votes;
-            _producers.modify( pitr, same_payer, [&]( auto& p ) {
-               p.total_votes += pd.second.first;
-               if ( p.total_votes < 0 ) { // floating point arithmetics can give small negative numbers
-                  p.total_votes = 0;
-               }
-               _gstate.total_producer_vote_weight += pd.second.first;
-               //eosio_assert( p.total_votes >= 0, "something bad happened" );
+         _voters.modify( new_proxy, same_payer, [&]( auto& vp ) {
+               vp.update_weights( vp.last_weight(), votes::add( vp.proxied_weight(), votes::change( new_vote_weight ) ) );
             });
-            auto prod2 = _producers2.find( pd.first.value );
-            if( prod2 != _producers2.end() ) {
-               const auto last_claim_plus_3days = pitr->last_claim_time + microseconds(3 * useconds_per_day);
-               bool crossed_threshold       = (last_claim_plus_3days <= ct);
-               bool updated_after_threshold = (last_claim_plus_3days <= prod2->last_votepay_share_update);
-               // Note: updated_after_threshold implies cross_threshold
-
-               double new_votepay_share = update_producer_votepay_share( prod2,
-                                             ct,
-                                             updated_after_threshold ? 0.0 : init_total_votes,
-                                             crossed_threshold && !updated_after_threshold // only reset votepay_share once after threshold
-                                          );
-
-               if( !crossed_threshold ) {
-                  delta_change_rate += pd.second.first;
-               } else if( !updated_after_threshold ) {
-                  total_inactive_vpay_share += new_votepay_share;
-                  delta_change_rate -= init_total_votes;
-               }
-            }
-         } else {
-            eosio_assert( !pd.second.second /* not from new set */, "producer is not registered" ); //data corruption
+         propagate_weight_change( *new_proxy );
+      } else {
+         for( const auto& p : producers ) {
+            auto& d = producer_deltas[p];
+            d.first += votes::change( new_vote_weight );
+            d.second = true;
          }
       }
 
-      update_total_votepay_share( ct, -total_inactive_vpay_share, delta_change_rate );
+      apply_producer_deltas( producer_deltas, voting );
 
       _voters.modify( voter, same_payer, [&]( auto& av ) {
-         av.last_vote_weight = new_vote_weight;
-         av.producers = producers;
+         av.set_last_weight( new_vote_weight );
          av.proxy     = proxy;
+         set_voted_producers( av, producers );
       });
    }
 
@@ -356,61 +511,172 @@ namespace eosiosystem {
 
    void system_contract::propagate_weight_change( const voter_info& voter ) {
       eosio_assert( !voter.proxy || !voter.is_proxy, "account registered as a proxy is not allowed to use a proxy" );
-      double new_weight = stake2vote( voter.staked );
+      votes::fixed new_weight = stake2vote( voter.staked );
       if ( voter.is_proxy ) {
-         new_weight += voter.proxied_vote_weight;
+         new_weight = votes::add( new_weight, votes::change( voter.proxied_weight() ) );
       }
 
+      const auto producers = voted_producers( voter );
+      const votes::change delta = votes::change( new_weight ) - votes::change( voter.last_weight() );
+
       /// don't propagate small changes (1 ~= epsilon)
-      if ( fabs( new_weight - voter.last_vote_weight ) > 1 )  {
+      if ( delta > votes::change( votes::one ) || -delta > votes::change( votes::one ) )  {
          if ( voter.proxy ) {
             auto& proxy = _voters.get( voter.proxy.value, "proxy not found" ); //data corruption
             _voters.modify( proxy, same_payer, [&]( auto& p ) {
-                  p.proxied_vote_weight += new_weight - voter.last_vote_weight;
+                  p.update_weights( p.last_weight(), votes::add( p.proxied_weight(), delta ) );
                }
             );
             propagate_weight_change( proxy );
          } else {
-            auto delta = new_weight - voter.last_vote_weight;
-            const auto ct = current_time_point();
-            double delta_change_rate         = 0;
-            double total_inactive_vpay_share = 0;
-            for ( auto acnt : voter.producers ) {
-               auto& prod = _producers.get( acnt.value, "producer not found" ); //data corruption
-               const double init_total_votes = prod.total_votes;
-               _producers.modify( prod, same_payer, [&]( auto& p ) {
-                  p.total_votes += delta;
-                  _gstate.total_producer_vote_weight += delta;
-               });
-               auto prod2 = _producers2.find( acnt.value );
-               if ( prod2 != _producers2.end() ) {
-                  const auto last_claim_plus_3days = prod.last_claim_time + microseconds(3 * useconds_per_day);
-                  bool crossed_threshold       = (last_claim_plus_3days <= ct);
-                  bool updated_after_threshold = (last_claim_plus_3days <= prod2->last_votepay_share_update);
-                  // Note: updated_after_threshold implies cross_threshold
-
-                  double new_votepay_share = update_producer_votepay_share( prod2,
-                                                ct,
-                                                updated_after_threshold ? 0.0 : init_total_votes,
-                                                crossed_threshold && !updated_after_threshold // only reset votepay_share once after threshold
-                                             );
-
-                  if( !crossed_threshold ) {
-                     delta_change_rate += delta;
-                  } else if( !updated_after_threshold ) {
-                     total_inactive_vpay_share += new_votepay_share;
-                     delta_change_rate -= init_total_votes;
-                  }
-               }
+            boost::container::flat_map<name, pair<votes::change, bool /*new*/> > producer_deltas;
+            for ( auto acnt : producers ) {
+               producer_deltas[acnt] = { delta, false };
             }
-
-            update_total_votepay_share( ct, -total_inactive_vpay_share, delta_change_rate );
+            apply_producer_deltas( producer_deltas, false );
          }
       }
+      // also runs for proxies on behalf of the accounts voting through them
+      const bool reencode = needs_reencoding( voter );
       _voters.modify( voter, same_payer, [&]( auto& v ) {
-            v.last_vote_weight = new_weight;
+            v.update_last_weight( new_weight );
+            if ( reencode )
+               set_voted_producers( v, producers );
          }
       );
    }
 
+   /**
+    *  Adds vote weight changes to the producer tallies together with the vote pay accounting they
+    *  imply, the vote total and the vote pay totals in global state are updated once for all
+    *  producers. The weights only become doubles where the vote pay shares need them.
+    *
+    *  @param voting - true if the producers flagged new are being voted for and must be active
+    */
+   void system_contract::apply_producer_deltas( const boost::container::flat_map<name, pair<votes::change, bool /*new*/> >& producer_deltas,
+                                                bool voting )
+   {
+      const auto ct = current_time_point();
+      votes::change         total_votes_change = 0;
+      pay::votepay_changes  votepay_changes;
+      for( const auto& pd : producer_deltas ) {
+         auto pitr = get_tally( pd.first );
+         if( pitr != _tallies.end() ) {
+            eosio_assert( !voting || pitr->active() || !pd.second.second /* not from new set */, "producer is not currently registered" );
+            const votes::fixed init_votes = pitr->total_votes;
+            const auto status = pitr->votepay_status( ct );
+
+            _tallies.modify( pitr, same_payer, [&]( auto& p ) {
+               p.total_votes = votes::add( p.total_votes, pd.second.first ); // clamped at zero
+               auto vp = p.votepay();
+               pay::change_votes( vp, votepay_changes, init_votes, p.total_votes, status, ct.time_since_epoch().count() );
+               p.set_votepay( vp );
+            });
+            sync_legacy_votes( *pitr );
+            check_top_producers( *pitr, init_votes );
+            total_votes_change += votes::change( pitr->total_votes ) - votes::change( init_votes );
+         } else {
+            eosio_assert( !pd.second.second /* not from new set */, "producer is not registered" ); //data corruption
+         }
+      }
+
+      if( total_votes_change != 0 ) {
+         auto& ghot = _ghot.modify();
+         ghot.total_producer_vote_weight = votes::add( ghot.total_producer_vote_weight, total_votes_change );
+      }
+      auto totals = get_votepay_totals();
+      pay::apply_changes( totals, votepay_changes, ct.time_since_epoch().count() );
+      set_votepay_totals( totals );
+   }
+
+   void system_contract::refreshvotes( const name cursor, uint32_t max_rows ) {
+      eosio_assert( max_rows > 0, "max_rows must be positive" );
+
+      auto voter = _voters.lower_bound( cursor.value );
+      eosio_assert( voter != _voters.end(), "no voters to refresh" );
+
+      boost::container::flat_map<name, pair<votes::change, bool /*new*/> > producer_deltas;
+      boost::container::flat_map<name, votes::change> proxy_deltas;
+      for ( uint32_t rows = 0; voter != _voters.end() && rows < max_rows; ++voter, ++rows ) {
+         if ( voter->is_proxy ) {
+            // refreshed below together with the weight proxied to it
+            proxy_deltas[voter->owner];
+            continue;
+         }
+         const votes::fixed last_weight = voter->last_weight();
+         if ( last_weight == 0 ) {
+            continue;
+         }
+         const votes::fixed new_weight = stake2vote( voter->staked );
+         const votes::change delta = votes::change( new_weight ) - votes::change( last_weight );
+         if ( delta == 0 ) {
+            continue;
+         }
+         const auto producers = voted_producers( *voter );
+         if ( voter->proxy ) {
+            proxy_deltas[voter->proxy] += delta;
+         } else {
+            for ( const auto& p : producers ) {
+               producer_deltas[p].first += delta;
+            }
+         }
+         const bool reencode = needs_reencoding( *voter );
+         _voters.modify( voter, same_payer, [&]( auto& v ) {
+            v.update_last_weight( new_weight );
+            if ( reencode )
+               set_voted_producers( v, producers );
+         });
+      }
+
+      for ( const auto& pd : proxy_deltas ) {
+         const auto& proxy = _voters.get( pd.first.value, "proxy not found" ); //data corruption
+         const auto producers = voted_producers( proxy );
+         const votes::fixed last_weight = proxy.last_weight();
+         const votes::fixed proxied     = votes::add( proxy.proxied_weight(), pd.second );
+         votes::fixed new_weight = last_weight;
+         if ( proxy.is_proxy && last_weight > 0 ) {
+            // a proxy cannot use a proxy itself, its weight goes to the producers it votes for
+            new_weight = votes::add( stake2vote( proxy.staked ), votes::change( proxied ) );
+            for ( const auto& p : producers ) {
+               producer_deltas[p].first += votes::change( new_weight ) - votes::change( last_weight );
+            }
+         }
+         if ( pd.second == 0 && new_weight == last_weight ) {
+            continue;
+         }
+         const bool reencode = needs_reencoding( proxy );
+         _voters.modify( proxy, same_payer, [&]( auto& v ) {
+            v.update_weights( new_weight, proxied );
+            if ( reencode )
+               set_voted_producers( v, producers );
+         });
+      }
+
+      apply_producer_deltas( producer_deltas, false );
+   }
+
+   void system_contract::migratevoter( const name cursor, uint32_t max_rows ) {
+      require_auth( _self );
+      eosio_assert( max_rows > 0, "max_rows must be positive" );
+
+      auto voter = _voters.lower_bound( cursor.value );
+      eosio_assert( voter != _voters.end(), "no voters to migrate" );
+      for ( uint32_t rows = 0; voter != _voters.end() && rows < max_rows; ++voter, ++rows ) {
+         if ( voter->weights.has_value() ) {
+            continue;
+         }
+         // the doubles were rounded by the legacy math, but a weight of a stake of two units or more
+         // since 2020 is at least 2^21, a multiple of 2^-31 as a double, and converts without rounding again
+         _voters.modify( voter, same_payer, [&]( auto& v ) {
+            v.set_weights( v.last_weight(), v.proxied_weight() );
+         });
+      }
+   }
+
+   void system_contract::setcompact( bool compact ) {
+      require_auth( _self );
+      eosio_assert( compact != _ghot.get().compact_votes, "action has no effect" );
+      _ghot.modify().compact_votes = compact;
+   }
+
 } /// namespace eosiosystem
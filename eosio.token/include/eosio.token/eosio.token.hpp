@@ -8,6 +8,7 @@
 #include <eosiolib/eosio.hpp>
 
 #include <string>
+#include <vector>
 
 namespace eosiosystem {
    class system_contract;
@@ -21,6 +22,15 @@ namespace eosio {
       public:
          using contract::contract;
 
+         struct transfer_args {
+            name    from;
+            name    to;
+            asset   quantity;
+            string  memo;
+
+            EOSLIB_SERIALIZE( transfer_args, (from)(to)(quantity)(memo) )
+         };
+
          [[eosio::action]]
          void create( name   issuer,
                       asset  maximum_supply);
@@ -37,6 +47,13 @@ namespace eosio {
                         asset   quantity,
                         string  memo );
 
+         /**
+          *  Settles several transfers of one token in order, each as if by transfer, with a single
+          *  lookup of the token stats. Every sender and recipient is notified of this action.
+          */
+         [[eosio::action]]
+         void transfers( const std::vector<transfer_args>& transfers );
+
          [[eosio::action]]
          void open( name owner, const symbol& symbol, name ram_payer );
 
@@ -75,6 +92,7 @@ namespace eosio {
          typedef eosio::multi_index< "accounts"_n, account > accounts;
          typedef eosio::multi_index< "stat"_n, currency_stats > stats;
 
+         void settle( const currency_stats& st, name from, name to, const asset& quantity, const string& memo );
          void sub_balance( name owner, asset value );
          void add_balance( name owner, asset value, name ram_payer );
    };
@@ -89,13 +89,32 @@ void token::transfer( name    from,
                       asset   quantity,
                       string  memo )
 {
-    eosio_assert( from != to, "cannot transfer to self" );
-    require_auth( from );
-    eosio_assert( is_account( to ), "to account does not exist");
     auto sym = quantity.symbol.code();
     stats statstable( _self, sym.raw() );
     const auto& st = statstable.get( sym.raw() );
 
+    settle( st, from, to, quantity, memo );
+}
+
+void token::transfers( const std::vector<transfer_args>& transfers )
+{
+    eosio_assert( !transfers.empty(), "no transfers given" );
+    auto sym = transfers.front().quantity.symbol.code();
+    stats statstable( _self, sym.raw() );
+    const auto& st = statstable.get( sym.raw() );
+
+    for( const auto& t : transfers ) {
+       eosio_assert( t.quantity.symbol.code() == sym, "all transfers must be of one token" );
+       settle( st, t.from, t.to, t.quantity, t.memo );
+    }
+}
+
+void token::settle( const currency_stats& st, name from, name to, const asset& quantity, const string& memo )
+{
+    eosio_assert( from != to, "cannot transfer to self" );
+    require_auth( from );
+    eosio_assert( is_account( to ), "to account does not exist");
+
     require_recipient( from );
     require_recipient( to );
 
@@ -167,4 +186,4 @@ void token::close( name owner, const symbol& symbol )
 
 } /// namespace eosio
 
-EOSIO_DISPATCH( eosio::token, (create)(issue)(transfer)(open)(close)(retire) )
+EOSIO_DISPATCH( eosio::token, (create)(issue)(transfer)(transfers)(open)(close)(retire) )
@@ -0,0 +1,922 @@
+#include <boost/test/unit_test.hpp>
+#include <eosio/chain/contract_table_objects.hpp>
+#include <eosio/chain/global_property_object.hpp>
+#include <eosio/chain/resource_limits.hpp>
+#include <eosio/chain/wast_to_wasm.hpp>
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdlib>
+#include <fstream>
+#include <iostream>
+#include <string>
+#include <fc/io/json.hpp>
+#include <fc/log/logger.hpp>
+#include <eosio/chain/exceptions.hpp>
+#include <Runtime/Runtime.h>
+#include <eosio.system/bancor.hpp>
+#include <eosio.system/producer_slots.hpp>
+#include <random>
+#include <set>
+
+#include "eosio.system_tester.hpp"
+
+using namespace eosio_system;
+
+/**
+ *  Benchmarks of the system contract hot paths. They only report numbers and fail only when the
+ *  measured actions fail. Run them with
+ *
+ *     unit_test --run_test=eosio_system_bench_tests --log_level=message
+ *
+ *  bench_voting_scale reads the size of its population from the environment, see there.
+ */
+namespace {
+
+   struct bench_result {
+      uint64_t count      = 0;
+      uint64_t billed_cpu = 0; ///< sum of billed cpu in us
+      uint64_t elapsed    = 0; ///< sum of wall clock in us
+      uint64_t net        = 0; ///< sum of billed net in bytes
+      uint64_t actions    = 0; ///< sum of action traces, inline actions and notifications included
+      uint64_t act_bytes  = 0; ///< sum of the packed actions of those traces
+      int64_t  ram        = 0; ///< sum of ram usage changes in bytes, only where a benchmark measures them
+
+      void add( const transaction_trace_ptr& trace ) {
+         BOOST_REQUIRE( trace->receipt );
+         ++count;
+         billed_cpu += trace->receipt->cpu_usage_us;
+         elapsed    += trace->elapsed.count();
+         net        += trace->net_usage;
+         actions    += trace->action_traces.size();
+         for( const auto& at : trace->action_traces ) {
+            act_bytes += fc::raw::pack_size( at.act );
+         }
+      }
+
+      void report( const std::string& what )const {
+         BOOST_TEST_MESSAGE( what << ": " << count << " trx, "
+                             << double(billed_cpu) / count << " us billed cpu, "
+                             << double(elapsed) / count << " us elapsed, "
+                             << double(net) / count << " bytes net, "
+                             << double(actions) / count << " action traces of "
+                             << double(act_bytes) / count << " bytes per trx" );
+      }
+
+      /// per transaction averages for the json reports
+      fc::mutable_variant_object averages()const {
+         if( count == 0 )
+            return mvo()("count", 0);
+         return mvo()("count",         count)
+                     ("billed_cpu_us", double(billed_cpu) / count)
+                     ("elapsed_us",    double(elapsed) / count)
+                     ("net_bytes",     double(net) / count)
+                     ("ram_bytes",     double(ram) / count);
+      }
+   };
+
+   template<typename F>
+   double native_ns_per_call( uint32_t iterations, F&& f ) {
+      auto start = std::chrono::steady_clock::now();
+      for( uint32_t i = 0; i < iterations; ++i ) {
+         f( i );
+      }
+      auto stop = std::chrono::steady_clock::now();
+      return double( std::chrono::duration_cast<std::chrono::nanoseconds>( stop - start ).count() ) / iterations;
+   }
+
+   uint32_t bench_env( const char* var, uint32_t fallback ) {
+      const char* value = std::getenv( var );
+      return value ? uint32_t( std::strtoul( value, nullptr, 10 ) ) : fallback;
+   }
+
+   /// prefix followed by five letters counting up from "aaaaa"
+   account_name bench_account( const std::string& prefix, uint32_t i ) {
+      std::string n = prefix;
+      for( uint32_t j = 0; j < 5; ++j, i /= 26 ) n += char('a' + i % 26);
+      return account_name( n );
+   }
+
+}
+
+BOOST_AUTO_TEST_SUITE(eosio_system_bench_tests)
+
+BOOST_AUTO_TEST_CASE( bench_bancor_native ) try {
+   const uint32_t iterations = 1000000;
+   const int64_t  ramcore = 100000000000000ll, ram = 64ll*1024*1024*1024, core = 1000000000ll;
+   volatile int64_t sink = 0;
+
+   double fixed_buy = native_ns_per_call( iterations, [&]( uint32_t i ) {
+      sink += eosiosystem::bancor::to_exchange( ramcore, core + i, 1990000 + i );
+   });
+   double double_buy = native_ns_per_call( iterations, [&]( uint32_t i ) {
+      double R(ramcore), C(core + i + 1990000 + i), T(1990000 + i);
+      sink += int64_t( -R * (1.0 - std::pow( 1.0 + T / C, 0.5 )) );
+   });
+   double fixed_sell = native_ns_per_call( iterations, [&]( uint32_t i ) {
+      sink += eosiosystem::bancor::from_exchange( ramcore, ram + i, 99500000000ll + i );
+   });
+   double double_sell = native_ns_per_call( iterations, [&]( uint32_t i ) {
+      double R(ramcore - 99500000000ll - i), C(ram + i), E(99500000000ll + i);
+      sink += int64_t( C * (std::pow( 1.0 + E / R, 2.0 ) - 1.0) );
+   });
+
+   // native code runs doubles on the FPU, inside the contract they go through softfloat
+   BOOST_TEST_MESSAGE( "bancor to_exchange:   integer " << fixed_buy  << " ns, double " << double_buy  << " ns" );
+   BOOST_TEST_MESSAGE( "bancor from_exchange: integer " << fixed_sell << " ns, double " << double_sell << " ns" );
+} FC_LOG_AND_RETHROW()
+
+BOOST_AUTO_TEST_CASE( bench_bancor_quote_native ) try {
+   const uint32_t iterations = 1000000;
+   const int64_t  ramcore = 100000000000000ll, ram = 64ll*1024*1024*1024, core = 1000000000ll;
+   volatile int64_t sink = 0;
+
+   // price of 8000 bytes: RAM -> RAMCORE -> core as buyrambytes used to do it, then in closed form
+   double two_legs = native_ns_per_call( iterations, [&]( uint32_t i ) {
+      int64_t issued = eosiosystem::bancor::to_exchange( ramcore, ram + i, 8000 );
+      sink += eosiosystem::bancor::from_exchange( ramcore + issued, core + i, issued );
+   });
+   double closed_form = native_ns_per_call( iterations, [&]( uint32_t i ) {
+      sink += eosiosystem::bancor::input( ram + i, core + i, 8000 );
+   });
+
+   BOOST_TEST_MESSAGE( "ram quote: two conversions " << two_legs << " ns, closed form " << closed_form << " ns" );
+} FC_LOG_AND_RETHROW()
+
+BOOST_FIXTURE_TEST_CASE( bench_ram_trades, eosio_system_tester ) try {
+   const uint32_t trades = 100;
+   transfer( "eosio", "alice1111111", core_sym::from_string("100000.0000"), "eosio" );
+
+   bench_result buy, sell;
+   for( uint32_t i = 0; i < trades; ++i ) {
+      buy.add( base_tester::push_action( config::system_account_name, N(buyram), N(alice1111111), mvo()
+                                         ("payer", "alice1111111")
+                                         ("receiver", "alice1111111")
+                                         ("quant", core_sym::from_string("10.0000") ) ) );
+      sell.add( base_tester::push_action( config::system_account_name, N(sellram), N(alice1111111), mvo()
+                                          ("account", "alice1111111")
+                                          ("bytes", 1024 ) ) );
+      produce_block();
+   }
+   buy.report( "buyram" );
+   sell.report( "sellram" );
+
+   // the fees of all trades above are paid to eosio.ramfee at once
+   bench_result sweep;
+   sweep.add( base_tester::push_action( config::system_account_name, N(sweepramfee), N(bob111111111), mvo() ) );
+   sweep.report( "sweepramfee after " + std::to_string( 2 * trades ) + " trades" );
+} FC_LOG_AND_RETHROW()
+
+BOOST_FIXTURE_TEST_CASE( bench_buyrambytes, eosio_system_tester ) try {
+   const uint32_t trades = 100;
+   transfer( "eosio", "alice1111111", core_sym::from_string("100000.0000"), "eosio" );
+
+   bench_result result;
+   for( uint32_t i = 0; i < trades; ++i ) {
+      result.add( base_tester::push_action( config::system_account_name, N(buyrambytes), N(alice1111111), mvo()
+                                            ("payer", "alice1111111")
+                                            ("receiver", "alice1111111")
+                                            ("bytes", 8000 ) ) );
+      produce_block();
+   }
+   result.report( "buyrambytes" );
+} FC_LOG_AND_RETHROW()
+
+BOOST_FIXTURE_TEST_CASE( bench_onblock, eosio_system_tester ) try {
+   const uint32_t blocks = 200;
+
+   // onblock runs as an implicit transaction without a receipt, only its wall clock time is available
+   uint64_t count = 0, elapsed = 0;
+   control->applied_transaction.connect([&]( const transaction_trace_ptr& t ) {
+      if( !t->action_traces.empty() && t->action_traces[0].act.name == N(onblock) ) {
+         BOOST_REQUIRE( !t->except );
+         ++count;
+         elapsed += t->elapsed.count();
+      }
+   });
+   produce_blocks( blocks );
+   BOOST_REQUIRE_LT( 0u, count );
+   BOOST_TEST_MESSAGE( "onblock: " << count << " blocks, " << double(elapsed) / count << " us elapsed per block" );
+} FC_LOG_AND_RETHROW()
+
+BOOST_FIXTURE_TEST_CASE( bench_onblock_name_close, eosio_system_tester ) try {
+   const uint32_t bids = 10000, days = 5;
+
+   cross_15_percent_threshold();
+
+   // benchaaaaa, benchbaaaa, ... bid for by eosio, which has no resource limits
+   for( uint32_t i = 0; i < bids; i += 50 ) {
+      signed_transaction trx;
+      for( uint32_t j = i; j < i + 50; ++j ) {
+         trx.actions.emplace_back( get_action( config::system_account_name, N(bidname),
+                                               vector<permission_level>{{config::system_account_name, config::active_name}},
+                                               mvo()
+                                               ("bidder", config::system_account_name)
+                                               ("newname", bench_account( "bench", j ))
+                                               ("bid", core_sym::from_string("1.0000")) ) );
+      }
+      set_transaction_headers( trx );
+      trx.sign( get_private_key( config::system_account_name, "active" ), control->get_chain_id() );
+      push_transaction( trx );
+      produce_block();
+   }
+   // name auctions open 14 days after activation
+   produce_block( fc::days(14) );
+   produce_block();
+
+   // the slowest onblock of each day is the one closing auctions
+   uint64_t elapsed = 0;
+   control->applied_transaction.connect([&]( const transaction_trace_ptr& t ) {
+      if( !t->action_traces.empty() && t->action_traces[0].act.name == N(onblock) ) {
+         BOOST_REQUIRE( !t->except );
+         elapsed = std::max<uint64_t>( elapsed, t->elapsed.count() );
+      }
+   });
+   uint64_t total = 0;
+   for( uint32_t d = 0; d < days; ++d ) {
+      elapsed = 0;
+      produce_block( fc::days(1) );
+      produce_block();
+      total += elapsed;
+   }
+   BOOST_TEST_MESSAGE( "onblock closing name auctions with " << bids << " open bids: " << double(total) / days << " us elapsed" );
+
+   elapsed = 0;
+   produce_block();
+   BOOST_TEST_MESSAGE( "onblock without closing: " << elapsed << " us elapsed" );
+} FC_LOG_AND_RETHROW()
+
+BOOST_FIXTURE_TEST_CASE( bench_voteproducer, eosio_system_tester ) try {
+   const uint32_t votes = 50;
+
+   // 30 producers with long urls, the worst case for rows that carry the producer metadata. Each
+   // vote writes one prodtally row per producer, votes and vote pay together.
+   std::vector<account_name> producers;
+   for( char c = 'a'; c <= 'z'; ++c ) producers.emplace_back( std::string("benchprod1") + c );
+   for( char c = '1'; c <= '4'; ++c ) producers.emplace_back( std::string("benchprod2") + c );
+   for( const auto& p : producers ) {
+      create_account_with_resources( p, config::system_account_name, 20000 );
+      BOOST_REQUIRE_EQUAL( success(), push_action( p, N(regproducer), mvo()
+                                                   ("producer",  p )
+                                                   ("producer_key", get_public_key( p, "active" ) )
+                                                   ("url", std::string( 500, 'u' ) )
+                                                   ("location", 0 ) ) );
+   }
+   produce_block();
+
+   transfer( "eosio", "alice1111111", core_sym::from_string("100000.0000"), "eosio" );
+   BOOST_REQUIRE_EQUAL( success(), stake( "alice1111111", core_sym::from_string("1000.0000"), core_sym::from_string("1000.0000") ) );
+
+   const auto& rlm = control->get_resource_limits_manager();
+   const int64_t ram_before = rlm.get_account_ram_usage( config::system_account_name );
+
+   bench_result result;
+   for( uint32_t i = 0; i < votes; ++i ) {
+      // alternate between two sets so that every vote changes the tally of all 30 producers
+      std::vector<account_name> vote_for( producers.begin() + (i % 2), producers.end() - ((i + 1) % 2) );
+      result.add( base_tester::push_action( config::system_account_name, N(voteproducer), N(alice1111111), mvo()
+                                            ("voter", "alice1111111")
+                                            ("proxy", name(0).to_string())
+                                            ("producers", vote_for ) ) );
+      produce_block();
+   }
+   result.report( "voteproducer (29 producers)" );
+   BOOST_TEST_MESSAGE( "voteproducer: " << rlm.get_account_ram_usage( config::system_account_name ) - ram_before
+                       << " bytes of eosio ram used by " << votes << " votes" );
+} FC_LOG_AND_RETHROW()
+
+BOOST_AUTO_TEST_CASE( bench_voter_rows_native ) try {
+   const uint32_t voter_count    = 1000000;
+   const uint64_t producer_count = 500;
+
+   // a synthetic voters table: half of the voters vote for 30 producers, the others for 1 to 29,
+   // all among the slots of 500 producers. Rows are counted as the contract serializes them.
+   const uint64_t fixed_bytes = 8 + 8 + 8 + 8 + 8 + 1 + 4 + 4 + 16; // all voter_info fields but the producers
+   const uint64_t row_overhead = config::billable_size_v<key_value_object>;
+
+   std::mt19937_64 rng( 7 );
+   std::vector<std::vector<uint64_t>> samples;
+   uint64_t legacy_bytes = 0, compact_bytes = 0, producers = 0;
+   for( uint32_t i = 0; i < voter_count; ++i ) {
+      const size_t n = i % 2 ? 30 : 1 + rng() % 29;
+      std::set<uint64_t> ids;
+      while( ids.size() < n ) {
+         ids.insert( rng() % producer_count );
+      }
+      std::vector<uint64_t> voted( ids.begin(), ids.end() );
+      legacy_bytes  += fixed_bytes + fc::raw::pack_size( voted ); // a name packs like its uint64_t
+      compact_bytes += fixed_bytes + 1 /* empty producers */ + fc::raw::pack_size( eosiosystem::slots::encode( voted ) );
+      producers     += n;
+      if( samples.size() < 1000 ) {
+         samples.push_back( std::move(voted) );
+      }
+   }
+   // the compact rows also need the prodslots table, a row and an index entry per producer
+   const uint64_t slot_table_bytes = producer_count * ( 16 + row_overhead + config::billable_size_v<index64_object> );
+
+   auto mib = []( uint64_t bytes ) { return double(bytes) / (1024 * 1024); };
+   BOOST_TEST_MESSAGE( "voters table, " << voter_count << " voters, " << double(producers) / voter_count << " producers per voter:" );
+   BOOST_TEST_MESSAGE( "  producer names: " << double(legacy_bytes) / voter_count << " bytes per row, "
+                       << mib( legacy_bytes + voter_count * row_overhead ) << " MiB billed ram" );
+   BOOST_TEST_MESSAGE( "  producer slots: " << double(compact_bytes) / voter_count << " bytes per row, "
+                       << mib( compact_bytes + voter_count * row_overhead + slot_table_bytes ) << " MiB billed ram" );
+
+   // the cpu price of the encoding, paid on every vote, stake change and refresh of a compact row
+   volatile uint64_t sink = 0;
+   std::vector<std::vector<uint8_t>> encoded;
+   for( const auto& s : samples ) encoded.push_back( eosiosystem::slots::encode( s ) );
+   double encode_ns = native_ns_per_call( voter_count, [&]( uint32_t i ) {
+      sink += eosiosystem::slots::encode( samples[i % samples.size()] ).size();
+   });
+   double decode_ns = native_ns_per_call( voter_count, [&]( uint32_t i ) {
+      sink += eosiosystem::slots::decode( encoded[i % encoded.size()] ).size();
+   });
+   BOOST_TEST_MESSAGE( "  encode " << encode_ns << " ns, decode " << decode_ns << " ns per row (native, without slot lookups, "
+                       "bench_voter_stake_change measures them on chain)" );
+} FC_LOG_AND_RETHROW()
+
+BOOST_FIXTURE_TEST_CASE( bench_voter_stake_change, eosio_system_tester ) try {
+   const uint32_t changes = 50;
+
+   // bob votes through alice's proxy, every stake change of bob updates both vote weights and
+   // reads the 30 producers alice votes for
+   std::vector<account_name> producers;
+   for( uint32_t i = 0; i < 30; ++i ) {
+      producers.emplace_back( bench_account( "benchbp", i ) );
+   }
+   std::sort( producers.begin(), producers.end() );
+   setup_producer_accounts( producers );
+   for( const auto& p : producers ) {
+      BOOST_REQUIRE_EQUAL( success(), regproducer( p ) );
+   }
+   transfer( "eosio", "alice1111111", core_sym::from_string("10000.0000"), "eosio" );
+   transfer( "eosio", "bob111111111", core_sym::from_string("10000.0000"), "eosio" );
+   BOOST_REQUIRE_EQUAL( success(), stake( "alice1111111", core_sym::from_string("100.0000"), core_sym::from_string("100.0000") ) );
+   BOOST_REQUIRE_EQUAL( success(), push_action( N(alice1111111), N(regproxy), mvo()("proxy", "alice1111111")("isproxy", true) ) );
+   BOOST_REQUIRE_EQUAL( success(), vote( N(alice1111111), producers ) );
+   BOOST_REQUIRE_EQUAL( success(), stake( "bob111111111", core_sym::from_string("100.0000"), core_sym::from_string("100.0000") ) );
+   BOOST_REQUIRE_EQUAL( success(), vote( N(bob111111111), {}, N(alice1111111) ) );
+   produce_block();
+
+   auto measure = [&]( const std::string& what ) {
+      bench_result result;
+      for( uint32_t i = 0; i < changes; ++i ) {
+         result.add( base_tester::push_action( config::system_account_name, N(delegatebw), N(bob111111111), mvo()
+                                               ("from", "bob111111111")
+                                               ("receiver", "bob111111111")
+                                               ("stake_net_quantity", core_sym::from_string("10.0000"))
+                                               ("stake_cpu_quantity", core_sym::from_string("10.0000"))
+                                               ("transfer", 0 ) ) );
+         produce_block();
+      }
+      result.report( what );
+   };
+   measure( "delegatebw of a voter behind a proxy of 30 producer names" );
+
+   // compact rows trade cpu for ram: the producers of alice are decoded and their 30 slots looked up
+   BOOST_REQUIRE_EQUAL( success(), push_action( config::system_account_name, N(setcompact), mvo()("compact", true) ) );
+   BOOST_REQUIRE_EQUAL( success(), vote( N(alice1111111), producers ) );
+   BOOST_REQUIRE( get_voter_info( "alice1111111" )["producers"].get_array().empty() );
+   produce_block();
+   measure( "delegatebw of a voter behind a proxy of 30 producer slots" );
+} FC_LOG_AND_RETHROW()
+
+BOOST_FIXTURE_TEST_CASE( bench_refreshvotes, eosio_system_tester ) try {
+   const uint32_t voter_count = 400;
+
+   std::vector<account_name> producers;
+   for( uint32_t i = 0; i < 30; ++i ) {
+      producers.emplace_back( std::string("benchbp") + char('a' + i / 26) + char('a' + i % 26) );
+   }
+   std::sort( producers.begin(), producers.end() );
+   setup_producer_accounts( producers );
+   for( const auto& p : producers ) {
+      BOOST_REQUIRE_EQUAL( success(), regproducer( p ) );
+   }
+
+   // benchvtaaaaa, benchvtaaaab, ... each voting for all 30 producers
+   std::vector<account_name> voters;
+   for( uint32_t i = 0; i < voter_count; ++i ) {
+      voters.emplace_back( bench_account( "benchvt", i ) );
+   }
+   // batches walk the voters table in name order
+   std::sort( voters.begin(), voters.end() );
+   for( size_t i = 0; i < voters.size(); i += 50 ) {
+      setup_producer_accounts( std::vector<account_name>( voters.begin() + i, voters.begin() + std::min( i + 50, voters.size() ) ) );
+      produce_block();
+   }
+   for( const auto& v : voters ) {
+      transfer( config::system_account_name, v, core_sym::from_string("100.0000"), config::system_account_name );
+      BOOST_REQUIRE_EQUAL( success(), stake( v, core_sym::from_string("10.0000"), core_sym::from_string("10.0000") ) );
+      BOOST_REQUIRE_EQUAL( success(), vote( v, producers ) );
+   }
+   produce_block();
+
+   // every round starts in a new week so that every voter in the batch has a new weight
+   for( uint32_t batch : { 1u, 10u, 50u, 100u, 200u } ) {
+      produce_block( fc::days(7) );
+      produce_block();
+      bench_result result;
+      for( size_t i = 0; i + batch <= voters.size(); i += batch ) {
+         result.add( base_tester::push_action( config::system_account_name, N(refreshvotes), voters[0], mvo()
+                                               ("cursor", voters[i])
+                                               ("max_rows", batch) ) );
+         produce_block();
+      }
+      result.report( "refreshvotes of " + std::to_string( batch ) + " voters with 30 producers each" );
+      BOOST_TEST_MESSAGE( "  " << batch * 1000000.0 / ( double(result.billed_cpu) / result.count ) << " rows per billed cpu second" );
+   }
+
+   // the per voter alternative: every voter repeats its vote
+   produce_block( fc::days(7) );
+   produce_block();
+   bench_result result;
+   for( const auto& v : voters ) {
+      result.add( base_tester::push_action( config::system_account_name, N(voteproducer), v, mvo()
+                                            ("voter", v)
+                                            ("proxy", name(0))
+                                            ("producers", producers) ) );
+   }
+   result.report( "voteproducer repeating the vote of one voter with 30 producers" );
+} FC_LOG_AND_RETHROW()
+
+BOOST_FIXTURE_TEST_CASE( bench_delegatebatch, eosio_system_tester ) try {
+   const uint32_t receiver_count = 100;
+
+   cross_15_percent_threshold();
+
+   std::vector<account_name> producers;
+   for( uint32_t i = 0; i < 30; ++i ) {
+      producers.emplace_back( std::string("benchbp") + char('a' + i / 26) + char('a' + i % 26) );
+   }
+   std::sort( producers.begin(), producers.end() );
+   setup_producer_accounts( producers );
+   for( const auto& p : producers ) {
+      BOOST_REQUIRE_EQUAL( success(), regproducer( p ) );
+   }
+
+   // benchrcaaaaa, benchrcaaaab, ...
+   std::vector<account_name> receivers;
+   for( uint32_t i = 0; i < receiver_count; ++i ) {
+      receivers.emplace_back( bench_account( "benchrc", i ) );
+   }
+   for( size_t i = 0; i < receivers.size(); i += 50 ) {
+      setup_producer_accounts( std::vector<account_name>( receivers.begin() + i, receivers.begin() + std::min( i + 50, receivers.size() ) ) );
+      produce_block();
+   }
+
+   // the staker votes for all producers, so every change of its stake updates 30 tallies
+   transfer( config::system_account_name, "alice1111111", core_sym::from_string("1000000.0000"), config::system_account_name );
+   BOOST_REQUIRE_EQUAL( success(), stake( "alice1111111", core_sym::from_string("100000.0000"), core_sym::from_string("100000.0000") ) );
+   BOOST_REQUIRE_EQUAL( success(), vote( N(alice1111111), producers ) );
+   produce_block();
+
+   const asset quantity = core_sym::from_string("1.0000");
+   bench_result single;
+   for( const auto& r : receivers ) {
+      single.add( base_tester::push_action( config::system_account_name, N(delegatebw), N(alice1111111), mvo()
+                                            ("from",               "alice1111111")
+                                            ("receiver",           r)
+                                            ("stake_net_quantity", quantity)
+                                            ("stake_cpu_quantity", quantity)
+                                            ("transfer",           false) ) );
+      produce_block();
+   }
+   single.report( "delegatebw to one receiver" );
+
+   for( uint32_t batch : { 1u, 10u, 100u } ) {
+      for( auto action : { N(delegatebatch), N(undelbatch) } ) {
+         bench_result result;
+         for( size_t i = 0; i + batch <= receivers.size(); i += batch ) {
+            vector<std::tuple<account_name, asset, asset>> deltas;
+            for( size_t j = i; j < i + batch; ++j ) {
+               deltas.emplace_back( receivers[j], quantity, quantity );
+            }
+            result.add( base_tester::push_action( config::system_account_name, action, N(alice1111111), mvo()
+                                                  ("from",      "alice1111111")
+                                                  ("receivers", bandwidth_deltas( deltas )) ) );
+            produce_block();
+         }
+         result.report( action.to_string() + " of " + std::to_string( batch ) + " receivers" );
+         BOOST_TEST_MESSAGE( "  " << double(result.billed_cpu) / result.count / batch << " us billed cpu per receiver" );
+      }
+   }
+} FC_LOG_AND_RETHROW()
+
+BOOST_FIXTURE_TEST_CASE( bench_onboarding, eosio_system_tester ) try {
+   const uint32_t account_count = 500, batch = 100;
+
+   // benchonaaaaa, benchonaaaab, ... are onboarded one action at a time, benchobaaaaa, ... in batches
+   auto make_accounts = [&]( const std::string& prefix ) {
+      std::vector<account_name> accounts;
+      for( uint32_t i = 0; i < account_count; ++i ) {
+         accounts.emplace_back( bench_account( prefix, i ) );
+      }
+      for( size_t i = 0; i < accounts.size(); i += 50 ) {
+         setup_producer_accounts( std::vector<account_name>( accounts.begin() + i, accounts.begin() + std::min( i + 50, accounts.size() ) ) );
+         produce_block();
+      }
+      return accounts;
+   };
+   const auto single = make_accounts( "benchon" ), batched = make_accounts( "benchob" );
+
+   const std::vector<std::tuple<action_name, action_name, std::string, int64_t>> resources = {
+      { N(setacctram), N(batchacctram), "ram_bytes",  1000000 },
+      { N(setacctnet), N(batchacctnet), "net_weight", 50000 },
+      { N(setacctcpu), N(batchacctcpu), "cpu_weight", 50000 }
+   };
+
+   bench_result one;
+   for( const auto& a : single ) {
+      for( const auto& [act, batch_act, field, value] : resources ) {
+         one.add( base_tester::push_action( config::system_account_name, act, config::system_account_name, mvo()
+                                            ("account", a)
+                                            (field, value) ) );
+      }
+      produce_block();
+   }
+   one.report( "setacctram/net/cpu of one account" );
+
+   bench_result many;
+   for( const auto& [act, batch_act, field, value] : resources ) {
+      for( size_t i = 0; i < batched.size(); i += batch ) {
+         fc::variants accounts;
+         for( size_t j = i; j < std::min<size_t>( i + batch, batched.size() ); ++j ) {
+            accounts.push_back( mvo()("account", batched[j])("value", value) );
+         }
+         many.add( base_tester::push_action( config::system_account_name, batch_act, config::system_account_name, mvo()
+                                             ("accounts", accounts) ) );
+         produce_block();
+      }
+   }
+   many.report( "batchacctram/net/cpu of " + std::to_string( batch ) + " accounts" );
+
+   BOOST_TEST_MESSAGE( "onboarding " << account_count << " accounts: "
+                       << one.billed_cpu << " us billed cpu one action at a time, "
+                       << many.billed_cpu << " us billed cpu in batches" );
+} FC_LOG_AND_RETHROW()
+
+BOOST_FIXTURE_TEST_CASE( bench_buyrambatch, eosio_system_tester ) try {
+   const uint32_t receiver_count = 200, bytes = 4096;
+
+   // benchrbaaaaa, benchrbaaaab, ...
+   std::vector<account_name> receivers;
+   for( uint32_t i = 0; i < receiver_count; ++i ) {
+      receivers.emplace_back( bench_account( "benchrb", i ) );
+   }
+   for( size_t i = 0; i < receivers.size(); i += 50 ) {
+      setup_producer_accounts( std::vector<account_name>( receivers.begin() + i, receivers.begin() + std::min( i + 50, receivers.size() ) ) );
+      produce_block();
+   }
+   transfer( "eosio", "alice1111111", core_sym::from_string("1000000.0000"), "eosio" );
+
+   bench_result single;
+   for( const auto& r : receivers ) {
+      single.add( base_tester::push_action( config::system_account_name, N(buyrambytes), N(alice1111111), mvo()
+                                            ("payer", "alice1111111")
+                                            ("receiver", r)
+                                            ("bytes", bytes) ) );
+      produce_block();
+   }
+   single.report( "buyrambytes for one receiver" );
+
+   for( uint32_t batch : { 1u, 10u, 50u, 200u } ) {
+      bench_result result;
+      for( size_t i = 0; i < receivers.size(); i += batch ) {
+         fc::variants purchases;
+         for( size_t j = i; j < std::min<size_t>( i + batch, receivers.size() ); ++j ) {
+            purchases.push_back( mvo()("receiver", receivers[j])("bytes", bytes) );
+         }
+         result.add( base_tester::push_action( config::system_account_name, N(buyrambatch), N(alice1111111), mvo()
+                                               ("payer", "alice1111111")
+                                               ("purchases", purchases) ) );
+         produce_block();
+      }
+      result.report( "buyrambatch of " + std::to_string( batch ) + " receivers" );
+      BOOST_TEST_MESSAGE( "  " << double(result.billed_cpu) / receiver_count << " us billed cpu per receiver, "
+                          << receiver_count * 1000000.0 / result.billed_cpu << " receivers per billed cpu second" );
+   }
+} FC_LOG_AND_RETHROW()
+
+BOOST_FIXTURE_TEST_CASE( bench_newacctres, eosio_system_tester ) try {
+   const uint32_t account_count = 100, per_block = 10;
+   transfer( "eosio", "alice1111111", core_sym::from_string("1000000.0000"), "eosio" );
+
+   // benchnaaaaaa, ... with newaccount, buyrambytes and delegatebw, benchnbaaaaa, ... with newacctres
+   bench_result three, one;
+   for( uint32_t i = 0; i < account_count; ++i ) {
+      three.add( create_account_with_resources( bench_account( "benchna", i ), N(alice1111111) ) );
+      if( i % per_block == per_block - 1 ) produce_block();
+   }
+   for( uint32_t i = 0; i < account_count; ++i ) {
+      const auto a = bench_account( "benchnb", i );
+      one.add( base_tester::push_action( config::system_account_name, N(newacctres), N(alice1111111), mvo()
+                                         ("creator", "alice1111111")
+                                         ("newact", a)
+                                         ("owner", authority( get_public_key( a, "owner" ) ))
+                                         ("active", authority( get_public_key( a, "active" ) ))
+                                         ("ram_bytes", 8000)
+                                         ("stake_net_quantity", core_sym::from_string("10.0000"))
+                                         ("stake_cpu_quantity", core_sym::from_string("10.0000")) ) );
+      if( i % per_block == per_block - 1 ) produce_block();
+   }
+   three.report( "newaccount, buyrambytes and delegatebw" );
+   one.report( "newacctres" );
+
+   const auto max_block_cpu = control->get_global_properties().configuration.max_block_cpu_usage;
+   BOOST_TEST_MESSAGE( "accounts per block by billed cpu: " << max_block_cpu * three.count / three.billed_cpu
+                       << " with three actions, " << max_block_cpu * one.count / one.billed_cpu << " with newacctres" );
+} FC_LOG_AND_RETHROW()
+
+BOOST_FIXTURE_TEST_CASE( bench_claimrewards, eosio_system_tester ) try {
+   const uint32_t days = 10;
+   const asset large_asset = core_sym::from_string("80.0000");
+   create_account_with_resources( N(defproducera), config::system_account_name, core_sym::from_string("1.0000"), false, large_asset, large_asset );
+   create_account_with_resources( N(producvotera), config::system_account_name, core_sym::from_string("1.0000"), false, large_asset, large_asset );
+
+   BOOST_REQUIRE_EQUAL( success(), regproducer( N(defproducera) ) );
+   transfer( config::system_account_name, "producvotera", core_sym::from_string("400000000.0000"), config::system_account_name );
+   BOOST_REQUIRE_EQUAL( success(), stake( "producvotera", core_sym::from_string("100000000.0000"), core_sym::from_string("100000000.0000") ) );
+   BOOST_REQUIRE_EQUAL( success(), vote( N(producvotera), { N(defproducera) } ) );
+   produce_blocks( 50 );
+
+   // every claim fills the buckets and pays block and vote pay
+   bench_result claims;
+   for( uint32_t d = 0; d < days; ++d ) {
+      produce_block( fc::hours(24) );
+      produce_blocks( 10 );
+      claims.add( base_tester::push_action( config::system_account_name, N(claimrewards), N(defproducera), mvo()
+                                            ("owner", "defproducera") ) );
+   }
+   claims.report( "claimrewards" );
+
+   // the token side of the payout on its own: six transfers as separate actions and as one transfers
+   const std::vector<account_name> recipients = { N(eosio.bpay), N(eosio.vpay), N(eosio.saving), N(eosio.names), N(eosio.ramfee), N(alice1111111) };
+   const asset quantity = core_sym::from_string("1.0000");
+   bench_result separate, batched;
+   for( uint32_t i = 0; i < days; ++i ) {
+      signed_transaction trx;
+      fc::variants transfers;
+      for( const auto& r : recipients ) {
+         trx.actions.emplace_back( get_action( N(eosio.token), N(transfer),
+                                               vector<permission_level>{{config::system_account_name, config::active_name}},
+                                               mvo()("from", config::system_account_name)("to", r)("quantity", quantity)("memo", "") ) );
+         transfers.push_back( mvo()("from", config::system_account_name)("to", r)("quantity", quantity)("memo", "") );
+      }
+      set_transaction_headers( trx );
+      trx.sign( get_private_key( config::system_account_name, "active" ), control->get_chain_id() );
+      separate.add( push_transaction( trx ) );
+      batched.add( base_tester::push_action( N(eosio.token), N(transfers), config::system_account_name, mvo()
+                                             ("transfers", transfers) ) );
+      produce_block();
+   }
+   separate.report( "six eosio.token transfer actions" );
+   batched.report( "one eosio.token transfers of six" );
+} FC_LOG_AND_RETHROW()
+
+BOOST_AUTO_TEST_CASE( bench_update_elected_producers ) try {
+   const uint32_t updates = 20;
+
+   for( uint32_t count : { 1000u, 10000u } ) {
+      eosio_system_tester t;
+
+      // benchbpaaaaa, benchbpaaaab, ...
+      std::vector<account_name> producers;
+      for( uint32_t i = 0; i < count; ++i ) {
+         producers.emplace_back( bench_account( "benchbp", i ) );
+      }
+      for( size_t i = 0; i < producers.size(); i += 50 ) {
+         t.setup_producer_accounts( std::vector<account_name>( producers.begin() + i, producers.begin() + std::min( i + 50, producers.size() ) ) );
+         t.produce_block();
+      }
+      for( const auto& p : producers ) {
+         t.regproducer( p );
+      }
+
+      // two voters electing overlapping sets of 30
+      const std::vector<account_name> voters = { N(producvotera), N(producvoterb) };
+      t.setup_producer_accounts( voters );
+      for( const auto& v : voters ) {
+         t.transfer( config::system_account_name, v, core_sym::from_string("100000.0000"), config::system_account_name );
+         BOOST_REQUIRE_EQUAL( t.success(), t.stake( v, core_sym::from_string("10000.0000"), core_sym::from_string("10000.0000") ) );
+      }
+      std::vector<account_name> first( producers.begin(), producers.begin() + 30 );
+      std::vector<account_name> second( producers.begin() + 10, producers.begin() + 40 );
+      std::sort( first.begin(), first.end() );
+      std::sort( second.begin(), second.end() );
+      BOOST_REQUIRE_EQUAL( t.success(), t.vote( N(producvotera), first ) );
+      BOOST_REQUIRE_EQUAL( t.success(), t.vote( N(producvoterb), first ) );
+      t.produce_block( fc::minutes(2) );
+      t.produce_block();
+
+      uint64_t elapsed = 0, blocks = 0;
+      t.control->applied_transaction.connect([&]( const transaction_trace_ptr& trace ) {
+         if( !trace->action_traces.empty() && trace->action_traces[0].act.name == N(onblock) ) {
+            ++blocks;
+            elapsed += trace->elapsed.count();
+         }
+      });
+      auto measure = [&]( const std::string& what, bool change_votes ) {
+         elapsed = blocks = 0;
+         for( uint32_t i = 0; i < updates; ++i ) {
+            if( change_votes ) {
+               BOOST_REQUIRE_EQUAL( t.success(), t.vote( N(producvoterb), i % 2 ? first : second ) );
+            }
+            t.produce_block( fc::minutes(2) ); // every block after the skip updates the schedule
+         }
+         BOOST_TEST_MESSAGE( "update_elected_producers, " << count << " producers, " << what << ": "
+                             << double(elapsed) / blocks << " us elapsed per onblock" );
+      };
+      measure( "unchanged", false );
+      measure( "changed", true );
+   }
+} FC_LOG_AND_RETHROW()
+
+/**
+ *  Voting with a production sized population: many producers, a voters table that doubles from
+ *  stage to stage and one proxy every fourth voter votes through. At each stage it measures
+ *  update_votes for new and changed votes, propagate_weight_change through the proxy, a vote of
+ *  the proxy with all its proxied weight and update_elected_producers in onblock, and reports
+ *  them as json to track across versions. The defaults run in minutes; the full size is e.g.
+ *
+ *     BENCH_VOTING_PRODUCERS=10000 BENCH_VOTING_VOTERS=1000000 BENCH_VOTING_STAGES=8 \
+ *     BENCH_VOTING_JSON=voting.json unit_test --run_test=eosio_system_bench_tests/bench_voting_scale
+ *
+ *  BENCH_VOTING_COMPACT=1 stores the producers of the voters as producer slots (setcompact).
+ */
+BOOST_FIXTURE_TEST_CASE( bench_voting_scale, eosio_system_tester ) try {
+   const uint32_t producer_count = std::max( 30u, bench_env( "BENCH_VOTING_PRODUCERS", 1000 ) );
+   const uint32_t voter_count    = bench_env( "BENCH_VOTING_VOTERS", 4000 );
+   // the first stage has voter_count >> (stages - 1) voters, a shift of 32 or more is undefined
+   const uint32_t stages         = std::min( 32u, std::max( 1u, bench_env( "BENCH_VOTING_STAGES", 4 ) ) );
+   const bool     compact        = bench_env( "BENCH_VOTING_COMPACT", 0 ) != 0;
+   const uint32_t samples        = 20;
+   const uint32_t proxied_every  = 4;
+
+   const auto& rlm = control->get_resource_limits_manager();
+   std::mt19937 rng( 7 );
+
+   // benchbpaaaaa, benchbpbaaaa, ...
+   std::vector<account_name> producers;
+   for( uint32_t i = 0; i < producer_count; ++i ) {
+      producers.emplace_back( bench_account( "benchbp", i ) );
+   }
+   for( size_t i = 0; i < producers.size(); i += 50 ) {
+      setup_producer_accounts( std::vector<account_name>( producers.begin() + i, producers.begin() + std::min( i + 50, producers.size() ) ) );
+      for( size_t j = i; j < std::min( i + 50, producers.size() ); ++j ) {
+         regproducer( producers[j] );
+      }
+      produce_block();
+   }
+   // 30 random producers, a new schedule every now and then
+   auto pick_producers = [&]() {
+      std::set<account_name> picked;
+      while( picked.size() < 30 ) {
+         picked.insert( producers[rng() % producers.size()] );
+      }
+      return std::vector<account_name>( picked.begin(), picked.end() );
+   };
+
+   if( compact ) {
+      BOOST_REQUIRE_EQUAL( success(), push_action( config::system_account_name, N(setcompact), mvo()("compact", true) ) );
+   }
+
+   const account_name proxy = N(benchproxyaa);
+   setup_producer_accounts( { proxy } );
+   transfer( config::system_account_name, proxy, core_sym::from_string("1000.0000"), config::system_account_name );
+   BOOST_REQUIRE_EQUAL( success(), stake( proxy, core_sym::from_string("100.0000"), core_sym::from_string("100.0000") ) );
+   BOOST_REQUIRE_EQUAL( success(), push_action( proxy, N(regproxy), mvo()("proxy", proxy)("isproxy", true) ) );
+   BOOST_REQUIRE_EQUAL( success(), vote( proxy, pick_producers() ) );
+   produce_block();
+
+   // billed cpu and elapsed of the action, ram as the change of the usage of eosio and the actor
+   auto measure = [&]( bench_result& result, const account_name& actor, const action_name& act, const mvo& data ) {
+      const int64_t ram_before = rlm.get_account_ram_usage( config::system_account_name ) + rlm.get_account_ram_usage( actor );
+      result.add( base_tester::push_action( config::system_account_name, act, actor, data ) );
+      result.ram += rlm.get_account_ram_usage( config::system_account_name ) + rlm.get_account_ram_usage( actor ) - ram_before;
+   };
+   auto vote_data = [&]( const account_name& voter, const account_name& via, const std::vector<account_name>& vote_for ) {
+      return mvo()("voter", voter)("proxy", via)("producers", vote_for);
+   };
+
+   // disconnected when the test ends, the tester outlives the locals the handler refers to
+   bool in_onblock_measure = false;
+   bench_result onblock;
+   boost::signals2::scoped_connection onblock_connection( control->applied_transaction.connect([&]( const transaction_trace_ptr& trace ) {
+      if( in_onblock_measure && !trace->action_traces.empty() && trace->action_traces[0].act.name == N(onblock) ) {
+         ++onblock.count;
+         onblock.elapsed += trace->elapsed.count();
+      }
+   }) );
+   // onblock only has a wall clock time, none if no schedule update was seen
+   auto onblock_elapsed = [&]() {
+      return onblock.count > 0 ? double(onblock.elapsed) / onblock.count : 0.0;
+   };
+
+   std::vector<account_name> direct, proxied;
+   fc::variants stage_reports;
+   uint32_t created = 0;
+   for( uint32_t stage = 1; stage <= stages; ++stage ) {
+      const uint32_t target = std::max( created, voter_count >> (stages - stage) );
+
+      // grow the voters table, every new voter votes once
+      bench_result new_votes, new_proxied;
+      for( ; created < target; ) {
+         std::vector<account_name> chunk;
+         for( ; created < target && chunk.size() < 50; ++created ) {
+            chunk.emplace_back( bench_account( "benchvt", created ) );
+         }
+         setup_producer_accounts( chunk );
+         produce_block();
+         for( const auto& v : chunk ) {
+            transfer( config::system_account_name, v, core_sym::from_string("30.0000"), config::system_account_name );
+            BOOST_REQUIRE_EQUAL( success(), stake( v, core_sym::from_string("10.0000"), core_sym::from_string("10.0000") ) );
+            if( (direct.size() + proxied.size()) % proxied_every == 0 ) {
+               measure( new_proxied, v, N(voteproducer), vote_data( v, proxy, {} ) );
+               proxied.push_back( v );
+            } else {
+               measure( new_votes, v, N(voteproducer), vote_data( v, name(0), pick_producers() ) );
+               direct.push_back( v );
+            }
+         }
+         produce_block();
+      }
+
+      // the same actions against the grown tables
+      bench_result changed_votes, to_proxy, proxied_stake, proxy_votes;
+      for( uint32_t i = 0; i < samples && !direct.empty(); ++i ) {
+         const account_name v = direct[rng() % direct.size()];
+         measure( changed_votes, v, N(voteproducer), vote_data( v, name(0), pick_producers() ) );
+      }
+      for( uint32_t i = 0; i < samples && !proxied.empty(); ++i ) {
+         const auto& v = proxied[rng() % proxied.size()];
+         measure( proxied_stake, v, N(delegatebw), mvo()
+                  ("from", v)("receiver", v)
+                  ("stake_net_quantity", core_sym::from_string("0.0100"))
+                  ("stake_cpu_quantity", core_sym::from_string("0.0000"))
+                  ("transfer", false) );
+      }
+      produce_block();
+      for( uint32_t i = 0; i < samples; ++i ) {
+         measure( proxy_votes, proxy, N(voteproducer), vote_data( proxy, name(0), pick_producers() ) );
+         produce_block();
+      }
+      for( uint32_t i = 0; i < samples && direct.size() > 1; ++i ) {
+         const size_t k = rng() % direct.size();
+         const account_name v = direct[k];
+         measure( to_proxy, v, N(voteproducer), vote_data( v, proxy, {} ) );
+         direct.erase( direct.begin() + k );
+         proxied.push_back( v );
+      }
+
+      // onblock right after the votes moved the schedule
+      onblock = bench_result();
+      in_onblock_measure = true;
+      for( uint32_t i = 0; i < samples; ++i ) {
+         BOOST_REQUIRE_EQUAL( success(), vote( proxy, pick_producers() ) );
+         produce_block( fc::minutes(2) );
+      }
+      in_onblock_measure = false;
+      produce_block();
+
+      const std::string size = std::to_string( created ) + " voters";
+      new_votes.report( "voteproducer of a new voter for 30 producers, " + size );
+      new_proxied.report( "voteproducer of a new voter through the proxy, " + size );
+      changed_votes.report( "voteproducer changing 30 producers, " + size );
+      to_proxy.report( "voteproducer switching to the proxy, " + size );
+      proxied_stake.report( "delegatebw of a proxied voter, " + size );
+      proxy_votes.report( "voteproducer of the proxy for " + std::to_string( proxied.size() ) + " voters, " + size );
+      BOOST_TEST_MESSAGE( "onblock updating the schedule, " << size << ": " << onblock_elapsed() << " us elapsed" );
+
+      stage_reports.emplace_back( mvo()
+         ("voters",          created)
+         ("direct_voters",   direct.size())
+         ("proxied_voters",  proxied.size())
+         ("eosio_ram_bytes", rlm.get_account_ram_usage( config::system_account_name ))
+         ("actions", mvo()
+            ("voteproducer_new",         new_votes.averages())
+            ("voteproducer_new_proxied", new_proxied.averages())
+            ("voteproducer_change",      changed_votes.averages())
+            ("voteproducer_to_proxy",    to_proxy.averages())
+            ("delegatebw_proxied",       proxied_stake.averages())
+            ("voteproducer_proxy",       proxy_votes.averages())
+            ("onblock_schedule",         onblock.count == 0 ? mvo()("count", 0)
+                                                            : mvo()("count", onblock.count)
+                                                                   ("elapsed_us", onblock_elapsed())))
+      );
+   }
+
+   const std::string json = fc::json::to_pretty_string( mvo()
+      ("benchmark",     "voting_scale")
+      ("producers",     producer_count)
+      ("voters",        created)
+      ("proxied_every", proxied_every)
+      ("compact_votes", compact)
+      ("stages",        stage_reports) );
+   BOOST_TEST_MESSAGE( json );
+   if( const char* path = std::getenv( "BENCH_VOTING_JSON" ) ) {
+      std::ofstream( path ) << json << std::endl;
+   }
+} FC_LOG_AND_RETHROW()
+
+BOOST_AUTO_TEST_SUITE_END()
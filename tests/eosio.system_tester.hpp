@@ -6,8 +6,10 @@
 
 #include <eosio/testing/tester.hpp>
 #include <eosio/chain/abi_serializer.hpp>
+#include <eosio/chain/resource_limits_private.hpp>
 #include "contracts.hpp"
 #include "test_symbol.hpp"
+#include <eosio.system/vote_weight.hpp>
 
 #include <fc/variant_object.hpp>
 #include <fstream>
@@ -256,6 +258,30 @@ public:
       return push_action( payer, N(buyrambytes), mvo()( "payer",payer)("receiver",receiver)("bytes",numbytes) );
    }
 
+   static vector<mvo> ram_purchases( const vector<std::pair<account_name, uint32_t>>& purchases ) {
+      vector<mvo> result;
+      for( const auto& p : purchases ) {
+         result.push_back( mvo()("receiver", p.first)("bytes", p.second) );
+      }
+      return result;
+   }
+
+   action_result buyrambatch( const account_name& payer, const vector<std::pair<account_name, uint32_t>>& purchases ) {
+      return push_action( payer, N(buyrambatch), mvo()("payer", payer)("purchases", ram_purchases( purchases )) );
+   }
+
+   action_result newacctres( const account_name& creator, const account_name& newact, uint32_t ram_bytes,
+                             const asset& net, const asset& cpu ) {
+      return push_action( creator, N(newacctres), mvo()
+                          ("creator", creator)
+                          ("newact", newact)
+                          ("owner", authority( get_public_key( newact, "owner" ) ))
+                          ("active", authority( get_public_key( newact, "active" ) ))
+                          ("ram_bytes", ram_bytes)
+                          ("stake_net_quantity", net)
+                          ("stake_cpu_quantity", cpu) );
+   }
+
    action_result sellram( const account_name& account, uint64_t numbytes ) {
       return push_action( account, N(sellram), mvo()( "account", account)("bytes",numbytes) );
    }
@@ -312,6 +338,32 @@ public:
       return unstake( acnt, acnt, net, cpu );
    }
 
+   /// receivers of delegatebatch and undelbatch with their net and cpu quantities
+   static fc::variants bandwidth_deltas( const vector<std::tuple<account_name, asset, asset>>& receivers ) {
+      fc::variants deltas;
+      for( const auto& r : receivers ) {
+         deltas.push_back( mvo()
+                           ("receiver",     std::get<0>(r))
+                           ("net_quantity", std::get<1>(r))
+                           ("cpu_quantity", std::get<2>(r)) );
+      }
+      return deltas;
+   }
+
+   action_result delegatebatch( const account_name& from, const vector<std::tuple<account_name, asset, asset>>& receivers ) {
+      return push_action( name(from), N(delegatebatch), mvo()
+                          ("from",      from)
+                          ("receivers", bandwidth_deltas( receivers ))
+      );
+   }
+
+   action_result undelbatch( const account_name& from, const vector<std::tuple<account_name, asset, asset>>& receivers ) {
+      return push_action( name(from), N(undelbatch), mvo()
+                          ("from",      from)
+                          ("receivers", bandwidth_deltas( receivers ))
+      );
+   }
+
    action_result bidname( const account_name& bidder, const account_name& newname, const asset& bid ) {
       return push_action( name(bidder), N(bidname), mvo()
                           ("bidder",  bidder)
@@ -380,12 +432,47 @@ public:
       return data.empty() ? fc::variant() : abi_ser.binary_to_variant( "voter_info", data, abi_serializer_max_time );
    }
 
+   /// producer row as the contract sees it: vote tally fields come from prodtally and the blocks of the
+   /// current round not yet merged into the row are included
    fc::variant get_producer_info( const account_name& act ) {
       vector<char> data = get_row_by_account( config::system_account_name, config::system_account_name, N(producers), act );
-      return abi_ser.binary_to_variant( "producer_info", data, abi_serializer_max_time );
+      fc::mutable_variant_object prod( abi_ser.binary_to_variant( "producer_info", data, abi_serializer_max_time ) );
+      const auto tally = get_producer_tally( act );
+      if( tally.is_object() ) {
+         prod.set( "total_votes", fixed_votes( tally["total_votes"] ) );
+         prod.set( "is_active", tally["is_active"] );
+         prod.set( "last_claim_time", tally["last_claim_time"] );
+      }
+      const auto ghot = get_global_hot_state();
+      if( ghot.is_object() ) {
+         for( const auto& c : ghot["round_unpaid_blocks"].get_array() ) {
+            if( c["producer"].as<account_name>() == act ) {
+               prod.set( "unpaid_blocks", prod["unpaid_blocks"].as<uint32_t>() + c["blocks"].as<uint32_t>() );
+            }
+         }
+      }
+      return prod;
    }
 
+   /// vote weight stored in fixed point by prodtally, topprods, globalhot and voters
+   static double fixed_votes( const fc::variant& v ) {
+      return eosiosystem::votes::to_double( v.as<eosiosystem::votes::fixed>() );
+   }
+
+   fc::variant get_producer_tally( const account_name& act ) {
+      vector<char> data = get_row_by_account( config::system_account_name, config::system_account_name, N(prodtally), act );
+      return data.empty() ? fc::variant() : abi_ser.binary_to_variant( "producer_tally", data, abi_serializer_max_time );
+   }
+
+   /// vote pay accounting of a producer, kept in prodtally once the producer has a tally
    fc::variant get_producer_info2( const account_name& act ) {
+      const auto tally = get_producer_tally( act );
+      if( tally.is_object() ) {
+         return mvo()
+            ("owner", tally["owner"])
+            ("votepay_share", tally["votepay_share"])
+            ("last_votepay_share_update", tally["last_votepay_share_update"]);
+      }
       vector<char> data = get_row_by_account( config::system_account_name, config::system_account_name, N(producers2), act );
       return abi_ser.binary_to_variant( "producer_info2", data, abi_serializer_max_time );
    }
@@ -438,10 +525,25 @@ public:
       return static_cast<uint64_t>( time_point::from_iso_string( v.as_string() ).time_since_epoch().count() );
    }
 
+   /// global state as the contract sees it: counters kept in the globalhot row override the stale copies in global
    fc::variant get_global_state() {
       vector<char> data = get_row_by_account( config::system_account_name, config::system_account_name, N(global), N(global) );
       if (data.empty()) std::cout << "\nData is empty\n" << std::endl;
-      return data.empty() ? fc::variant() : abi_ser.binary_to_variant( "eosio_global_state", data, abi_serializer_max_time );
+      if (data.empty()) return fc::variant();
+      fc::mutable_variant_object gstate( abi_ser.binary_to_variant( "eosio_global_state", data, abi_serializer_max_time ) );
+      const auto ghot = get_global_hot_state();
+      if( ghot.is_object() ) {
+         for( const auto& field : ghot.get_object() ) {
+            gstate.set( field.key(), field.value() );
+         }
+         gstate.set( "total_producer_vote_weight", fixed_votes( ghot["total_producer_vote_weight"] ) );
+      }
+      return gstate;
+   }
+
+   fc::variant get_global_hot_state() {
+      vector<char> data = get_row_by_account( config::system_account_name, config::system_account_name, N(globalhot), N(globalhot) );
+      return data.empty() ? fc::variant() : abi_ser.binary_to_variant( "eosio_global_hot_state", data, abi_serializer_max_time );
    }
 
    fc::variant get_global_state2() {
@@ -449,16 +551,37 @@ public:
       return data.empty() ? fc::variant() : abi_ser.binary_to_variant( "eosio_global_state2", data, abi_serializer_max_time );
    }
 
+   fc::variant get_top_producers() {
+      vector<char> data = get_row_by_account( config::system_account_name, config::system_account_name, N(topprods), N(topprods) );
+      return data.empty() ? fc::variant() : abi_ser.binary_to_variant( "top_producers_state", data, abi_serializer_max_time );
+   }
+
    fc::variant get_global_state3() {
       vector<char> data = get_row_by_account( config::system_account_name, config::system_account_name, N(global3), N(global3) );
       return data.empty() ? fc::variant() : abi_ser.binary_to_variant( "eosio_global_state3", data, abi_serializer_max_time );
    }
 
    fc::variant get_refund_request( name account ) {
-      vector<char> data = get_row_by_account( config::system_account_name, account, N(refunds), account );
+      vector<char> data = get_row_by_account( config::system_account_name, config::system_account_name, N(refundqueue), account );
       return data.empty() ? fc::variant() : abi_ser.binary_to_variant( "refund_request", data, abi_serializer_max_time );
    }
 
+   /// accounts whose resource limits were set by the transactions of the pending block
+   vector<account_name> limits_set_in_pending_block() {
+      using namespace eosio::chain::resource_limits;
+      vector<account_name> accounts;
+      const auto& idx = control->db().get_index<resource_limits_index, by_owner>();
+      for( auto itr = idx.lower_bound( boost::make_tuple( true ) ); itr != idx.end() && itr->pending; ++itr ) {
+         accounts.push_back( itr->owner );
+      }
+      return accounts;
+   }
+
+   /// pays out the matured refunds, which are no longer sent by deferred transactions
+   action_result procrefunds( uint32_t max = 100, const name& cursor = name() ) {
+      return push_action( config::system_account_name, N(procrefunds), mvo()("cursor", cursor)("max", max) );
+   }
+
    abi_serializer initialize_multisig() {
       abi_serializer msig_abi_ser;
       {
@@ -9,6 +9,14 @@
 #include <fc/log/logger.hpp>
 #include <eosio/chain/exceptions.hpp>
 #include <Runtime/Runtime.h>
+#include <eosio.system/bancor.hpp>
+#include <eosio.system/vote_weight.hpp>
+#include <eosio.system/producer_slots.hpp>
+#include <eosio.system/producer_pay_math.hpp>
+#include <cmath>
+#include <numeric>
+#include <random>
+#include <set>
 
 
 #include "eosio.system_tester.hpp"
@@ -36,8 +44,15 @@ BOOST_FIXTURE_TEST_CASE( buysell, eosio_system_tester ) try {
    const asset initial_ramfee_balance = get_balance(N(eosio.ramfee));
    BOOST_REQUIRE_EQUAL( success(), buyram( "alice1111111", "alice1111111", core_sym::from_string("200.0000") ) );
    BOOST_REQUIRE_EQUAL( core_sym::from_string("800.0000"), get_balance( "alice1111111" ) );
+   // the fee is held by eosio.ram until it is swept
+   BOOST_REQUIRE_EQUAL( initial_ram_balance + core_sym::from_string("200.0000"), get_balance(N(eosio.ram)) );
+   BOOST_REQUIRE_EQUAL( initial_ramfee_balance, get_balance(N(eosio.ramfee)) );
+   BOOST_REQUIRE_EQUAL( 10000, get_global_state()["ram_fee"].as_int64() );
+   BOOST_REQUIRE_EQUAL( success(), push_action( N(bob111111111), N(sweepramfee), mvo() ) );
    BOOST_REQUIRE_EQUAL( initial_ram_balance + core_sym::from_string("199.0000"), get_balance(N(eosio.ram)) );
    BOOST_REQUIRE_EQUAL( initial_ramfee_balance + core_sym::from_string("1.0000"), get_balance(N(eosio.ramfee)) );
+   BOOST_REQUIRE_EQUAL( 0, get_global_state()["ram_fee"].as_int64() );
+   BOOST_REQUIRE_EQUAL( wasm_assert_msg("no ram fee to sweep"), push_action( N(bob111111111), N(sweepramfee), mvo() ) );
 
    total = get_total_stake( "alice1111111" );
    auto bytes = total["ram_bytes"].as_uint64();
@@ -147,11 +162,13 @@ BOOST_FIXTURE_TEST_CASE( stake_unstake, eosio_system_tester ) try {
 
    produce_block( fc::hours(3*24-1) );
    produce_blocks(1);
+   BOOST_REQUIRE_EQUAL( wasm_assert_msg("no matured refunds"), procrefunds() );
    BOOST_REQUIRE_EQUAL( core_sym::from_string("700.0000"), get_balance( "alice1111111" ) );
    BOOST_REQUIRE_EQUAL( init_eosio_stake_balance + core_sym::from_string("300.0000"), get_balance( N(eosio.stake) ) );
    //after 3 days funds should be released
    produce_block( fc::hours(1) );
    produce_blocks(1);
+   BOOST_REQUIRE_EQUAL( success(), procrefunds() );
    BOOST_REQUIRE_EQUAL( core_sym::from_string("1000.0000"), get_balance( "alice1111111" ) );
    BOOST_REQUIRE_EQUAL( init_eosio_stake_balance, get_balance( N(eosio.stake) ) );
 
@@ -177,10 +194,12 @@ BOOST_FIXTURE_TEST_CASE( stake_unstake, eosio_system_tester ) try {
    BOOST_REQUIRE_EQUAL( core_sym::from_string("10.0000"), total["cpu_weight"].as<asset>());
    produce_block( fc::hours(3*24-1) );
    produce_blocks(1);
+   BOOST_REQUIRE_EQUAL( wasm_assert_msg("no matured refunds"), procrefunds() );
    BOOST_REQUIRE_EQUAL( core_sym::from_string("700.0000"), get_balance( "alice1111111" ) );
    //after 3 days funds should be released
    produce_block( fc::hours(1) );
    produce_blocks(1);
+   BOOST_REQUIRE_EQUAL( success(), procrefunds() );
 
    REQUIRE_MATCHING_OBJECT( voter( "alice1111111", core_sym::from_string("0.0000") ), get_voter_info( "alice1111111" ) );
    produce_blocks(1);
@@ -223,11 +242,13 @@ BOOST_FIXTURE_TEST_CASE( stake_unstake_with_transfer, eosio_system_tester ) try
 
    produce_block( fc::hours(3*24-1) );
    produce_blocks(1);
+   BOOST_REQUIRE_EQUAL( wasm_assert_msg("no matured refunds"), procrefunds() );
    BOOST_REQUIRE_EQUAL( core_sym::from_string("700.0000"), get_balance( "alice1111111" ) );
    //after 3 days funds should be released
 
    produce_block( fc::hours(1) );
    produce_blocks(1);
+   BOOST_REQUIRE_EQUAL( success(), procrefunds() );
 
    BOOST_REQUIRE_EQUAL( core_sym::from_string("1300.0000"), get_balance( "alice1111111" ) );
 
@@ -290,11 +311,13 @@ BOOST_FIXTURE_TEST_CASE( stake_while_pending_refund, eosio_system_tester ) try {
 
    produce_block( fc::hours(3*24-1) );
    produce_blocks(1);
+   BOOST_REQUIRE_EQUAL( wasm_assert_msg("no matured refunds"), procrefunds() );
    BOOST_REQUIRE_EQUAL( core_sym::from_string("700.0000"), get_balance( "alice1111111" ) );
    //after 3 days funds should be released
 
    produce_block( fc::hours(1) );
    produce_blocks(1);
+   BOOST_REQUIRE_EQUAL( success(), procrefunds() );
 
    BOOST_REQUIRE_EQUAL( core_sym::from_string("1300.0000"), get_balance( "alice1111111" ) );
 
@@ -651,6 +674,93 @@ BOOST_FIXTURE_TEST_CASE( stake_from_refund, eosio_system_tester ) try {
 
 } FC_LOG_AND_RETHROW()
 
+BOOST_FIXTURE_TEST_CASE( refund_queue, eosio_system_tester ) try {
+   cross_15_percent_threshold();
+
+   for( const auto& a : { "alice1111111", "bob111111111", "carol1111111" } ) {
+      transfer( "eosio", a, core_sym::from_string("1000.0000"), "eosio" );
+      BOOST_REQUIRE_EQUAL( success(), stake( a, a, core_sym::from_string("100.0000"), core_sym::from_string("50.0000") ) );
+   }
+
+   BOOST_REQUIRE_EQUAL( success(), unstake( "alice1111111", "alice1111111", core_sym::from_string("100.0000"), core_sym::from_string("50.0000") ) );
+   produce_block( fc::hours(12) );
+   BOOST_REQUIRE_EQUAL( success(), unstake( "bob111111111", "bob111111111", core_sym::from_string("100.0000"), core_sym::from_string("50.0000") ) );
+   BOOST_REQUIRE_EQUAL( success(), unstake( "carol1111111", "carol1111111", core_sym::from_string("50.0000"), core_sym::from_string("25.0000") ) );
+
+   BOOST_REQUIRE_EQUAL( wasm_assert_msg("max must be positive"), procrefunds( 0 ) );
+   BOOST_REQUIRE_EQUAL( wasm_assert_msg("no matured refunds"), procrefunds() );
+   BOOST_REQUIRE_EQUAL( wasm_assert_msg("refund is not available yet"),
+                        push_action( N(carol1111111), N(refund), mvo()("owner", "carol1111111") ) );
+
+   // only the refund of alice has matured
+   produce_block( fc::hours(3*24-6) );
+   BOOST_REQUIRE_EQUAL( success(), procrefunds() );
+   BOOST_REQUIRE_EQUAL( core_sym::from_string("1000.0000"), get_balance( "alice1111111" ) );
+   BOOST_REQUIRE( get_refund_request( "alice1111111" ).is_null() );
+   BOOST_REQUIRE_EQUAL( core_sym::from_string("850.0000"), get_balance( "bob111111111" ) );
+   BOOST_REQUIRE_EQUAL( wasm_assert_msg("no matured refunds"), procrefunds() );
+
+   // at most max refunds are paid per call, oldest first
+   produce_block( fc::hours(12) );
+   BOOST_REQUIRE_EQUAL( success(), procrefunds( 1 ) );
+   BOOST_REQUIRE_EQUAL( core_sym::from_string("1000.0000"), get_balance( "bob111111111" ) );
+   BOOST_REQUIRE_EQUAL( core_sym::from_string("850.0000"), get_balance( "carol1111111" ) );
+   BOOST_REQUIRE_EQUAL( core_sym::from_string("75.0000"), get_refund_request( "carol1111111" )["net_amount"].as<asset>()
+                                                          + get_refund_request( "carol1111111" )["cpu_amount"].as<asset>() );
+
+   // owners can still claim their own refund
+   BOOST_REQUIRE_EQUAL( success(), push_action( N(carol1111111), N(refund), mvo()("owner", "carol1111111") ) );
+   BOOST_REQUIRE_EQUAL( core_sym::from_string("925.0000"), get_balance( "carol1111111" ) );
+   BOOST_REQUIRE_EQUAL( wasm_assert_msg("refund request not found"),
+                        push_action( N(carol1111111), N(refund), mvo()("owner", "carol1111111") ) );
+   BOOST_REQUIRE_EQUAL( wasm_assert_msg("no matured refunds"), procrefunds() );
+} FC_LOG_AND_RETHROW()
+
+static const char reject_transfers_wast[] = R"=====(
+(module
+ (import "env" "eosio_assert" (func $eosio_assert (param i32 i32)))
+ (memory $0 1)
+ (export "memory" (memory $0))
+ (data (i32.const 16) "transfer rejected\00")
+ (export "apply" (func $apply))
+ (func $apply (param $receiver i64) (param $code i64) (param $action i64)
+  (call $eosio_assert (i32.const 0) (i32.const 16))
+ )
+)
+)=====";
+
+BOOST_FIXTURE_TEST_CASE( refund_queue_rejected_transfer, eosio_system_tester ) try {
+   cross_15_percent_threshold();
+
+   create_account_with_resources( N(rejecter1111), config::system_account_name, 100000 );
+   for( const auto& a : { "rejecter1111", "alice1111111", "bob111111111" } ) {
+      transfer( "eosio", a, core_sym::from_string("1000.0000"), "eosio" );
+      BOOST_REQUIRE_EQUAL( success(), stake( a, a, core_sym::from_string("100.0000"), core_sym::from_string("50.0000") ) );
+   }
+
+   // the oldest refund belongs to an account whose code rejects every transfer notification
+   BOOST_REQUIRE_EQUAL( success(), unstake( "rejecter1111", "rejecter1111", core_sym::from_string("0.0001"), core_sym::from_string("0.0000") ) );
+   produce_block( fc::hours(1) );
+   BOOST_REQUIRE_EQUAL( success(), unstake( "alice1111111", "alice1111111", core_sym::from_string("100.0000"), core_sym::from_string("50.0000") ) );
+   BOOST_REQUIRE_EQUAL( success(), unstake( "bob111111111", "bob111111111", core_sym::from_string("100.0000"), core_sym::from_string("50.0000") ) );
+   set_code( N(rejecter1111), reject_transfers_wast );
+   produce_blocks();
+
+   produce_block( fc::hours(3*24) );
+   BOOST_REQUIRE_EQUAL( wasm_assert_msg("transfer rejected"), procrefunds() );
+   BOOST_REQUIRE_EQUAL( core_sym::from_string("850.0000"), get_balance( "alice1111111" ) );
+
+   // the cursor skips the refund that cannot be paid
+   BOOST_REQUIRE_EQUAL( wasm_assert_msg("refund request not found"), procrefunds( 100, N(carol1111111) ) );
+   BOOST_REQUIRE_EQUAL( success(), procrefunds( 100, N(alice1111111) ) );
+   BOOST_REQUIRE_EQUAL( core_sym::from_string("1000.0000"), get_balance( "alice1111111" ) );
+   BOOST_REQUIRE_EQUAL( core_sym::from_string("1000.0000"), get_balance( "bob111111111" ) );
+   BOOST_REQUIRE( get_refund_request( "alice1111111" ).is_null() );
+   BOOST_REQUIRE( get_refund_request( "bob111111111" ).is_null() );
+   BOOST_REQUIRE( !get_refund_request( "rejecter1111" ).is_null() );
+   BOOST_REQUIRE_EQUAL( wasm_assert_msg("transfer rejected"), procrefunds() );
+} FC_LOG_AND_RETHROW()
+
 BOOST_FIXTURE_TEST_CASE( stake_to_another_user_not_from_refund, eosio_system_tester ) try {
    cross_15_percent_threshold();
 
@@ -686,6 +796,169 @@ BOOST_FIXTURE_TEST_CASE( stake_to_another_user_not_from_refund, eosio_system_tes
 
 } FC_LOG_AND_RETHROW()
 
+BOOST_FIXTURE_TEST_CASE( stake_batch, eosio_system_tester ) try {
+   cross_15_percent_threshold();
+
+   issue( "alice1111111", core_sym::from_string("1000.0000"),  config::system_account_name );
+   BOOST_REQUIRE_EQUAL( success(), stake( "alice1111111", core_sym::from_string("100.0000"), core_sym::from_string("50.0000") ) );
+   BOOST_REQUIRE_EQUAL( success(), unstake( "alice1111111", core_sym::from_string("100.0000"), core_sym::from_string("50.0000") ) );
+   BOOST_REQUIRE_EQUAL( core_sym::from_string("850.0000"), get_balance( "alice1111111" ) );
+
+   BOOST_REQUIRE_EQUAL( wasm_assert_msg("no receivers to delegate to"), delegatebatch( "alice1111111", {} ) );
+   BOOST_REQUIRE_EQUAL( wasm_assert_msg("must stake a positive amount"),
+                        delegatebatch( "alice1111111", { std::make_tuple( N(bob111111111), core_sym::from_string("10.0000"), core_sym::from_string("10.0000") ),
+                                                         std::make_tuple( N(carol1111111), core_sym::from_string("-1.0000"), core_sym::from_string("10.0000") ) } ) );
+
+   // stake to self is taken from the pending refund, the rest is transferred at once
+   BOOST_REQUIRE_EQUAL( success(),
+                        delegatebatch( "alice1111111", { std::make_tuple( N(alice1111111), core_sym::from_string("60.0000"), core_sym::from_string("40.0000") ),
+                                                         std::make_tuple( N(bob111111111), core_sym::from_string("100.0000"), core_sym::from_string("50.0000") ),
+                                                         std::make_tuple( N(carol1111111), core_sym::from_string("10.0000"), core_sym::from_string("10.0000") ) } ) );
+   BOOST_REQUIRE_EQUAL( core_sym::from_string("680.0000"), get_balance( "alice1111111" ) );
+   auto refund = get_refund_request( "alice1111111" );
+   BOOST_REQUIRE_EQUAL( core_sym::from_string("40.0000"), refund["net_amount"].as<asset>() );
+   BOOST_REQUIRE_EQUAL( core_sym::from_string("10.0000"), refund["cpu_amount"].as<asset>() );
+   REQUIRE_MATCHING_OBJECT( voter( "alice1111111", core_sym::from_string("270.0000") ), get_voter_info( "alice1111111" ) );
+   auto total = get_total_stake( "bob111111111" );
+   BOOST_REQUIRE_EQUAL( core_sym::from_string("110.0000"), total["net_weight"].as<asset>() );
+   BOOST_REQUIRE_EQUAL( core_sym::from_string("60.0000"), total["cpu_weight"].as<asset>() );
+
+   BOOST_REQUIRE_EQUAL( wasm_assert_msg("no receivers to undelegate from"), undelbatch( "alice1111111", {} ) );
+   BOOST_REQUIRE_EQUAL( wasm_assert_msg("insufficient staked net bandwidth"),
+                        undelbatch( "alice1111111", { std::make_tuple( N(bob111111111), core_sym::from_string("100.0000"), core_sym::from_string("50.0000") ),
+                                                      std::make_tuple( N(carol1111111), core_sym::from_string("10.0001"), core_sym::from_string("10.0000") ) } ) );
+
+   // everything unstaked goes into one refund request
+   BOOST_REQUIRE_EQUAL( success(),
+                        undelbatch( "alice1111111", { std::make_tuple( N(bob111111111), core_sym::from_string("100.0000"), core_sym::from_string("50.0000") ),
+                                                      std::make_tuple( N(carol1111111), core_sym::from_string("10.0000"), core_sym::from_string("10.0000") ) } ) );
+   refund = get_refund_request( "alice1111111" );
+   BOOST_REQUIRE_EQUAL( core_sym::from_string("150.0000"), refund["net_amount"].as<asset>() );
+   BOOST_REQUIRE_EQUAL( core_sym::from_string("70.0000"), refund["cpu_amount"].as<asset>() );
+   REQUIRE_MATCHING_OBJECT( voter( "alice1111111", core_sym::from_string("100.0000") ), get_voter_info( "alice1111111" ) );
+   total = get_total_stake( "carol1111111" );
+   BOOST_REQUIRE_EQUAL( core_sym::from_string("10.0000"), total["net_weight"].as<asset>() );
+   BOOST_REQUIRE_EQUAL( core_sym::from_string("10.0000"), total["cpu_weight"].as<asset>() );
+
+   produce_block( fc::days(3) );
+   BOOST_REQUIRE_EQUAL( success(), procrefunds() );
+   BOOST_REQUIRE_EQUAL( core_sym::from_string("900.0000"), get_balance( "alice1111111" ) );
+} FC_LOG_AND_RETHROW()
+
+BOOST_FIXTURE_TEST_CASE( resource_limits_unchanged, eosio_system_tester ) try {
+   cross_15_percent_threshold();
+   issue( "alice1111111", core_sym::from_string("1000.0000"),  config::system_account_name );
+   produce_block();
+
+   // every set_resource_limits leaves a pending limits update of the account until the block ends
+   base_tester::push_action( config::system_account_name, N(delegatebw), N(alice1111111), mvo()
+                             ("from",               "alice1111111")
+                             ("receiver",           "bob111111111")
+                             ("stake_net_quantity", core_sym::from_string("10.0000"))
+                             ("stake_cpu_quantity", core_sym::from_string("10.0000"))
+                             ("transfer",           false) );
+   BOOST_REQUIRE( vector<account_name>{ N(bob111111111) } == limits_set_in_pending_block() );
+   produce_block();
+
+   // the net weight of alice is managed, staking net only leaves all of its limits as they are
+   base_tester::push_action( config::system_account_name, N(setacctnet), config::system_account_name, mvo()
+                             ("account",    "alice1111111")
+                             ("net_weight", 1000000) );
+   BOOST_REQUIRE( vector<account_name>{ N(alice1111111) } == limits_set_in_pending_block() );
+   produce_block();
+   base_tester::push_action( config::system_account_name, N(delegatebw), N(alice1111111), mvo()
+                             ("from",               "alice1111111")
+                             ("receiver",           "alice1111111")
+                             ("stake_net_quantity", core_sym::from_string("10.0000"))
+                             ("stake_cpu_quantity", core_sym::from_string("0.0000"))
+                             ("transfer",           false) );
+   BOOST_REQUIRE( limits_set_in_pending_block().empty() );
+   produce_block();
+
+   // setting the limits an account already has writes nothing
+   base_tester::push_action( config::system_account_name, N(setacctnet), config::system_account_name, mvo()
+                             ("account",    "alice1111111")
+                             ("net_weight", 1000000) );
+   int64_t ram, net, cpu;
+   control->get_resource_limits_manager().get_account_limits( N(eosio.token), ram, net, cpu );
+   base_tester::push_action( config::system_account_name, N(setalimits), config::system_account_name, mvo()
+                             ("account", "eosio.token")
+                             ("ram", ram)
+                             ("net", net)
+                             ("cpu", cpu) );
+   BOOST_REQUIRE( limits_set_in_pending_block().empty() );
+   produce_block();
+
+   // several changes of one account in one action are written once, with the final values
+   base_tester::push_action( config::system_account_name, N(delegatebatch), N(alice1111111), mvo()
+                             ("from",      "alice1111111")
+                             ("receivers", bandwidth_deltas( { std::make_tuple( N(carol1111111), core_sym::from_string("10.0000"), core_sym::from_string("10.0000") ),
+                                                               std::make_tuple( N(carol1111111), core_sym::from_string("5.0000"), core_sym::from_string("5.0000") ) } )) );
+   BOOST_REQUIRE( vector<account_name>{ N(carol1111111) } == limits_set_in_pending_block() );
+   produce_block();
+   control->get_resource_limits_manager().get_account_limits( N(carol1111111), ram, net, cpu );
+   BOOST_REQUIRE_EQUAL( 250000, net );
+   BOOST_REQUIRE_EQUAL( 250000, cpu );
+} FC_LOG_AND_RETHROW()
+
+BOOST_FIXTURE_TEST_CASE( batch_account_resources, eosio_system_tester ) try {
+   auto limits = [&]( name account ) {
+      int64_t ram, net, cpu;
+      control->get_resource_limits_manager().get_account_limits( account, ram, net, cpu );
+      return std::make_tuple( ram, net, cpu );
+   };
+   auto flags = [&]( name account ) {
+      return get_voter_info( account )["flags1"].as<uint32_t>();
+   };
+   const auto alice = N(alice1111111), bob = N(bob111111111), carol = N(carol1111111);
+   const int64_t alice_ram = std::get<0>( limits( alice ) ), bob_net = std::get<1>( limits( bob ) );
+
+   BOOST_REQUIRE_EQUAL( wasm_assert_msg("no accounts given"),
+                        push_action( config::system_account_name, N(batchacctram), mvo()("accounts", fc::variants()) ) );
+   BOOST_REQUIRE_EQUAL( success(),
+                        push_action( config::system_account_name, N(batchacctram), mvo()
+                                     ("accounts", fc::variants{ mvo()("account", alice)("value", 100000),
+                                                                mvo()("account", bob)("value", 200000) }) ) );
+   BOOST_REQUIRE_EQUAL( success(),
+                        push_action( config::system_account_name, N(batchacctnet), mvo()
+                                     ("accounts", fc::variants{ mvo()("account", alice)("value", 5000),
+                                                                mvo()("account", carol)("value", -1) }) ) );
+   BOOST_REQUIRE_EQUAL( success(),
+                        push_action( config::system_account_name, N(batchacctcpu), mvo()
+                                     ("accounts", fc::variants{ mvo()("account", alice)("value", 7000) }) ) );
+   BOOST_REQUIRE( std::make_tuple( int64_t(100000), int64_t(5000), int64_t(7000) ) == limits( alice ) );
+   BOOST_REQUIRE_EQUAL( 200000, std::get<0>( limits( bob ) ) );
+   BOOST_REQUIRE_EQUAL( bob_net, std::get<1>( limits( bob ) ) );
+   BOOST_REQUIRE_EQUAL( -1, std::get<1>( limits( carol ) ) );
+   BOOST_REQUIRE_EQUAL( 7u, flags( alice ) );
+   BOOST_REQUIRE_EQUAL( 1u, flags( bob ) );
+   BOOST_REQUIRE_EQUAL( 2u, flags( carol ) );
+
+   // an empty value hands the resource back to staking; one unmanaged account fails the whole batch
+   BOOST_REQUIRE_EQUAL( wasm_assert_msg("RAM of account is already unmanaged"),
+                        push_action( config::system_account_name, N(batchacctram), mvo()
+                                     ("accounts", fc::variants{ mvo()("account", alice)("value", fc::variant()),
+                                                                mvo()("account", carol)("value", fc::variant()) }) ) );
+   BOOST_REQUIRE_EQUAL( success(),
+                        push_action( config::system_account_name, N(batchacctram), mvo()
+                                     ("accounts", fc::variants{ mvo()("account", alice)("value", fc::variant()),
+                                                                mvo()("account", bob)("value", fc::variant()) }) ) );
+   BOOST_REQUIRE_EQUAL( alice_ram, std::get<0>( limits( alice ) ) );
+   BOOST_REQUIRE_EQUAL( 6u, flags( alice ) );
+   BOOST_REQUIRE_EQUAL( 0u, flags( bob ) );
+
+   BOOST_REQUIRE_EQUAL( wasm_assert_msg("only supports unlimited accounts"),
+                        push_action( config::system_account_name, N(batchalimits), mvo()
+                                     ("accounts", fc::variants{ mvo()("account", "eosio.token")("ram_bytes", 1000000)("net_weight", -1)("cpu_weight", -1),
+                                                                mvo()("account", alice)("ram_bytes", 1000000)("net_weight", -1)("cpu_weight", -1) }) ) );
+   BOOST_REQUIRE_EQUAL( success(),
+                        push_action( config::system_account_name, N(batchalimits), mvo()
+                                     ("accounts", fc::variants{ mvo()("account", "eosio.token")("ram_bytes", 1000000)("net_weight", -1)("cpu_weight", -1),
+                                                                mvo()("account", "eosio.names")("ram_bytes", 2000000)("net_weight", 10)("cpu_weight", 20) }) ) );
+   BOOST_REQUIRE( std::make_tuple( int64_t(1000000), int64_t(-1), int64_t(-1) ) == limits( N(eosio.token) ) );
+   BOOST_REQUIRE( std::make_tuple( int64_t(2000000), int64_t(10), int64_t(20) ) == limits( N(eosio.names) ) );
+} FC_LOG_AND_RETHROW()
+
 // Tests for voting
 BOOST_FIXTURE_TEST_CASE( producer_register_unregister, eosio_system_tester ) try {
    issue( "alice1111111", core_sym::from_string("1000.0000"),  config::system_account_name );
@@ -757,6 +1030,223 @@ BOOST_FIXTURE_TEST_CASE( producer_register_unregister, eosio_system_tester ) try
 } FC_LOG_AND_RETHROW()
 
 
+BOOST_FIXTURE_TEST_CASE( producer_tally, eosio_system_tester, * boost::unit_test::tolerance(1e+5) ) try {
+   issue( "alice1111111", core_sym::from_string("1000.0000"),  config::system_account_name );
+   issue( "bob111111111", core_sym::from_string("2000.0000"),  config::system_account_name );
+   BOOST_REQUIRE_EQUAL( success(), regproducer( N(alice1111111) ) );
+
+   auto tally = get_producer_tally( "alice1111111" );
+   BOOST_REQUIRE_EQUAL( "alice1111111", tally["owner"].as_string() );
+   BOOST_REQUIRE_EQUAL( 0, fixed_votes( tally["total_votes"] ) );
+   BOOST_REQUIRE_EQUAL( true, tally["is_active"].as_bool() );
+   BOOST_REQUIRE_EQUAL( tally["last_claim_time"].as_string(), tally["last_votepay_share_update"].as_string() );
+   // vote pay is accounted in the tally, there is no producers2 row
+   BOOST_REQUIRE( get_row_by_account( config::system_account_name, config::system_account_name, N(producers2), N(alice1111111) ).empty() );
+
+   // a new chain has nothing to migrate
+   BOOST_REQUIRE_EQUAL( error("missing authority of eosio"),
+                        push_action( N(alice1111111), N(migrateprods), mvo()("max_rows", 10) ) );
+   BOOST_REQUIRE_EQUAL( wasm_assert_msg("producers are already migrated"),
+                        push_action( config::system_account_name, N(migrateprods), mvo()("max_rows", 10) ) );
+
+   // votes only touch the tally, the metadata row is left alone
+   const auto metadata = get_row_by_account( config::system_account_name, config::system_account_name, N(producers), N(alice1111111) );
+   BOOST_REQUIRE_EQUAL( success(), stake( "bob111111111", core_sym::from_string("11.0000"), core_sym::from_string("0.1111") ) );
+   BOOST_REQUIRE_EQUAL( success(), vote( N(bob111111111), { N(alice1111111) } ) );
+   BOOST_TEST_REQUIRE( stake2votes(core_sym::from_string("11.1111")) == fixed_votes( get_producer_tally( "alice1111111" )["total_votes"] ) );
+   BOOST_TEST_REQUIRE( stake2votes(core_sym::from_string("11.1111")) == get_producer_info( "alice1111111" )["total_votes"].as_double() );
+   BOOST_REQUIRE( metadata == get_row_by_account( config::system_account_name, config::system_account_name, N(producers), N(alice1111111) ) );
+
+   BOOST_REQUIRE_EQUAL( success(), push_action( N(alice1111111), N(unregprod), mvo()("producer", "alice1111111") ) );
+   BOOST_REQUIRE_EQUAL( false, get_producer_tally( "alice1111111" )["is_active"].as_bool() );
+   BOOST_REQUIRE_EQUAL( success(), regproducer( N(alice1111111) ) );
+   BOOST_REQUIRE_EQUAL( true, get_producer_tally( "alice1111111" )["is_active"].as_bool() );
+} FC_LOG_AND_RETHROW()
+
+BOOST_AUTO_TEST_CASE( producer_tally_migration, * boost::unit_test::tolerance(1e-10) ) try {
+   eosio_system_tester t(eosio_system_tester::setup_level::minimal);
+
+   std::string old_contract_core_symbol_name = "SYS"; // Set to core symbol used in contracts::util::system_wasm_old()
+   symbol old_contract_core_symbol{::eosio::chain::string_to_symbol_c( 4, old_contract_core_symbol_name.c_str() )};
+
+   auto old_core_from_string = [&]( const std::string& s ) {
+      return eosio::chain::asset::from_string(s + " " + old_contract_core_symbol_name);
+   };
+
+   t.create_core_token( old_contract_core_symbol );
+   t.set_code( config::system_account_name, contracts::util::system_wasm_old() );
+   t.set_abi(  config::system_account_name, contracts::util::system_abi_old().data() );
+   {
+      const auto& accnt = t.control->db().get<account_object,by_name>( config::system_account_name );
+      abi_def abi;
+      BOOST_REQUIRE_EQUAL(abi_serializer::to_abi(accnt.abi, abi), true);
+      t.abi_ser.set_abi(abi, eosio_system_tester::abi_serializer_max_time);
+   }
+
+   const std::vector<account_name> producers = { N(defproducera), N(defproducerb) };
+   t.setup_producer_accounts( producers, old_core_from_string("1.0000"),
+                              old_core_from_string("80.0000"), old_core_from_string("80.0000") );
+   for( const auto& p : producers ) {
+      BOOST_REQUIRE_EQUAL( t.success(), t.regproducer(p) );
+   }
+   t.create_account_with_resources( N(producvotera), config::system_account_name, old_core_from_string("1.0000"), false,
+                                    old_core_from_string("80.0000"), old_core_from_string("80.0000") );
+   t.transfer( config::system_account_name, N(producvotera), old_core_from_string("1000.0000"), config::system_account_name );
+   BOOST_REQUIRE_EQUAL( t.success(), t.stake( N(producvotera), old_core_from_string("100.0000"), old_core_from_string("100.0000") ) );
+   BOOST_REQUIRE_EQUAL( t.success(), t.vote( N(producvotera), producers ) );
+   t.produce_block();
+   std::map<account_name, double> legacy_votes;
+   for( const auto& p : producers ) {
+      legacy_votes[p] = t.get_producer_info( p )["total_votes"].as_double();
+      BOOST_TEST_REQUIRE( 0 < legacy_votes[p] );
+   }
+
+   t.deploy_contract( false );
+
+   // producers2 rows as the contracts before prodtally left them, with vote pay already accrued
+   auto& db = const_cast<chainbase::database&>( t.control->db() );
+   const auto* tbl = &db.create<eosio::chain::table_id_object>( [&]( eosio::chain::table_id_object& o ) {
+      o.code  = config::system_account_name;
+      o.scope = config::system_account_name;
+      o.table = N(producers2);
+      o.payer = config::system_account_name;
+   });
+   const fc::time_point votepay_update = t.control->head_block_time() - fc::hours(1);
+   const std::map<account_name, double> votepay_shares = { { N(defproducera), 5.0 }, { N(defproducerb), 7.0 } };
+   for( const auto& s : votepay_shares ) {
+      const auto data = t.abi_ser.variant_to_binary( "producer_info2", mvo()
+                                                     ("owner", s.first)
+                                                     ("votepay_share", s.second)
+                                                     ("last_votepay_share_update", votepay_update),
+                                                     eosio_system_tester::abi_serializer_max_time );
+      db.create<eosio::chain::key_value_object>( [&]( eosio::chain::key_value_object& o ) {
+         o.t_id        = tbl->id;
+         o.primary_key = s.first.value;
+         o.payer       = config::system_account_name;
+         o.value.assign( data.data(), data.size() );
+      });
+      db.modify( *tbl, []( eosio::chain::table_id_object& o ) { ++o.count; } );
+   }
+   for( const auto& p : producers ) {
+      BOOST_REQUIRE( t.get_row_by_account( config::system_account_name, config::system_account_name, N(prodtally), p ).empty() );
+   }
+
+   auto require_migrated = [&]( const account_name& p ) {
+      const auto tally = t.get_producer_tally( p );
+      BOOST_TEST_REQUIRE( legacy_votes.at( p ) == t.fixed_votes( tally["total_votes"] ) );
+      BOOST_REQUIRE_EQUAL( true, tally["is_active"].as_bool() );
+      BOOST_TEST_REQUIRE( votepay_shares.at( p ) == tally["votepay_share"].as_double() );
+      BOOST_REQUIRE_EQUAL( votepay_update.time_since_epoch().count(),
+                           t.microseconds_since_epoch_of_iso_string( tally["last_votepay_share_update"] ) );
+   };
+
+   // the first use of a producer creates its tally from producer_info and producer_info2
+   BOOST_REQUIRE_EQUAL( t.success(), t.regproducer( N(defproducera) ) );
+   require_migrated( N(defproducera) );
+   BOOST_REQUIRE( t.get_row_by_account( config::system_account_name, config::system_account_name, N(prodtally), N(defproducerb) ).empty() );
+
+   // migrateprods creates the remaining ones
+   BOOST_REQUIRE_EQUAL( t.error("missing authority of eosio"),
+                        t.push_action( N(defproducera), N(migrateprods), mvo()("max_rows", 10) ) );
+   BOOST_REQUIRE_EQUAL( t.success(), t.push_action( config::system_account_name, N(migrateprods), mvo()("max_rows", 10) ) );
+   require_migrated( N(defproducerb) );
+
+   // once done it releases the producers2 rows, the tallies keep the vote pay accounting
+   BOOST_REQUIRE_EQUAL( t.success(), t.push_action( config::system_account_name, N(migrateprods), mvo()("max_rows", 1) ) );
+   BOOST_REQUIRE( t.get_row_by_account( config::system_account_name, config::system_account_name, N(producers2), N(defproducera) ).empty() );
+   BOOST_REQUIRE( !t.get_row_by_account( config::system_account_name, config::system_account_name, N(producers2), N(defproducerb) ).empty() );
+   BOOST_REQUIRE_EQUAL( t.success(), t.push_action( config::system_account_name, N(migrateprods), mvo()("max_rows", 10) ) );
+   BOOST_REQUIRE( t.get_row_by_account( config::system_account_name, config::system_account_name, N(producers2), N(defproducerb) ).empty() );
+   BOOST_REQUIRE_EQUAL( t.wasm_assert_msg("producers are already migrated"),
+                        t.push_action( config::system_account_name, N(migrateprods), mvo()("max_rows", 10) ) );
+   for( const auto& p : producers ) {
+      require_migrated( p );
+   }
+} FC_LOG_AND_RETHROW()
+
+BOOST_FIXTURE_TEST_CASE( vote_weight_cache, eosio_system_tester ) try {
+   issue( "alice1111111", core_sym::from_string("1000.0000"),  config::system_account_name );
+   issue( "bob111111111", core_sym::from_string("2000.0000"),  config::system_account_name );
+   BOOST_REQUIRE_EQUAL( success(), regproducer( N(alice1111111) ) );
+   BOOST_REQUIRE_EQUAL( success(), stake( "bob111111111", core_sym::from_string("11.0000"), core_sym::from_string("0.1111") ) );
+   BOOST_REQUIRE_EQUAL( success(), vote( N(bob111111111), { N(alice1111111) } ) );
+
+   auto week = [&]() {
+      auto now = control->pending_block_time().time_since_epoch().count() / 1000000;
+      return uint32_t( (now - (config::block_timestamp_epoch / 1000)) / (86400 * 7) );
+   };
+   auto ghot = get_global_hot_state();
+   BOOST_REQUIRE_EQUAL( week(), ghot["vote_weight_week"].as<uint32_t>() );
+   BOOST_REQUIRE_EQUAL( pow( 2, week() / double(52) ), fixed_votes( ghot["vote_weight"] ) );
+   BOOST_REQUIRE_EQUAL( stake2votes( core_sym::from_string("11.1111") ), fixed_votes( get_producer_tally( "alice1111111" )["total_votes"] ) );
+
+   // a week later the weight is computed again
+   produce_block( fc::days(8) );
+   produce_block();
+   BOOST_REQUIRE_EQUAL( success(), stake( "bob111111111", core_sym::from_string("10.0000"), core_sym::from_string("0.0000") ) );
+   ghot = get_global_hot_state();
+   BOOST_REQUIRE_EQUAL( week(), ghot["vote_weight_week"].as<uint32_t>() );
+   BOOST_REQUIRE_EQUAL( pow( 2, week() / double(52) ), fixed_votes( ghot["vote_weight"] ) );
+   BOOST_REQUIRE_EQUAL( stake2votes( core_sym::from_string("21.1111") ), get_voter_info( "bob111111111" )["last_vote_weight"].as_double() );
+
+   // the weights are kept in fixed point, the doubles are a copy for readers of the table
+   const auto weights = get_voter_info( "bob111111111" )["weights"];
+   BOOST_REQUIRE_EQUAL( stake2votes( core_sym::from_string("21.1111") ), fixed_votes( weights["last_vote_weight"] ) );
+   BOOST_REQUIRE_EQUAL( 0, fixed_votes( weights["proxied_vote_weight"] ) );
+   BOOST_REQUIRE_EQUAL( stake2votes( core_sym::from_string("21.1111") ), fixed_votes( get_global_hot_state()["total_producer_vote_weight"] ) );
+} FC_LOG_AND_RETHROW()
+
+BOOST_FIXTURE_TEST_CASE( refresh_votes, eosio_system_tester, * boost::unit_test::tolerance(1e-10) ) try {
+   create_accounts_with_resources( { N(defproducer1), N(defproducer2) } );
+   BOOST_REQUIRE_EQUAL( success(), regproducer( N(defproducer1) ) );
+   BOOST_REQUIRE_EQUAL( success(), regproducer( N(defproducer2) ) );
+   issue( "alice1111111", core_sym::from_string("1000.0000"),  config::system_account_name );
+   issue( "bob111111111", core_sym::from_string("1000.0000"),  config::system_account_name );
+   issue( "carol1111111", core_sym::from_string("1000.0000"),  config::system_account_name );
+
+   // alice votes directly, bob votes through carol's proxy
+   BOOST_REQUIRE_EQUAL( success(), stake( "alice1111111", core_sym::from_string("100.0000"), core_sym::from_string("100.0000") ) );
+   BOOST_REQUIRE_EQUAL( success(), vote( N(alice1111111), { N(defproducer1) } ) );
+   BOOST_REQUIRE_EQUAL( success(), stake( "carol1111111", core_sym::from_string("50.0000"), core_sym::from_string("50.0000") ) );
+   BOOST_REQUIRE_EQUAL( success(), push_action( N(carol1111111), N(regproxy), mvo()("proxy", "carol1111111")("isproxy", true) ) );
+   BOOST_REQUIRE_EQUAL( success(), vote( N(carol1111111), { N(defproducer2) } ) );
+   BOOST_REQUIRE_EQUAL( success(), stake( "bob111111111", core_sym::from_string("10.0000"), core_sym::from_string("10.0000") ) );
+   BOOST_REQUIRE_EQUAL( success(), vote( N(bob111111111), {}, N(carol1111111) ) );
+
+   const double votes1 = get_producer_info( "defproducer1" )["total_votes"].as_double();
+   const double votes2 = get_producer_info( "defproducer2" )["total_votes"].as_double();
+   BOOST_TEST_REQUIRE( stake2votes( core_sym::from_string("200.0000") ) == votes1 );
+   BOOST_TEST_REQUIRE( stake2votes( core_sym::from_string("120.0000") ) == votes2 );
+
+   // vote weights grow every week but the tallies only follow when voters act
+   produce_block( fc::days(14) );
+   produce_block();
+   BOOST_TEST_REQUIRE( votes1 == get_producer_info( "defproducer1" )["total_votes"].as_double() );
+   BOOST_TEST_REQUIRE( stake2votes( core_sym::from_string("200.0000") ) > votes1 );
+
+   BOOST_REQUIRE_EQUAL( wasm_assert_msg("max_rows must be positive"),
+                        push_action( N(bob111111111), N(refreshvotes), mvo()("cursor", "alice1111111")("max_rows", 0) ) );
+   BOOST_REQUIRE_EQUAL( wasm_assert_msg("no voters to refresh"),
+                        push_action( N(bob111111111), N(refreshvotes), mvo()("cursor", "zzzzzzzzzzzz")("max_rows", 10) ) );
+
+   // anyone can refresh, only the voters in the batch are refreshed
+   BOOST_REQUIRE_EQUAL( success(), push_action( N(bob111111111), N(refreshvotes), mvo()("cursor", "alice1111111")("max_rows", 1) ) );
+   BOOST_TEST_REQUIRE( stake2votes( core_sym::from_string("200.0000") ) == get_producer_info( "defproducer1" )["total_votes"].as_double() );
+   BOOST_TEST_REQUIRE( stake2votes( core_sym::from_string("200.0000") ) == get_voter_info( "alice1111111" )["last_vote_weight"].as_double() );
+   BOOST_TEST_REQUIRE( votes2 == get_producer_info( "defproducer2" )["total_votes"].as_double() );
+
+   // the proxied weight of bob and the own weight of carol reach defproducer2 in one write
+   BOOST_REQUIRE_EQUAL( success(), push_action( N(alice1111111), N(refreshvotes), mvo()("cursor", "bob111111111")("max_rows", 2) ) );
+   BOOST_TEST_REQUIRE( stake2votes( core_sym::from_string("20.0000") ) == get_voter_info( "carol1111111" )["proxied_vote_weight"].as_double() );
+   BOOST_TEST_REQUIRE( stake2votes( core_sym::from_string("120.0000") ) == get_voter_info( "carol1111111" )["last_vote_weight"].as_double() );
+   BOOST_TEST_REQUIRE( stake2votes( core_sym::from_string("120.0000") ) == get_producer_info( "defproducer2" )["total_votes"].as_double() );
+   BOOST_TEST_REQUIRE( stake2votes( core_sym::from_string("320.0000") ) == get_global_state()["total_producer_vote_weight"].as_double() );
+
+   // refreshing again within the week changes nothing
+   BOOST_REQUIRE_EQUAL( success(), push_action( N(alice1111111), N(refreshvotes), mvo()("cursor", "")("max_rows", 100) ) );
+   BOOST_TEST_REQUIRE( stake2votes( core_sym::from_string("120.0000") ) == get_producer_info( "defproducer2" )["total_votes"].as_double() );
+} FC_LOG_AND_RETHROW()
+
 BOOST_FIXTURE_TEST_CASE( vote_for_producer, eosio_system_tester, * boost::unit_test::tolerance(1e+5) ) try {
    cross_15_percent_threshold();
 
@@ -836,6 +1326,7 @@ BOOST_FIXTURE_TEST_CASE( vote_for_producer, eosio_system_tester, * boost::unit_t
    //carol1111111 should receive funds in 3 days
    produce_block( fc::days(3) );
    produce_block();
+   BOOST_REQUIRE_EQUAL( success(), procrefunds() );
    BOOST_REQUIRE_EQUAL( core_sym::from_string("3000.0000"), get_balance( "carol1111111" ) );
 
 } FC_LOG_AND_RETHROW()
@@ -1192,6 +1683,182 @@ BOOST_FIXTURE_TEST_CASE( proxy_actions_affect_producers, eosio_system_tester, *
 
 } FC_LOG_AND_RETHROW()
 
+BOOST_FIXTURE_TEST_CASE(unpaid_blocks_round_counter, eosio_system_tester) try {
+   const asset large_asset = core_sym::from_string("80.0000");
+   create_account_with_resources( N(defproducera), config::system_account_name, core_sym::from_string("1.0000"), false, large_asset, large_asset );
+   create_account_with_resources( N(producvotera), config::system_account_name, core_sym::from_string("1.0000"), false, large_asset, large_asset );
+
+   BOOST_REQUIRE_EQUAL(success(), regproducer(N(defproducera)));
+   produce_block(fc::hours(24));
+   transfer( config::system_account_name, "producvotera", core_sym::from_string("400000000.0000"), config::system_account_name);
+   BOOST_REQUIRE_EQUAL(success(), stake("producvotera", core_sym::from_string("100000000.0000"), core_sym::from_string("100000000.0000")));
+   BOOST_REQUIRE_EQUAL(success(), vote( N(producvotera), { N(defproducera) }));
+   produce_blocks(50);
+
+   auto stored_unpaid_blocks = [&]() {
+      vector<char> data = get_row_by_account( config::system_account_name, config::system_account_name, N(producers), N(defproducera) );
+      return abi_ser.binary_to_variant( "producer_info", data, abi_serializer_max_time )["unpaid_blocks"].as<uint32_t>();
+   };
+   auto round_unpaid_blocks = [&]() {
+      uint32_t blocks = 0;
+      for( const auto& c : get_global_hot_state()["round_unpaid_blocks"].get_array() ) {
+         if( c["producer"].as<account_name>() == N(defproducera) ) blocks += c["blocks"].as<uint32_t>();
+      }
+      return blocks;
+   };
+
+   // within a round the producer row is left alone, a block that also updates the schedule
+   // starts a new round, so blocks are produced until one is only counted
+   bool counted = false;
+   for( uint32_t i = 0; i < 10 && !counted; ++i ) {
+      const uint32_t stored_before = stored_unpaid_blocks();
+      const uint32_t round_before  = round_unpaid_blocks();
+      produce_block();
+      if( stored_unpaid_blocks() == stored_before ) {
+         BOOST_REQUIRE_EQUAL( round_before + 1, round_unpaid_blocks() );
+         counted = true;
+      }
+   }
+   BOOST_REQUIRE( counted );
+   const uint32_t stored = stored_unpaid_blocks();
+   BOOST_REQUIRE_EQUAL( get_global_state()["total_unpaid_blocks"].as<uint32_t>(),
+                        stored_unpaid_blocks() + round_unpaid_blocks() );
+   BOOST_REQUIRE_EQUAL( get_global_state()["total_unpaid_blocks"].as<uint32_t>(),
+                        get_producer_info(N(defproducera))["unpaid_blocks"].as<uint32_t>() );
+
+   // the schedule update merges the round into the producer row
+   produce_block(fc::minutes(2));
+   produce_block();
+   BOOST_REQUIRE_LT( stored, stored_unpaid_blocks() );
+   BOOST_REQUIRE_GE( 2u, round_unpaid_blocks() );
+   BOOST_REQUIRE_EQUAL( get_global_state()["total_unpaid_blocks"].as<uint32_t>(),
+                        stored_unpaid_blocks() + round_unpaid_blocks() );
+
+   // claimrewards pays the blocks of the running round as well
+   BOOST_REQUIRE_EQUAL(success(), push_action(N(defproducera), N(claimrewards), mvo()("owner", "defproducera")));
+   BOOST_REQUIRE_EQUAL( 0, stored_unpaid_blocks() );
+   BOOST_REQUIRE_EQUAL( 0, round_unpaid_blocks() );
+   BOOST_REQUIRE_EQUAL( 0, get_global_state()["total_unpaid_blocks"].as<uint32_t>() );
+} FC_LOG_AND_RETHROW()
+
+BOOST_FIXTURE_TEST_CASE(top_producers_cache, eosio_system_tester) try {
+   const std::vector<account_name> producers = { N(defproducera), N(defproducerb), N(defproducerc) };
+   setup_producer_accounts( producers );
+   for( const auto& p : producers ) {
+      BOOST_REQUIRE_EQUAL( success(), regproducer(p) );
+   }
+   create_account_with_resources( N(producvotera), config::system_account_name, core_sym::from_string("1.0000"), false );
+   transfer( config::system_account_name, "producvotera", core_sym::from_string("1000.0000"), config::system_account_name );
+   BOOST_REQUIRE_EQUAL( success(), stake( "producvotera", core_sym::from_string("100.0000"), core_sym::from_string("100.0000") ) );
+   BOOST_REQUIRE_EQUAL( success(), vote( N(producvotera), { N(defproducera), N(defproducerb) } ) );
+
+   auto elected = [&]() {
+      return get_top_producers()["producers"].as<std::vector<account_name>>();
+   };
+   auto dirty = [&]() {
+      return get_top_producers()["dirty"].as_bool();
+   };
+
+   produce_block( fc::minutes(2) );
+   produce_block();
+   BOOST_REQUIRE_EQUAL( false, dirty() );
+   BOOST_REQUIRE_EQUAL( 2, elected().size() );
+   BOOST_REQUIRE_EQUAL( 0, fixed_votes( get_top_producers()["threshold"] ) );
+   const auto schedule_hash = get_top_producers()["schedule_hash"].as_string();
+
+   // more votes for the elected producers cannot change who is elected
+   BOOST_REQUIRE_EQUAL( success(), stake( "producvotera", core_sym::from_string("10.0000"), core_sym::from_string("10.0000") ) );
+   BOOST_REQUIRE_EQUAL( false, dirty() );
+
+   // an elected producer losing votes can
+   BOOST_REQUIRE_EQUAL( success(), vote( N(producvotera), { N(defproducera) } ) );
+   BOOST_REQUIRE_EQUAL( true, dirty() );
+   produce_block( fc::minutes(2) );
+   produce_block();
+   BOOST_REQUIRE_EQUAL( false, dirty() );
+   BOOST_REQUIRE_EQUAL( 1, elected().size() );
+   BOOST_REQUIRE_EQUAL( N(defproducera), elected()[0] );
+   // fewer producers than last time are not proposed
+   BOOST_REQUIRE_EQUAL( schedule_hash, get_top_producers()["schedule_hash"].as_string() );
+
+   // so can a producer outside the top 21 gaining votes
+   BOOST_REQUIRE_EQUAL( success(), vote( N(producvotera), { N(defproducera), N(defproducerc) } ) );
+   BOOST_REQUIRE_EQUAL( true, dirty() );
+   produce_block( fc::minutes(2) );
+   produce_block();
+   BOOST_REQUIRE_EQUAL( false, dirty() );
+   BOOST_REQUIRE_EQUAL( 2, elected().size() );
+   BOOST_REQUIRE( schedule_hash != get_top_producers()["schedule_hash"].as_string() );
+
+   // and unregistering an elected producer
+   BOOST_REQUIRE_EQUAL( success(), push_action( N(defproducerc), N(unregprod), mvo()("producer", "defproducerc") ) );
+   BOOST_REQUIRE_EQUAL( true, dirty() );
+} FC_LOG_AND_RETHROW()
+
+BOOST_AUTO_TEST_CASE(top_producers_cache_upgrade) try {
+   eosio_system_tester t(eosio_system_tester::setup_level::minimal);
+
+   std::string old_contract_core_symbol_name = "SYS"; // Set to core symbol used in contracts::util::system_wasm_old()
+   symbol old_contract_core_symbol{::eosio::chain::string_to_symbol_c( 4, old_contract_core_symbol_name.c_str() )};
+
+   auto old_core_from_string = [&]( const std::string& s ) {
+      return eosio::chain::asset::from_string(s + " " + old_contract_core_symbol_name);
+   };
+
+   t.create_core_token( old_contract_core_symbol );
+   t.set_code( config::system_account_name, contracts::util::system_wasm_old() );
+   t.set_abi(  config::system_account_name, contracts::util::system_abi_old().data() );
+   {
+      const auto& accnt = t.control->db().get<account_object,by_name>( config::system_account_name );
+      abi_def abi;
+      BOOST_REQUIRE_EQUAL(abi_serializer::to_abi(accnt.abi, abi), true);
+      t.abi_ser.set_abi(abi, eosio_system_tester::abi_serializer_max_time);
+   }
+
+   const std::vector<account_name> producers = { N(defproducera), N(defproducerb), N(defproducerc), N(defproducerd) };
+   t.setup_producer_accounts( producers, old_core_from_string("1.0000"),
+                              old_core_from_string("80.0000"), old_core_from_string("80.0000") );
+   for( const auto& p : producers ) {
+      BOOST_REQUIRE_EQUAL( t.success(), t.regproducer(p) );
+   }
+   const std::vector<account_name> voters = { N(producvotera), N(producvoterb), N(producvoterc) };
+   for( const auto& v : voters ) {
+      t.create_account_with_resources( v, config::system_account_name, old_core_from_string("1.0000"), false,
+                                       old_core_from_string("80.0000"), old_core_from_string("80.0000") );
+      t.transfer( config::system_account_name, v, old_core_from_string("100000000.0000"), config::system_account_name );
+      BOOST_REQUIRE_EQUAL( t.success(), t.stake( v, old_core_from_string("30000000.0000"), old_core_from_string("30000000.0000") ) );
+      BOOST_REQUIRE_EQUAL( t.success(), t.vote( v, producers ) );
+   }
+
+   // the old contract elects the producers, wait until their schedule is active
+   for( uint32_t i = 0; i < 1000 && t.control->head_block_state()->active_schedule.producers.size() != producers.size(); ++i ) {
+      t.produce_block();
+   }
+   BOOST_REQUIRE_EQUAL( producers.size(), t.control->head_block_state()->active_schedule.producers.size() );
+   const uint32_t version = t.control->head_block_state()->active_schedule.version;
+
+   t.deploy_contract( false );
+   BOOST_REQUIRE( t.get_row_by_account( config::system_account_name, config::system_account_name, N(topprods), N(topprods) ).empty() );
+
+   // the first update proposes the unchanged schedule, which the chain refuses as already active,
+   // and stores its hash anyway
+   t.produce_block( fc::minutes(2) );
+   t.produce_block();
+   const auto top = t.get_top_producers();
+   BOOST_REQUIRE_EQUAL( false, top["dirty"].as_bool() );
+   BOOST_REQUIRE_EQUAL( producers.size(), top["producers"].get_array().size() );
+   BOOST_REQUIRE( std::string( 64, '0' ) != top["schedule_hash"].as_string() );
+
+   // so the next update returns before walking the vote index
+   const auto last_update = t.get_global_hot_state()["last_producer_schedule_update"].as_string();
+   t.produce_block( fc::minutes(2) );
+   t.produce_block();
+   BOOST_REQUIRE( last_update != t.get_global_hot_state()["last_producer_schedule_update"].as_string() );
+   BOOST_REQUIRE_EQUAL( false, t.get_top_producers()["dirty"].as_bool() );
+   BOOST_REQUIRE_EQUAL( top["schedule_hash"].as_string(), t.get_top_producers()["schedule_hash"].as_string() );
+   BOOST_REQUIRE_EQUAL( version, t.control->head_block_state()->active_schedule.version );
+} FC_LOG_AND_RETHROW()
+
 BOOST_FIXTURE_TEST_CASE(producer_pay, eosio_system_tester, * boost::unit_test::tolerance(1e-10)) try {
 
    const double continuous_rate = 4.879 / 100.;
@@ -1385,6 +2052,67 @@ BOOST_FIXTURE_TEST_CASE(producer_pay, eosio_system_tester, * boost::unit_test::t
 } FC_LOG_AND_RETHROW()
 
 
+BOOST_FIXTURE_TEST_CASE(claimrewards_single_payout, eosio_system_tester) try {
+   const asset large_asset = core_sym::from_string("80.0000");
+   create_account_with_resources( N(defproducera), config::system_account_name, core_sym::from_string("1.0000"), false, large_asset, large_asset );
+   create_account_with_resources( N(producvotera), config::system_account_name, core_sym::from_string("1.0000"), false, large_asset, large_asset );
+
+   BOOST_REQUIRE_EQUAL(success(), regproducer(N(defproducera)));
+   transfer( config::system_account_name, "producvotera", core_sym::from_string("400000000.0000"), config::system_account_name);
+   BOOST_REQUIRE_EQUAL(success(), stake("producvotera", core_sym::from_string("100000000.0000"), core_sym::from_string("100000000.0000")));
+   BOOST_REQUIRE_EQUAL(success(), vote( N(producvotera), { N(defproducera) }));
+   produce_blocks(50);
+   produce_block(fc::hours(24));
+   produce_blocks(10);
+
+   const asset initial_balance = get_balance(N(defproducera));
+   auto trace = base_tester::push_action( config::system_account_name, N(claimrewards), N(defproducera), mvo()("owner", "defproducera") );
+   produce_block();
+
+   // the bucket fill and both payments to the producer settle in one transfers after the issue
+   std::vector<action_name> token_actions;
+   for( const auto& at : trace->action_traces ) {
+      if( at.receiver == N(eosio.token) ) {
+         token_actions.push_back( at.act.name );
+      }
+   }
+   BOOST_REQUIRE( std::vector<action_name>({ N(issue), N(transfers) }) == token_actions );
+
+   BOOST_REQUIRE( initial_balance < get_balance(N(defproducera)) );
+} FC_LOG_AND_RETHROW()
+
+BOOST_FIXTURE_TEST_CASE(core_supply_tracking, eosio_system_tester) try {
+   BOOST_REQUIRE_EQUAL( symbol(CORE_SYM), get_global_hot_state()["core_symbol"].as<symbol>() );
+   BOOST_REQUIRE_EQUAL( 0, get_global_hot_state()["core_supply"].as<int64_t>() );
+
+   const asset large_asset = core_sym::from_string("80.0000");
+   create_account_with_resources( N(defproducera), config::system_account_name, core_sym::from_string("1.0000"), false, large_asset, large_asset );
+   create_account_with_resources( N(producvotera), config::system_account_name, core_sym::from_string("1.0000"), false, large_asset, large_asset );
+
+   BOOST_REQUIRE_EQUAL(success(), regproducer(N(defproducera)));
+   transfer( config::system_account_name, "producvotera", core_sym::from_string("400000000.0000"), config::system_account_name);
+   BOOST_REQUIRE_EQUAL(success(), stake("producvotera", core_sym::from_string("100000000.0000"), core_sym::from_string("100000000.0000")));
+   BOOST_REQUIRE_EQUAL(success(), vote( N(producvotera), { N(defproducera) }));
+   produce_blocks(50);
+   produce_block(fc::hours(24));
+
+   // the first claim starts tracking the supply, including what it issues itself
+   BOOST_REQUIRE_EQUAL(success(), push_action(N(defproducera), N(claimrewards), mvo()("owner", "defproducera")));
+   BOOST_REQUIRE( get_token_supply() > core_sym::from_string("1000000000.0000") );
+   BOOST_REQUIRE_EQUAL( get_token_supply().get_amount(), get_global_hot_state()["core_supply"].as<int64_t>() );
+   BOOST_REQUIRE_EQUAL( wasm_assert_msg("core supply is already in sync"), push_action(N(alice1111111), N(syncsupply), mvo()) );
+
+   // tokens issued outside claimrewards are picked up by syncsupply, which anyone may call
+   issue( "alice1111111", core_sym::from_string("1000.0000"), config::system_account_name );
+   BOOST_REQUIRE_EQUAL( get_token_supply().get_amount() - 1000'0000, get_global_hot_state()["core_supply"].as<int64_t>() );
+   BOOST_REQUIRE_EQUAL( success(), push_action(N(alice1111111), N(syncsupply), mvo()) );
+   BOOST_REQUIRE_EQUAL( get_token_supply().get_amount(), get_global_hot_state()["core_supply"].as<int64_t>() );
+
+   produce_block(fc::hours(24));
+   BOOST_REQUIRE_EQUAL(success(), push_action(N(defproducera), N(claimrewards), mvo()("owner", "defproducera")));
+   BOOST_REQUIRE_EQUAL( get_token_supply().get_amount(), get_global_hot_state()["core_supply"].as<int64_t>() );
+} FC_LOG_AND_RETHROW()
+
 BOOST_FIXTURE_TEST_CASE(multiple_producer_pay, eosio_system_tester, * boost::unit_test::tolerance(1e-10)) try {
 
    auto within_one = [](int64_t a, int64_t b) -> bool { return std::abs( a - b ) <= 1; };
@@ -2332,6 +3060,7 @@ BOOST_AUTO_TEST_CASE(votepay_transition2, * boost::unit_test::tolerance(1e-10))
    BOOST_REQUIRE( !tbl );
 
    t.produce_block( fc::hours(2*24) );
+   const double total_votes = t.get_global_state()["total_producer_vote_weight"].as_double();
 
    t.deploy_contract( false );
 
@@ -2348,6 +3077,39 @@ BOOST_AUTO_TEST_CASE(votepay_transition2, * boost::unit_test::tolerance(1e-10))
    BOOST_TEST_REQUIRE( t.get_producer_info(producer_names[0])["total_votes"].as_double() + t.get_producer_info(producer_names[1])["total_votes"].as_double() ==
                        t.get_global_state3()["total_vpay_share_change_rate"].as_double() );
 
+   // the vote total moves to the globalhot row, voters keep their double weights until they vote again or
+   // migratevoter converts them
+   BOOST_REQUIRE_EQUAL( total_votes, t.get_global_state()["total_producer_vote_weight"].as_double() );
+
+   // anyone may refresh votes, legacy rows keep their size and only their double weights change
+   const auto& rlm = t.control->get_resource_limits_manager();
+   t.produce_block( fc::days(7) );
+   const int64_t voter_ram      = rlm.get_account_ram_usage( N(producvotera) );
+   const double  refresh_before = t.get_voter_info( N(producvotera) )["last_vote_weight"].as_double();
+   BOOST_REQUIRE_EQUAL( t.success(), t.push_action( N(producvoterd), N(refreshvotes), mvo()("cursor", "")("max_rows", 10) ) );
+   BOOST_TEST_REQUIRE( refresh_before < t.get_voter_info( N(producvotera) )["last_vote_weight"].as_double() );
+   BOOST_REQUIRE( !t.get_voter_info( N(producvotera) ).get_object().contains( "weights" ) );
+   BOOST_REQUIRE_EQUAL( voter_ram, rlm.get_account_ram_usage( N(producvotera) ) );
+
+   // a vote through a proxy does not grow the row of the proxy either
+   BOOST_REQUIRE_EQUAL( t.success(), t.push_action( N(producvoterd), N(regproxy), mvo()("proxy", "producvoterd")("isproxy", true) ) );
+   const int64_t proxy_ram = rlm.get_account_ram_usage( N(producvoterd) );
+   BOOST_REQUIRE_EQUAL( t.success(), t.vote( N(producvoterc), {}, N(producvoterd) ) );
+   BOOST_TEST_REQUIRE( 0 < t.get_voter_info( N(producvoterd) )["proxied_vote_weight"].as_double() );
+   BOOST_REQUIRE( !t.get_voter_info( N(producvoterd) ).get_object().contains( "weights" ) );
+   BOOST_REQUIRE_EQUAL( proxy_ram, rlm.get_account_ram_usage( N(producvoterd) ) );
+
+   const double weight = t.get_voter_info( N(producvotera) )["last_vote_weight"].as_double();
+   BOOST_REQUIRE( !t.get_voter_info( N(producvotera) ).get_object().contains( "weights" ) );
+   BOOST_REQUIRE_EQUAL( t.error("missing authority of eosio"),
+                        t.push_action( N(producvotera), N(migratevoter), mvo()("cursor", "")("max_rows", 10) ) );
+   BOOST_REQUIRE_EQUAL( t.success(), t.push_action( config::system_account_name, N(migratevoter), mvo()("cursor", "")("max_rows", 10) ) );
+   const auto voter = t.get_voter_info( N(producvotera) );
+   BOOST_REQUIRE_EQUAL( weight, voter["last_vote_weight"].as_double() );
+   BOOST_REQUIRE_EQUAL( weight, t.fixed_votes( voter["weights"]["last_vote_weight"] ) );
+   BOOST_REQUIRE_EQUAL( t.wasm_assert_msg("no voters to migrate"),
+                        t.push_action( config::system_account_name, N(migratevoter), mvo()("cursor", "zzzzzzzzzzzz")("max_rows", 10) ) );
+
 } FC_LOG_AND_RETHROW()
 
 
@@ -2636,6 +3398,76 @@ BOOST_FIXTURE_TEST_CASE( voters_actions_affect_proxy_and_producers, eosio_system
 } FC_LOG_AND_RETHROW()
 
 
+BOOST_FIXTURE_TEST_CASE( compact_voter_producers, eosio_system_tester, * boost::unit_test::tolerance(1e+6) ) try {
+   cross_15_percent_threshold();
+
+   create_accounts_with_resources( { N(defproducer1), N(defproducer2), N(defproducer3) } );
+   BOOST_REQUIRE_EQUAL( success(), regproducer( "defproducer1", 1) );
+   BOOST_REQUIRE_EQUAL( success(), regproducer( "defproducer2", 2) );
+   // a new producer pays for its slot itself
+   const auto& rlm = control->get_resource_limits_manager();
+   const int64_t system_ram = rlm.get_account_ram_usage( config::system_account_name );
+   BOOST_REQUIRE_EQUAL( success(), regproducer( "defproducer3", 3) );
+   BOOST_REQUIRE_EQUAL( system_ram, rlm.get_account_ram_usage( config::system_account_name ) );
+
+   auto voter_row_size = [&]( account_name voter ) {
+      return get_row_by_account( config::system_account_name, config::system_account_name, N(voters), voter ).size();
+   };
+   auto producers_of = [&]( account_name voter ) {
+      return get_voter_info( voter )["producers"].as<vector<account_name>>();
+   };
+
+   //alice1111111 votes before compact votes are enabled
+   issue( "alice1111111", core_sym::from_string("1000.0000"),  config::system_account_name );
+   BOOST_REQUIRE_EQUAL( success(), stake( "alice1111111", core_sym::from_string("30.0001"), core_sym::from_string("20.0001") ) );
+   BOOST_REQUIRE_EQUAL( success(), vote( N(alice1111111), { N(defproducer1), N(defproducer2) } ) );
+   BOOST_REQUIRE( vector<account_name>({ N(defproducer1), N(defproducer2) }) == producers_of( N(alice1111111) ) );
+   const auto legacy_size = voter_row_size( N(alice1111111) );
+
+   BOOST_REQUIRE_EQUAL( error("missing authority of eosio"),
+                        push_action( N(alice1111111), N(setcompact), mvo()("compact", true) ) );
+   BOOST_REQUIRE_EQUAL( success(), push_action( config::system_account_name, N(setcompact), mvo()("compact", true) ) );
+   BOOST_REQUIRE_EQUAL( wasm_assert_msg("action has no effect"),
+                        push_action( config::system_account_name, N(setcompact), mvo()("compact", true) ) );
+
+   //bob111111111 votes with compact votes, the row stores producer slots instead of names
+   issue( "bob111111111", core_sym::from_string("1000.0000"),  config::system_account_name );
+   BOOST_REQUIRE_EQUAL( success(), stake( "bob111111111", core_sym::from_string("100.0002"), core_sym::from_string("50.0001") ) );
+   BOOST_REQUIRE_EQUAL( success(), vote( N(bob111111111), { N(defproducer1), N(defproducer3) } ) );
+   BOOST_REQUIRE( producers_of( N(bob111111111) ).empty() );
+   BOOST_REQUIRE_LT( voter_row_size( N(bob111111111) ), legacy_size );
+   BOOST_TEST_REQUIRE( stake2votes(core_sym::from_string("200.0005")) == get_producer_info( "defproducer1" )["total_votes"].as_double() );
+   BOOST_TEST_REQUIRE( stake2votes(core_sym::from_string("50.0002")) == get_producer_info( "defproducer2" )["total_votes"].as_double() );
+   BOOST_TEST_REQUIRE( stake2votes(core_sym::from_string("150.0003")) == get_producer_info( "defproducer3" )["total_votes"].as_double() );
+
+   //a stake change of bob111111111 reaches the producers decoded from the slots
+   BOOST_REQUIRE_EQUAL( success(), unstake( "bob111111111", core_sym::from_string("50.0001"), core_sym::from_string("50.0001") ) );
+   BOOST_TEST_REQUIRE( stake2votes(core_sym::from_string("100.0003")) == get_producer_info( "defproducer1" )["total_votes"].as_double() );
+   BOOST_TEST_REQUIRE( stake2votes(core_sym::from_string("50.0002")) == get_producer_info( "defproducer2" )["total_votes"].as_double() );
+   BOOST_TEST_REQUIRE( stake2votes(core_sym::from_string("50.0001")) == get_producer_info( "defproducer3" )["total_votes"].as_double() );
+
+   //the row of alice1111111 is converted the first time it is written
+   BOOST_REQUIRE_EQUAL( legacy_size, voter_row_size( N(alice1111111) ) );
+   BOOST_REQUIRE_EQUAL( success(), stake( "alice1111111", core_sym::from_string("10.0000"), core_sym::from_string("10.0000") ) );
+   BOOST_REQUIRE( producers_of( N(alice1111111) ).empty() );
+   BOOST_REQUIRE_LT( voter_row_size( N(alice1111111) ), legacy_size );
+   BOOST_TEST_REQUIRE( stake2votes(core_sym::from_string("120.0003")) == get_producer_info( "defproducer1" )["total_votes"].as_double() );
+   BOOST_TEST_REQUIRE( stake2votes(core_sym::from_string("70.0002")) == get_producer_info( "defproducer2" )["total_votes"].as_double() );
+
+   //once compact votes are disabled rows go back to producer names when they are written
+   BOOST_REQUIRE_EQUAL( success(), push_action( config::system_account_name, N(setcompact), mvo()("compact", false) ) );
+   BOOST_REQUIRE_EQUAL( success(), vote( N(bob111111111), { N(defproducer2) } ) );
+   BOOST_REQUIRE( vector<account_name>({ N(defproducer2) }) == producers_of( N(bob111111111) ) );
+   BOOST_REQUIRE_EQUAL( success(), stake( "alice1111111", core_sym::from_string("1.0000"), core_sym::from_string("1.0000") ) );
+   BOOST_REQUIRE( vector<account_name>({ N(defproducer1), N(defproducer2) }) == producers_of( N(alice1111111) ) );
+   BOOST_REQUIRE_EQUAL( legacy_size, voter_row_size( N(alice1111111) ) );
+   BOOST_TEST_REQUIRE( stake2votes(core_sym::from_string("72.0002")) == get_producer_info( "defproducer1" )["total_votes"].as_double() );
+   BOOST_TEST_REQUIRE( stake2votes(core_sym::from_string("122.0003")) == get_producer_info( "defproducer2" )["total_votes"].as_double() );
+   BOOST_TEST_REQUIRE( 0.0 == get_producer_info( "defproducer3" )["total_votes"].as_double() );
+
+} FC_LOG_AND_RETHROW()
+
+
 BOOST_FIXTURE_TEST_CASE( vote_both_proxy_and_producers, eosio_system_tester ) try {
    //alice1111111 becomes a proxy
    BOOST_REQUIRE_EQUAL( success(), push_action( N(alice1111111), N(regproxy), mvo()
@@ -2943,6 +3775,8 @@ BOOST_FIXTURE_TEST_CASE( multiple_namebids, eosio_system_tester ) try {
       const asset initial_names_balance = get_balance(N(eosio.names));
       BOOST_REQUIRE_EQUAL( success(),
                            bidname( "alice", "prefb", core_sym::from_string("1.1001") ) );
+      BOOST_REQUIRE_EQUAL( core_sym::from_string( "9996.9997" ), get_balance("bob") );
+      BOOST_REQUIRE_EQUAL( success(), push_action( N(bob), N(claimbidref), mvo()("bidder", "bob") ) );
       BOOST_REQUIRE_EQUAL( core_sym::from_string( "9997.9997" ), get_balance("bob") );
       BOOST_REQUIRE_EQUAL( core_sym::from_string( "9998.8999" ), get_balance("alice") );
       BOOST_REQUIRE_EQUAL( initial_names_balance + core_sym::from_string("0.1001"), get_balance(N(eosio.names)) );
@@ -2954,6 +3788,7 @@ BOOST_FIXTURE_TEST_CASE( multiple_namebids, eosio_system_tester ) try {
       BOOST_REQUIRE_EQUAL( core_sym::from_string( "10000.0000" ), get_balance("david") );
       BOOST_REQUIRE_EQUAL( success(),
                            bidname( "david", "prefd", core_sym::from_string("1.9900") ) );
+      BOOST_REQUIRE_EQUAL( success(), push_action( N(carl), N(claimbidref), mvo()("bidder", "carl") ) );
       BOOST_REQUIRE_EQUAL( core_sym::from_string( "9999.0000" ), get_balance("carl") );
       BOOST_REQUIRE_EQUAL( core_sym::from_string( "9998.0100" ), get_balance("david") );
    }
@@ -3038,6 +3873,94 @@ BOOST_FIXTURE_TEST_CASE( multiple_namebids, eosio_system_tester ) try {
 
 } FC_LOG_AND_RETHROW()
 
+BOOST_FIXTURE_TEST_CASE( namebid_refunds, eosio_system_tester ) try {
+   cross_15_percent_threshold();
+   produce_block( fc::hours(14*24) );    //wait 14 day for name auction activation
+   std::vector<account_name> accounts = { N(alice), N(bob), N(carl) };
+   create_accounts_with_resources( accounts );
+   for ( const auto& a: accounts ) {
+      transfer( config::system_account_name, a, core_sym::from_string( "100.0000" ) );
+   }
+   auto bid_refund = [&]( const account_name& bidder ) {
+      vector<char> data = get_row_by_account( config::system_account_name, config::system_account_name, N(bidrefunds), bidder );
+      return data.empty() ? asset() : abi_ser.binary_to_variant( "bid_refund", data, abi_serializer_max_time )["amount"].as<asset>();
+   };
+
+   // outbid amounts of alice on several names add up in one row
+   BOOST_REQUIRE_EQUAL( success(), bidname( "alice", "prefa", core_sym::from_string("1.0000") ) );
+   BOOST_REQUIRE_EQUAL( success(), bidname( "alice", "prefb", core_sym::from_string("2.0000") ) );
+   BOOST_REQUIRE_EQUAL( success(), bidname( "carl",  "prefc", core_sym::from_string("3.0000") ) );
+   BOOST_REQUIRE_EQUAL( success(), bidname( "bob",   "prefa", core_sym::from_string("1.5000") ) );
+   BOOST_REQUIRE_EQUAL( success(), bidname( "bob",   "prefb", core_sym::from_string("2.5000") ) );
+   BOOST_REQUIRE_EQUAL( success(), bidname( "bob",   "prefc", core_sym::from_string("4.0000") ) );
+   BOOST_REQUIRE_EQUAL( success(), bidname( "alice", "prefa", core_sym::from_string("2.0000") ) );
+   BOOST_REQUIRE_EQUAL( core_sym::from_string("95.0000"), get_balance("alice") );
+   BOOST_REQUIRE_EQUAL( core_sym::from_string("3.0000"), bid_refund( N(alice) ) );
+   BOOST_REQUIRE_EQUAL( core_sym::from_string("1.5000"), bid_refund( N(bob) ) );
+   BOOST_REQUIRE_EQUAL( core_sym::from_string("3.0000"), bid_refund( N(carl) ) );
+
+   // a bidder claims everything at once
+   BOOST_REQUIRE_EQUAL( error("missing authority of alice"),
+                        push_action( N(bob), N(claimbidref), mvo()("bidder", "alice") ) );
+   BOOST_REQUIRE_EQUAL( success(), push_action( N(alice), N(claimbidref), mvo()("bidder", "alice") ) );
+   BOOST_REQUIRE_EQUAL( core_sym::from_string("98.0000"), get_balance("alice") );
+   BOOST_REQUIRE_EQUAL( asset(), bid_refund( N(alice) ) );
+   BOOST_REQUIRE_EQUAL( wasm_assert_msg("refund not found"),
+                        push_action( N(alice), N(claimbidref), mvo()("bidder", "alice") ) );
+
+   // anyone can sweep the others in batches
+   BOOST_REQUIRE_EQUAL( wasm_assert_msg("max_rows must be positive"),
+                        push_action( N(alice), N(sweepbidrefs), mvo()("cursor", "")("max_rows", 0) ) );
+   BOOST_REQUIRE_EQUAL( success(), push_action( N(alice), N(sweepbidrefs), mvo()("cursor", "carl")("max_rows", 10) ) );
+   BOOST_REQUIRE_EQUAL( core_sym::from_string("100.0000"), get_balance("carl") );
+   BOOST_REQUIRE_EQUAL( core_sym::from_string("1.5000"), bid_refund( N(bob) ) );
+   BOOST_REQUIRE_EQUAL( success(), push_action( N(alice), N(sweepbidrefs), mvo()("cursor", "")("max_rows", 1) ) );
+   BOOST_REQUIRE_EQUAL( core_sym::from_string("93.5000"), get_balance("bob") );
+   BOOST_REQUIRE_EQUAL( wasm_assert_msg("no bid refunds to sweep"),
+                        push_action( N(alice), N(sweepbidrefs), mvo()("cursor", "")("max_rows", 10) ) );
+} FC_LOG_AND_RETHROW()
+
+BOOST_FIXTURE_TEST_CASE( namebid_close_index, eosio_system_tester ) try {
+   cross_15_percent_threshold();
+   produce_block( fc::hours(14*24) );    //wait 14 day for name auction activation
+   create_accounts_with_resources( { N(alice), N(bob) } );
+   transfer( config::system_account_name, N(alice), core_sym::from_string("100.0000") );
+   transfer( config::system_account_name, N(bob), core_sym::from_string("100.0000") );
+   auto high_bid = [&]( const account_name& newname ) {
+      vector<char> data = get_row_by_account( config::system_account_name, config::system_account_name, N(namebids), newname );
+      return abi_ser.binary_to_variant( "name_bid", data, abi_serializer_max_time )["high_bid"].as_int64();
+   };
+
+   // a new chain has nothing to migrate
+   BOOST_REQUIRE_EQUAL( wasm_assert_msg("name bids are already migrated"),
+                        push_action( config::system_account_name, N(migratebids), mvo()("max_rows", 10) ) );
+
+   BOOST_REQUIRE_EQUAL( success(), bidname( "alice", "prefa", core_sym::from_string("5.0000") ) );
+   BOOST_REQUIRE_EQUAL( success(), bidname( "bob",   "prefb", core_sym::from_string("1.0000") ) );
+   BOOST_REQUIRE_EQUAL( success(), bidname( "bob",   "prefc", core_sym::from_string("2.0000") ) );
+   produce_block( fc::hours(20) );
+   BOOST_REQUIRE_EQUAL( success(), bidname( "alice", "prefd", core_sym::from_string("1.0000") ) );
+   BOOST_REQUIRE_EQUAL( success(), bidname( "alice", "prefc", core_sym::from_string("3.0000") ) );
+
+   // the highest bid and every other auction without a bid for a day close together
+   produce_block( fc::hours(5) );
+   produce_block();
+   BOOST_REQUIRE_EQUAL( -50000, high_bid( N(prefa) ) );
+   BOOST_REQUIRE_EQUAL( -10000, high_bid( N(prefb) ) );
+   BOOST_REQUIRE_EQUAL(  30000, high_bid( N(prefc) ) );
+   BOOST_REQUIRE_EQUAL(  10000, high_bid( N(prefd) ) );
+   create_account_with_resources( N(prefb), N(bob) );
+
+   // the next settlement is a day later
+   produce_block( fc::hours(20) );
+   produce_block();
+   BOOST_REQUIRE_EQUAL(  30000, high_bid( N(prefc) ) );
+   produce_block( fc::hours(5) );
+   produce_block();
+   BOOST_REQUIRE_EQUAL( -30000, high_bid( N(prefc) ) );
+   BOOST_REQUIRE_EQUAL( -10000, high_bid( N(prefd) ) );
+} FC_LOG_AND_RETHROW()
+
 BOOST_FIXTURE_TEST_CASE( namebid_pending_winner, eosio_system_tester ) try {
    cross_15_percent_threshold();
    produce_block( fc::hours(14*24) );    //wait 14 day for name auction activation
@@ -3631,6 +4554,36 @@ BOOST_FIXTURE_TEST_CASE( setparams, eosio_system_tester ) try {
 
 } FC_LOG_AND_RETHROW()
 
+BOOST_FIXTURE_TEST_CASE( namelists, eosio_system_tester ) try {
+   auto update = []( const string& list, const string& action, const vector<account_name>& names ) {
+      return mvo()("list", list)("action", action)("names", names);
+   };
+
+   BOOST_REQUIRE_EQUAL( error("missing authority of eosio"),
+                        push_action( N(alice1111111), N(namelists), mvo()
+                                     ("updates", vector<mvo>{ update( "actor_blacklist", "insert", { N(bob111111111) } ) }) ) );
+   BOOST_REQUIRE_EQUAL( wasm_assert_msg("no list updates given"),
+                        push_action( config::system_account_name, N(namelists), mvo()("updates", vector<mvo>()) ) );
+   BOOST_REQUIRE_EQUAL( wasm_assert_msg(" unknown list type string  support 'actor_blacklist' ,'contract_blacklist', 'resource_greylist'"),
+                        push_action( config::system_account_name, N(namelists), mvo()
+                                     ("updates", vector<mvo>{ update( "producer_blacklist", "insert", { N(bob111111111) } ) }) ) );
+   BOOST_REQUIRE_EQUAL( wasm_assert_msg(" unknown list type string support 'insert' or 'remove'"),
+                        push_action( config::system_account_name, N(namelists), mvo()
+                                     ("updates", vector<mvo>{ update( "actor_blacklist", "erase", { N(bob111111111) } ) }) ) );
+   BOOST_REQUIRE_EQUAL( wasm_assert_msg("duplicate list update"),
+                        push_action( config::system_account_name, N(namelists), mvo()
+                                     ("updates", vector<mvo>{ update( "actor_blacklist", "insert", { N(bob111111111) } ),
+                                                              update( "resource_greylist", "insert", { N(bob111111111) } ),
+                                                              update( "actor_blacklist", "insert", { N(carol1111111) } ) }) ) );
+
+   // several lists in one action, and the same names through namelist
+   BOOST_REQUIRE_EQUAL( success(), push_action( config::system_account_name, N(namelists), mvo()
+                                                ("updates", vector<mvo>{ update( "actor_blacklist", "insert", { N(bob111111111), N(carol1111111) } ),
+                                                                         update( "resource_greylist", "insert", { N(bob111111111) } ) }) ) );
+   BOOST_REQUIRE_EQUAL( success(), push_action( config::system_account_name, N(namelist), mvo()
+                                                ("list", "resource_greylist")("action", "remove")("names", vector<account_name>{ N(bob111111111) }) ) );
+} FC_LOG_AND_RETHROW()
+
 BOOST_FIXTURE_TEST_CASE( setram_effect, eosio_system_tester ) try {
 
    const asset net = core_sym::from_string("8.0000");
@@ -3802,6 +4755,378 @@ BOOST_FIXTURE_TEST_CASE( ram_gift, eosio_system_tester ) try {
 
 } FC_LOG_AND_RETHROW()
 
+BOOST_AUTO_TEST_CASE( bancor_fixed_point_drift ) try {
+   // the floating point formulas used by exchange_state before the integer relay
+   auto double_to_exchange = []( int64_t supply, int64_t balance, int64_t in ) {
+      double R(supply), C(balance + in), T(in);
+      return int64_t( -R * (1.0 - std::pow( 1.0 + T / C, 0.5 )) );
+   };
+   auto double_from_exchange = []( int64_t supply, int64_t balance, int64_t in ) {
+      double R(supply - in), C(balance), E(in);
+      return int64_t( C * (std::pow( 1.0 + E / R, 2.0 ) - 1.0) );
+   };
+   // double results are only accurate to ~1e-15 relative, the integer relay is exact
+   auto check = []( int64_t fixed, int64_t dbl ) {
+      BOOST_REQUIRE_LE( std::abs( fixed - dbl ), 1 + std::abs( dbl ) / 100'000'000'000'000ll );
+   };
+
+   std::mt19937_64 rng( 1 );
+   for( int i = 0; i < 100000; ++i ) {
+      const int64_t supply  = 100000000000000ll + int64_t( rng() % 1000000000000000ll );
+      const int64_t balance = 1 + int64_t( rng() % (1ll << (10 + rng() % 43)) );
+      const int64_t in      = 1 + int64_t( rng() % (1ll << (1 + rng() % 46)) );
+      check( eosiosystem::bancor::to_exchange( supply, balance, in ), double_to_exchange( supply, balance, in ) );
+
+      const int64_t sold = 1 + int64_t( rng() % (supply / 4) );
+      check( eosiosystem::bancor::from_exchange( supply, balance, sold ), double_from_exchange( supply, balance, sold ) );
+   }
+
+   // initial RAM market of the test chain: 64 GiB against 1/1000 of the core supply
+   const int64_t ramcore = 100000000000000ll, ram = 64ll*1024*1024*1024, core = 1000000000ll;
+   BOOST_REQUIRE_EQUAL( 0, eosiosystem::bancor::to_exchange( ramcore, core, 0 ) );
+   BOOST_REQUIRE_EQUAL( 0, eosiosystem::bancor::from_exchange( ramcore, ram, 0 ) );
+   check( eosiosystem::bancor::to_exchange( ramcore, core, 1990000 ), double_to_exchange( ramcore, core, 1990000 ) );
+   check( eosiosystem::bancor::from_exchange( ramcore, ram, 99500000000ll ), double_from_exchange( ramcore, ram, 99500000000ll ) );
+} FC_LOG_AND_RETHROW()
+
+BOOST_AUTO_TEST_CASE( bancor_closed_form ) try {
+   using namespace eosiosystem;
+
+   std::mt19937_64 rng( 2 );
+   for( int i = 0; i < 100000; ++i ) {
+      const int64_t ramcore = 100000000000000ll + int64_t( rng() % 1000000000000ll );
+      const int64_t core    = 1 + int64_t( rng() % 10000000000000ll );
+      const int64_t ram     = 1000 + int64_t( rng() % 100000000000ll );
+      const int64_t quant   = 1 + int64_t( rng() % 100000000000ll );
+
+      // both legs through RAMCORE give the closed form up to the rounding of the intermediate RAMCORE
+      const int64_t issued   = bancor::to_exchange( ramcore, core, quant );
+      const int64_t two_legs = bancor::from_exchange( ramcore + issued, ram, issued );
+      const int64_t direct   = bancor::output( core, ram, quant );
+      BOOST_REQUIRE_LE( two_legs, direct );
+      BOOST_REQUIRE_LE( direct, two_legs + 1 );
+
+      // input() is the smallest amount that buys the requested bytes
+      const int64_t bytes = int64_t( rng() % (ram / 2) );
+      const int64_t cost  = bancor::input( ram, core, bytes );
+      BOOST_REQUIRE_LE( bytes, bancor::output( core, ram, cost ) );
+      if( cost > 0 ) {
+         BOOST_REQUIRE_LT( bancor::output( core, ram, cost - 1 ), bytes );
+      }
+   }
+} FC_LOG_AND_RETHROW()
+
+BOOST_AUTO_TEST_CASE( fixed_point_vote_weight ) try {
+   using namespace eosiosystem;
+
+   // weights of a stake of more than a few units on a chain past 2018 have no bits below 2^-32 and convert exactly
+   std::mt19937_64 rng( 3 );
+   for( int i = 0; i < 100000; ++i ) {
+      const double weight = double( 4 + rng() % 100000000000000ll ) * std::pow( 2, (940 + rng() % 1000) / double(52) );
+      BOOST_REQUIRE_EQUAL( weight, votes::to_double( votes::from_double( weight ) ) );
+
+      // adding a vote weight change rounds like the double addition it replaces
+      const double delta = double( 4 + rng() % 100000000000000ll ) * std::pow( 2, (940 + rng() % 1000) / double(52) );
+      BOOST_REQUIRE_EQUAL( weight + delta, votes::to_double( votes::add( votes::from_double( weight ), votes::change( votes::from_double( delta ) ) ) ) );
+
+      // since 2020 the weight of a stake is the exact product that the double code rounds
+      const int64_t staked = 1 + rng() % 100000000000000ll;
+      const double per_token = std::pow( 2, (1044 + rng() % 1000) / double(52) );
+      BOOST_REQUIRE_EQUAL( double(staked) * per_token, votes::to_double( votes::stake_weight( staked, votes::from_double( per_token ) ) ) );
+   }
+   BOOST_REQUIRE( votes::fixed(0) == votes::from_double( -1e-9 ) );
+   BOOST_REQUIRE( votes::fixed(0) == votes::add( votes::from_double( 10 ), -votes::change( votes::from_double( 10.5 ) ) ) );
+   BOOST_REQUIRE( votes::from_double( 10 ) == votes::add( votes::from_double( 10.5 ), -votes::change( votes::from_double( 0.5 ) ) ) );
+   BOOST_REQUIRE_EQUAL( -0.5, votes::to_double( -votes::change( votes::from_double( 0.5 ) ) ) );
+
+   // weights past max_weight fail instead of wrapping, a total stake of 1e14 units stays in range until about 2048
+   BOOST_REQUIRE( votes::max_weight == votes::add( votes::max_weight - 1, 1 ) );
+   BOOST_CHECK_THROW( votes::add( votes::max_weight, 1 ), std::out_of_range );
+   BOOST_CHECK_THROW( votes::from_double( 1e30 ), std::out_of_range );
+   BOOST_CHECK_NO_THROW( votes::stake_weight( 100000000000000ll, votes::from_double( std::pow( 2, 2496 / double(52) ) ) ) );
+   BOOST_CHECK_THROW( votes::stake_weight( 100000000000000ll, votes::from_double( std::pow( 2, 2600 / double(52) ) ) ), std::out_of_range );
+
+   // the vote index orders producers like the double key (-votes for active producers) did
+   auto double_key = []( double weight, bool active ) { return active ? -weight : weight; };
+   for( int i = 0; i < 100000; ++i ) {
+      const double a = double( rng() % 1000000000000ll ) * 1048576.0, b = double( rng() % 1000000000000ll ) * 1048576.0;
+      const bool a_active = rng() % 2, b_active = rng() % 2;
+      if( double_key( a, a_active ) == double_key( b, b_active ) )
+         continue;
+      BOOST_REQUIRE_EQUAL( double_key( a, a_active ) < double_key( b, b_active ),
+                           votes::index_key( votes::from_double( a ), a_active ) < votes::index_key( votes::from_double( b ), b_active ) );
+   }
+   // zero votes of an active producer sort before those of an inactive one, -0.0 == 0.0 tied them
+   BOOST_REQUIRE( votes::index_key( 0, true ) < votes::index_key( 0, false ) );
+
+   // weights differing only below the precision of a double are still ordered exactly
+   const votes::fixed big = votes::fixed(1) << 100;
+   BOOST_REQUIRE_EQUAL( votes::to_double( big ), votes::to_double( big + 1 ) );
+   BOOST_REQUIRE( votes::index_key( big + 1, true ) < votes::index_key( big, true ) );
+} FC_LOG_AND_RETHROW()
+
+BOOST_AUTO_TEST_CASE( producer_slot_encoding ) try {
+   using namespace eosiosystem;
+
+   std::mt19937_64 rng( 5 );
+   for( int i = 0; i < 10000; ++i ) {
+      // slots of a few hundred producers, and arbitrary ones
+      const uint64_t range = i % 2 ? 1000 : std::numeric_limits<uint64_t>::max();
+      const size_t n = rng() % 31;
+      std::set<uint64_t> ids;
+      while( ids.size() < n ) {
+         ids.insert( rng() % range );
+      }
+      std::vector<uint64_t> shuffled( ids.begin(), ids.end() );
+      std::shuffle( shuffled.begin(), shuffled.end(), rng );
+
+      const auto bytes = slots::encode( shuffled );
+      BOOST_REQUIRE( std::vector<uint64_t>( ids.begin(), ids.end() ) == slots::decode( bytes ) );
+      if( range == 1000 ) {
+         BOOST_REQUIRE_LE( bytes.size(), 2 * n ); // gaps below 2^14 take at most two bytes
+      }
+   }
+   BOOST_REQUIRE( slots::encode( {} ).empty() );
+   BOOST_REQUIRE( slots::decode( {} ).empty() );
+
+   // 30 producers among the first 128 slots take a byte each
+   std::vector<uint64_t> first( 30 );
+   std::iota( first.begin(), first.end(), 0 );
+   BOOST_REQUIRE_EQUAL( 30u, slots::encode( first ).size() );
+} FC_LOG_AND_RETHROW()
+
+BOOST_AUTO_TEST_CASE( producer_pay_math ) try {
+   using namespace eosiosystem;
+
+   // a year of 2% continuous inflation on 10^9 tokens
+   const int64_t supply = 1'000'000'000'0000;
+   BOOST_REQUIRE_EQUAL( 20'000'000'0000, pay::inflation( 0.02, supply, pay::useconds_per_year ) );
+   BOOST_REQUIRE_EQUAL( 0, pay::inflation( 0.02, supply, 0 ) );
+
+   std::mt19937_64 rng( 11 );
+   for( int i = 0; i < 10000; ++i ) {
+      const int64_t new_tokens = rng() % (int64_t(1) << 50);
+      const auto s = pay::split_inflation( new_tokens );
+      BOOST_REQUIRE_EQUAL( new_tokens, s.per_block + s.per_vote + s.gov_fund + s.dev_fund );
+      BOOST_REQUIRE_EQUAL( (new_tokens / 2) / 4, s.per_block );
+      BOOST_REQUIRE_EQUAL( (new_tokens - new_tokens / 2) / 5, s.gov_fund );
+   }
+
+   BOOST_REQUIRE_EQUAL( 0, pay::per_block_pay( 1000, 0, 0 ) );
+   BOOST_REQUIRE_EQUAL( 250, pay::per_block_pay( 1000, 12, 48 ) );
+   BOOST_REQUIRE_EQUAL( 1000, pay::per_block_pay( 1000, 48, 48 ) );
+
+   BOOST_REQUIRE_EQUAL( 0, pay::per_vote_pay( 1.0, 1000'0000, 0.0, 100'0000 ) );
+   BOOST_REQUIRE_EQUAL( 250'0000, pay::per_vote_pay( 1.0, 1000'0000, 4.0, 100'0000 ) );
+   BOOST_REQUIRE_EQUAL( 0, pay::per_vote_pay( 1.0, 1000'0000, 20.0, 100'0000 ) );         // below the minimum daily pay
+   BOOST_REQUIRE_EQUAL( 1000'0000, pay::per_vote_pay( 2.0, 1000'0000, 1.0, 100'0000 ) );  // never more than the bucket
+
+   BOOST_REQUIRE_EQUAL( 0.0, pay::accrued_share( 5.0, 10'000'000, 10'000'000 ) );
+   BOOST_REQUIRE_EQUAL( 0.0, pay::accrued_share( 5.0, 10'000'000, 9'000'000 ) );
+   BOOST_REQUIRE_EQUAL( 0.0, pay::accrued_share( 0.0, 0, 10'000'000 ) );
+   BOOST_REQUIRE_EQUAL( 50.0, pay::accrued_share( 5.0, 0, 10'000'000 ) );
+
+   pay::votepay_totals totals{ 100.0, 2.0, 0 };
+   BOOST_REQUIRE_EQUAL( 120.0, pay::update_totals( totals, 10'000'000, 0.0, 0.0 ) );
+   BOOST_REQUIRE_EQUAL( 10'000'000, totals.last_update );
+   BOOST_REQUIRE_EQUAL( 120.0, pay::update_totals( totals, 5'000'000, 0.0, 0.0 ) );       // time does not go backwards
+   BOOST_REQUIRE_EQUAL( 0.0, pay::update_totals( totals, 5'000'000, -500.0, -3.0 ) );     // both clamped at zero
+   BOOST_REQUIRE_EQUAL( 0.0, totals.change_rate );
+   BOOST_REQUIRE_EQUAL( 7.0, pay::update_totals( totals, 5'000'000, 7.0, 1.5 ) );
+   BOOST_REQUIRE_EQUAL( 1.5, totals.change_rate );
+
+   const int64_t day = pay::useconds_per_day;
+   BOOST_REQUIRE( !pay::crossed_claim_threshold( 0, 3 * day - 1 ) );
+   BOOST_REQUIRE( pay::crossed_claim_threshold( 0, 3 * day ) );
+   BOOST_REQUIRE( !pay::claim_allowed( 0, day ) );
+   BOOST_REQUIRE( pay::claim_allowed( 0, day + 1 ) );
+
+   // a producer claiming within three days is paid for its share and keeps counting towards the rate
+   pay::votepay_totals claim_totals{ 0.0, 30.0, 0 };
+   pay::producer_votepay vp{ 0.0, 0 };
+   auto status = pay::get_votepay_status( true, 0, 0, 2 * day );
+   BOOST_REQUIRE( !status.crossed_threshold && !status.updated_after_threshold );
+   const int64_t claimed = pay::claim_vote_pay( vp, claim_totals, 3000'0000, 10.0, status, 2 * day );
+   BOOST_REQUIRE_EQUAL( 1000'0000, claimed );
+   BOOST_REQUIRE_EQUAL( 0.0, vp.share );
+   BOOST_REQUIRE_EQUAL( 30.0, claim_totals.change_rate );
+
+   // after three days without a claim a vote change resets the share once and takes the votes out of the rate
+   status = pay::get_votepay_status( true, 2 * day, 2 * day, 6 * day );
+   BOOST_REQUIRE( status.crossed_threshold && !status.updated_after_threshold );
+   pay::votepay_changes changes;
+   pay::change_votes( vp, changes, 10 * votes::one, 12 * votes::one, status, 6 * day );
+   BOOST_REQUIRE_EQUAL( 0.0, vp.share );
+   BOOST_REQUIRE_EQUAL( -10.0, votes::to_double( changes.rate_delta ) );
+   BOOST_REQUIRE_EQUAL( 10.0 * 4 * 24 * 3600, changes.inactive_share );
+   pay::apply_changes( claim_totals, changes, 6 * day );
+   BOOST_REQUIRE_EQUAL( 20.0, claim_totals.change_rate );
+
+   // its next claim pays nothing and puts the votes back into the rate
+   status = pay::get_votepay_status( true, 2 * day, 6 * day, 7 * day );
+   BOOST_REQUIRE( status.updated_after_threshold );
+   BOOST_REQUIRE_EQUAL( 0, pay::claim_vote_pay( vp, claim_totals, 3000'0000, 12.0, status, 7 * day ) );
+   BOOST_REQUIRE_EQUAL( 32.0, claim_totals.change_rate );
+
+   // a producer without vote pay tracking is not touched by vote changes
+   pay::votepay_changes untracked;
+   pay::change_votes( vp, untracked, votes::one, 2 * votes::one, pay::get_votepay_status( false, 0, 0, day ), day );
+   BOOST_REQUIRE( untracked.rate_delta == 0 );
+
+   // the highest bid and up to names_per_close - 1 more, or names_per_close more if it does not count
+   uint32_t candidates = 20;
+   BOOST_REQUIRE_EQUAL( pay::names_per_close, pay::close_names( true, [&]() { return candidates-- > 0; } ) );
+   BOOST_REQUIRE_EQUAL( 11u, candidates );
+   candidates = 3;
+   BOOST_REQUIRE_EQUAL( 3u, pay::close_names( false, [&]() { return candidates > 0 && candidates--; } ) );
+
+   BOOST_REQUIRE( !pay::name_close_due( pay::blocks_per_day, 0 ) );
+   BOOST_REQUIRE( pay::name_close_due( pay::blocks_per_day + 1, 0 ) );
+
+   const int64_t now = 100 * day;
+   BOOST_REQUIRE( pay::name_auction_closes( 1, now - day - 1, now - 14 * day - 1, now ) );
+   BOOST_REQUIRE( !pay::name_auction_closes( 0, now - day - 1, now - 14 * day - 1, now ) );  // no open bid
+   BOOST_REQUIRE( !pay::name_auction_closes( 1, now - day, now - 14 * day - 1, now ) );      // bid within a day
+   BOOST_REQUIRE( !pay::name_auction_closes( 1, now - day - 1, now - 14 * day, now ) );      // activated two weeks ago
+   BOOST_REQUIRE( !pay::name_auction_closes( 1, now - day - 1, 0, now ) );                   // never activated
+} FC_LOG_AND_RETHROW()
+
+BOOST_FIXTURE_TEST_CASE( buyrambytes_exact, eosio_system_tester ) try {
+   transfer( "eosio", "alice1111111", core_sym::from_string("1000.0000"), "eosio" );
+
+   for( uint32_t bytes : { 1u, 100u, 1024u, 8000u, 100000u, 10000000u } ) {
+      const uint64_t before = get_total_stake( "alice1111111" )["ram_bytes"].as_uint64();
+      BOOST_REQUIRE_EQUAL( success(), buyrambytes( "alice1111111", "alice1111111", bytes ) );
+      const uint64_t bought = get_total_stake( "alice1111111" )["ram_bytes"].as_uint64() - before;
+      // at least what was asked for, at most what the 0.0001 granularity of the price and fee allows
+      BOOST_REQUIRE_LE( bytes, bought );
+      BOOST_REQUIRE_LE( bought, bytes + 1000 );
+      produce_block();
+   }
+
+   BOOST_REQUIRE_EQUAL( wasm_assert_msg("must purchase a positive amount"),
+                        buyrambytes( "alice1111111", "alice1111111", 0 ) );
+} FC_LOG_AND_RETHROW()
+
+BOOST_FIXTURE_TEST_CASE( buyrambatch, eosio_system_tester ) try {
+   transfer( "eosio", "alice1111111", core_sym::from_string("1000.0000"), "eosio" );
+   auto ram_bytes = [&]( account_name a ) { return get_total_stake( a )["ram_bytes"].as_uint64(); };
+
+   BOOST_REQUIRE_EQUAL( error("missing authority of alice1111111"),
+                        push_action( N(bob111111111), N(buyrambatch), mvo()
+                                     ("payer", "alice1111111")("purchases", ram_purchases( { { N(bob111111111), 1000 } } )) ) );
+   BOOST_REQUIRE_EQUAL( wasm_assert_msg("no receivers given"), buyrambatch( N(alice1111111), {} ) );
+   BOOST_REQUIRE_EQUAL( wasm_assert_msg("must purchase a positive amount"),
+                        buyrambatch( N(alice1111111), { { N(bob111111111), 1000 }, { N(carol1111111), 0 } } ) );
+
+   const uint64_t bob_before = ram_bytes( N(bob111111111) ), carol_before = ram_bytes( N(carol1111111) );
+   const asset alice_before = get_balance( "alice1111111" ), ram_before = get_balance( N(eosio.ram) );
+
+   // one transfer pays for all receivers, the first one also gets the rounding bytes
+   auto trace = base_tester::push_action( config::system_account_name, N(buyrambatch), N(alice1111111), mvo()
+                                          ("payer", "alice1111111")
+                                          ("purchases", ram_purchases( { { N(carol1111111), 5000 }, { N(bob111111111), 1000 } } )) );
+   produce_block();
+   BOOST_REQUIRE_EQUAL( 1, std::count_if( trace->action_traces.begin(), trace->action_traces.end(), []( const auto& at ) {
+      return at.receiver == N(eosio.token) && at.act.name == N(transfer);
+   }) );
+   BOOST_REQUIRE_EQUAL( bob_before + 1000, ram_bytes( N(bob111111111) ) );
+   BOOST_REQUIRE_LE( carol_before + 5000, ram_bytes( N(carol1111111) ) );
+   BOOST_REQUIRE_LE( ram_bytes( N(carol1111111) ), carol_before + 5000 + 1000 );
+   BOOST_REQUIRE_EQUAL( alice_before - get_balance( "alice1111111" ), get_balance( N(eosio.ram) ) - ram_before );
+   int64_t ram, net, cpu;
+   control->get_resource_limits_manager().get_account_limits( N(bob111111111), ram, net, cpu );
+   BOOST_REQUIRE_EQUAL( int64_t( ram_bytes( N(bob111111111) ) ) + 1400 /* ram_gift_bytes */, ram );
+} FC_LOG_AND_RETHROW()
+
+BOOST_FIXTURE_TEST_CASE( newacctres, eosio_system_tester ) try {
+   transfer( "eosio", "alice1111111", core_sym::from_string("1000.0000"), "eosio" );
+   BOOST_REQUIRE_EQUAL( success(), stake( "alice1111111", core_sym::from_string("10.0000"), core_sym::from_string("10.0000") ) );
+
+   BOOST_REQUIRE_EQUAL( wasm_assert_msg("must purchase a positive amount"),
+                        newacctres( N(alice1111111), N(dave11111111), 0, core_sym::from_string("1.0000"), core_sym::from_string("1.0000") ) );
+   BOOST_REQUIRE_EQUAL( wasm_assert_msg("must stake a positive amount"),
+                        newacctres( N(alice1111111), N(dave11111111), 8000, core_sym::from_string("-1.0000"), core_sym::from_string("1.0000") ) );
+   // the account must not exist yet, nothing is bought or staked for it
+   const asset    alice_before  = get_balance( "alice1111111" );
+   const int64_t  staked_before = get_voter_info( "alice1111111" )["staked"].as_int64();
+   const uint64_t bob_ram       = get_total_stake( "bob111111111" )["ram_bytes"].as_uint64();
+   BOOST_REQUIRE_EQUAL( wasm_assert_msg("account already exists"),
+                        newacctres( N(alice1111111), N(bob111111111), 8000, core_sym::from_string("1.0000"), core_sym::from_string("1.0000") ) );
+   BOOST_REQUIRE_EQUAL( alice_before, get_balance( "alice1111111" ) );
+   BOOST_REQUIRE_EQUAL( staked_before, get_voter_info( "alice1111111" )["staked"].as_int64() );
+   BOOST_REQUIRE_EQUAL( bob_ram, get_total_stake( "bob111111111" )["ram_bytes"].as_uint64() );
+   BOOST_REQUIRE( get_row_by_account( config::system_account_name, N(alice1111111), N(delband), N(bob111111111) ).empty() );
+   BOOST_REQUIRE( get_row_by_account( config::system_account_name, config::system_account_name, N(pendacctres), N(bob111111111) ).empty() );
+
+   BOOST_REQUIRE_EQUAL( success(), newacctres( N(alice1111111), N(dave11111111), 8000,
+                                               core_sym::from_string("10.0000"), core_sym::from_string("5.0000") ) );
+   BOOST_REQUIRE( control->db().find<account_object, by_name>( N(dave11111111) ) != nullptr );
+
+   auto total = get_total_stake( "dave11111111" );
+   const uint64_t ram_bytes = total["ram_bytes"].as_uint64();
+   BOOST_REQUIRE_LE( 8000u, ram_bytes );
+   BOOST_REQUIRE_LE( ram_bytes, 9000u );
+   BOOST_REQUIRE_EQUAL( core_sym::from_string("10.0000"), total["net_weight"].as<asset>() );
+   BOOST_REQUIRE_EQUAL( core_sym::from_string("5.0000"), total["cpu_weight"].as<asset>() );
+
+   int64_t ram, net, cpu;
+   control->get_resource_limits_manager().get_account_limits( N(dave11111111), ram, net, cpu );
+   BOOST_REQUIRE_EQUAL( int64_t(ram_bytes) + 1400 /* ram_gift_bytes */, ram );
+   BOOST_REQUIRE_EQUAL( 100000, net );
+   BOOST_REQUIRE_EQUAL( 50000, cpu );
+
+   // the stake stays with alice1111111, the pending resources are gone
+   BOOST_REQUIRE_EQUAL( core_sym::from_string("35.0000").get_amount(), get_voter_info( "alice1111111" )["staked"].as_int64() );
+   BOOST_REQUIRE( alice_before - core_sym::from_string("15.0000") > get_balance( "alice1111111" ) );
+   BOOST_REQUIRE( get_row_by_account( config::system_account_name, config::system_account_name, N(pendacctres), N(dave11111111) ).empty() );
+
+   // the new account can use its resources right away
+   transfer( "eosio", "dave11111111", core_sym::from_string("10.0000"), "eosio" );
+   BOOST_REQUIRE_EQUAL( success(), stake( "dave11111111", core_sym::from_string("1.0000"), core_sym::from_string("1.0000") ) );
+} FC_LOG_AND_RETHROW()
+
+BOOST_FIXTURE_TEST_CASE( split_global_state, eosio_system_tester ) try {
+   auto raw_row = [&]( name table ) {
+      return get_row_by_account( config::system_account_name, config::system_account_name, table, table );
+   };
+
+   transfer( "eosio", "alice1111111", core_sym::from_string("1000.0000"), "eosio" );
+   BOOST_REQUIRE_EQUAL( success(), buyram( "alice1111111", "alice1111111", core_sym::from_string("100.0000") ) );
+   produce_blocks(2);
+
+   const auto ghot = get_global_hot_state();
+   BOOST_REQUIRE( ghot.is_object() );
+   BOOST_REQUIRE_LT( 0, ghot["total_ram_stake"].as_int64() );
+
+   // onblock only touches the hot row
+   const auto global_before  = raw_row( N(global) );
+   const auto global2_before = raw_row( N(global2) );
+   produce_blocks(10);
+   BOOST_REQUIRE( global_before  == raw_row( N(global) ) );
+   BOOST_REQUIRE( global2_before == raw_row( N(global2) ) );
+   BOOST_REQUIRE( raw_row( N(globalhot) ) != vector<char>() );
+
+   BOOST_REQUIRE_EQUAL( error("missing authority of eosio"),
+                        push_action( N(alice1111111), N(splitgstate), mvo() ) );
+
+   const auto total_ram_stake = get_global_state()["total_ram_stake"].as_int64();
+   BOOST_REQUIRE_EQUAL( success(), push_action( config::system_account_name, N(splitgstate), mvo() ) );
+
+   const auto cold = abi_ser.binary_to_variant( "eosio_global_state", raw_row( N(global) ), abi_serializer_max_time );
+   BOOST_REQUIRE_EQUAL( 0, cold["total_ram_stake"].as_int64() );
+   BOOST_REQUIRE_EQUAL( 0, cold["total_ram_bytes_reserved"].as_int64() );
+   BOOST_REQUIRE_EQUAL( total_ram_stake, get_global_hot_state()["total_ram_stake"].as_int64() );
+   BOOST_REQUIRE_EQUAL( total_ram_stake, get_global_state()["total_ram_stake"].as_int64() );
+
+   // running it again changes nothing
+   BOOST_REQUIRE_EQUAL( success(), push_action( config::system_account_name, N(splitgstate), mvo() ) );
+   BOOST_REQUIRE_EQUAL( total_ram_stake, get_global_hot_state()["total_ram_stake"].as_int64() );
+
+   BOOST_REQUIRE_EQUAL( success(), sellram( "alice1111111", 1024 ) );
+   BOOST_REQUIRE_GT( total_ram_stake, get_global_hot_state()["total_ram_stake"].as_int64() );
+} FC_LOG_AND_RETHROW()
+
 BOOST_FIXTURE_TEST_CASE( setabi_bios, TESTER ) try {
    abi_serializer abi_ser(fc::json::from_string( (const char*)contracts::system_abi().data()).template as<abi_def>(), abi_serializer_max_time);
    set_code( config::system_account_name, contracts::bios_wasm() );
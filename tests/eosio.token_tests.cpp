@@ -346,6 +346,60 @@ BOOST_FIXTURE_TEST_CASE( transfer_tests, eosio_token_tester ) try {
 
 } FC_LOG_AND_RETHROW()
 
+BOOST_FIXTURE_TEST_CASE( transfers_tests, eosio_token_tester ) try {
+
+   create( N(alice), asset::from_string("1000 CERO") );
+   create( N(alice), asset::from_string("1000 TRES") );
+   issue( N(alice), N(alice), asset::from_string("1000 CERO"), "hola" );
+   issue( N(alice), N(alice), asset::from_string("1000 TRES"), "hola" );
+   produce_blocks(1);
+
+   auto xfer = []( account_name from, account_name to, const string& quantity ) {
+      return mvo()( "from", from )( "to", to )( "quantity", quantity )( "memo", "hola" );
+   };
+
+   BOOST_REQUIRE_EQUAL( wasm_assert_msg( "no transfers given" ),
+      push_action( N(alice), N(transfers), mvo()( "transfers", variants() ) )
+   );
+   BOOST_REQUIRE_EQUAL( wasm_assert_msg( "all transfers must be of one token" ),
+      push_action( N(alice), N(transfers), mvo()( "transfers", variants{ xfer( N(alice), N(bob), "100 CERO" ),
+                                                                         xfer( N(alice), N(bob), "100 TRES" ) } ) )
+   );
+   BOOST_REQUIRE_EQUAL( wasm_assert_msg( "overdrawn balance" ),
+      push_action( N(alice), N(transfers), mvo()( "transfers", variants{ xfer( N(alice), N(bob), "600 CERO" ),
+                                                                         xfer( N(alice), N(carol), "401 CERO" ) } ) )
+   );
+   BOOST_REQUIRE_EQUAL( success(),
+      push_action( N(alice), N(transfers), mvo()( "transfers", variants{ xfer( N(alice), N(bob), "300 CERO" ),
+                                                                         xfer( N(alice), N(carol), "200 CERO" ) } ) )
+   );
+   REQUIRE_MATCHING_OBJECT( get_account(N(alice), "0,CERO"), mvo()("balance", "500 CERO") );
+   REQUIRE_MATCHING_OBJECT( get_account(N(bob), "0,CERO"), mvo()("balance", "300 CERO") );
+   REQUIRE_MATCHING_OBJECT( get_account(N(carol), "0,CERO"), mvo()("balance", "200 CERO") );
+
+   // transfers run in order and each one needs the authority of its sender
+   BOOST_REQUIRE_EQUAL( error( "missing authority of bob" ),
+      push_action( N(alice), N(transfers), mvo()( "transfers", variants{ xfer( N(alice), N(bob), "100 CERO" ),
+                                                                         xfer( N(bob), N(carol), "400 CERO" ) } ) )
+   );
+   auto trace = base_tester::push_action( N(eosio.token), N(transfers), vector<account_name>{ N(alice), N(bob) },
+                                          mvo()( "transfers", variants{ xfer( N(alice), N(bob), "100 CERO" ),
+                                                                        xfer( N(bob), N(carol), "400 CERO" ) } ) );
+   REQUIRE_MATCHING_OBJECT( get_account(N(alice), "0,CERO"), mvo()("balance", "400 CERO") );
+   REQUIRE_MATCHING_OBJECT( get_account(N(bob), "0,CERO"), mvo()("balance", "0 CERO") );
+   REQUIRE_MATCHING_OBJECT( get_account(N(carol), "0,CERO"), mvo()("balance", "600 CERO") );
+
+   // every sender and recipient is notified once
+   std::set<account_name> notified;
+   for( const auto& at : trace->action_traces ) {
+      if( at.receiver != N(eosio.token) ) {
+         BOOST_REQUIRE( notified.insert( at.receiver ).second );
+      }
+   }
+   BOOST_REQUIRE( (std::set<account_name>{ N(alice), N(bob), N(carol) }) == notified );
+
+} FC_LOG_AND_RETHROW()
+
 BOOST_FIXTURE_TEST_CASE( open_tests, eosio_token_tester ) try {
 
    auto token = create( N(alice), asset::from_string("1000 CERO"));
@@ -0,0 +1,311 @@
+/**
+ *  @file
+ *  @copyright defined in eos/LICENSE.txt
+ *
+ *  Deterministic simulator of the producer pay economics of eosio.system.
+ *
+ *  Replays years of block production, vote changes, claimrewards and name auction closes with the
+ *  arithmetic of eosio.system/producer_pay_math.hpp, the same code onblock, claimrewards and the
+ *  vote pay accounting of voting.cpp run, so a change to continuous_rate or to the bucket math can
+ *  be checked over the lifetime of a chain in seconds instead of on a running node.
+ *
+ *  Blocks are produced a round at a time: the 21 producers with the most votes produce 12 blocks
+ *  each, every round moves the clock by 126 seconds. Everything random comes from one seeded
+ *  generator, the same arguments always print the same report. The run fails if the global vote
+ *  pay total drifts from the sum of the producer shares or a pay bucket is overdrawn.
+ *
+ *  usage: economics_sim [--years N] [--rate R] [--producers N] [--seed N]
+ */
+#include <eosio.system/producer_pay_math.hpp>
+
+#include <algorithm>
+#include <cinttypes>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <random>
+#include <vector>
+
+using namespace eosiosystem;
+
+namespace {
+
+   const uint32_t schedule_size         = 21;
+   const uint32_t blocks_per_producer   = 12;
+   const int64_t  useconds_per_block    = 500'000;
+   const int64_t  useconds_per_hour     = 3600 * int64_t(1000000);
+   const double   max_votepay_drift     = 1e-6; /// relative, a millionth of the vote pay bucket
+
+   struct options {
+      uint32_t years     = 10;
+      double   rate      = pay::continuous_rate;
+      uint32_t producers = 30;
+      uint64_t seed      = 1;
+   };
+
+   /// producer_tally and producer_info of one producer
+   struct producer {
+      votes::fixed          total_votes         = 0;
+      uint32_t              unpaid_blocks       = 0;
+      int64_t               last_claim_time     = 0;
+      pay::producer_votepay votepay;
+      int64_t               next_claim_time     = 0;
+      uint32_t              claim_interval_days = 1; /// more than 3 lets the producer fall behind the claim threshold
+      int64_t               paid_bpay           = 0;
+      int64_t               paid_vpay           = 0;
+
+      pay::votepay_status votepay_status( int64_t now )const {
+         return pay::get_votepay_status( true, last_claim_time, votepay.last_update, now );
+      }
+   };
+
+   struct name_bid {
+      int64_t high_bid      = 0; /// negative once closed, like name_bid; closed bids are dropped
+      int64_t last_bid_time = 0;
+   };
+
+   /// globalhot, global2 and global3 fields the pay math touches
+   struct chain_state {
+      int64_t             now                      = 0;
+      uint32_t            slot                     = 0;
+      int64_t             activated_time           = 0;
+      int64_t             core_supply              = 0;
+      int64_t             perblock_bucket          = 0;
+      int64_t             pervote_bucket           = 0;
+      uint32_t            total_unpaid_blocks      = 0;
+      int64_t             last_pervote_bucket_fill = 0;
+      uint32_t            last_name_close_slot     = 0;
+      pay::votepay_totals votepay;
+
+      int64_t gov_fund  = 0;
+      int64_t dev_fund  = 0;
+      int64_t bpay_paid = 0;
+      int64_t vpay_paid = 0;
+      uint32_t claims       = 0;
+      uint32_t vote_changes = 0;
+      uint32_t names_closed = 0;
+   };
+
+   void usage( const char* prog ) {
+      std::fprintf( stderr, "usage: %s [--years N] [--rate R] [--producers N] [--seed N]\n", prog );
+      std::exit( 2 );
+   }
+
+   options parse_options( int argc, char** argv ) {
+      options opts;
+      for( int i = 1; i < argc; ++i ) {
+         if( i + 1 >= argc )
+            usage( argv[0] );
+         const char* value = argv[++i];
+         if( !std::strcmp( argv[i-1], "--years" ) )
+            opts.years = std::strtoul( value, nullptr, 10 );
+         else if( !std::strcmp( argv[i-1], "--rate" ) )
+            opts.rate = std::strtod( value, nullptr );
+         else if( !std::strcmp( argv[i-1], "--producers" ) )
+            opts.producers = std::strtoul( value, nullptr, 10 );
+         else if( !std::strcmp( argv[i-1], "--seed" ) )
+            opts.seed = std::strtoull( value, nullptr, 10 );
+         else
+            usage( argv[0] );
+      }
+      if( opts.years == 0 || opts.producers < schedule_size || opts.rate < 0 )
+         usage( argv[0] );
+      return opts;
+   }
+
+   /// system_contract::claimrewards with vote pay tracking enabled (global2 revision > 0)
+   void claimrewards( chain_state& s, producer& p, double rate ) {
+      if( !pay::claim_allowed( p.last_claim_time, s.now ) )
+         return; // already claimed rewards within past day
+
+      if( pay::bucket_fill_due( s.last_pervote_bucket_fill, s.now ) ) {
+         const int64_t new_tokens = pay::inflation( rate, s.core_supply, s.now - s.last_pervote_bucket_fill );
+         const auto split = pay::split_inflation( new_tokens );
+
+         s.core_supply              += new_tokens;
+         s.gov_fund                 += split.gov_fund;
+         s.dev_fund                 += split.dev_fund;
+         s.pervote_bucket           += split.per_vote;
+         s.perblock_bucket          += split.per_block;
+         s.last_pervote_bucket_fill  = s.now;
+      }
+
+      const auto    status        = p.votepay_status( s.now );
+      const int64_t per_block_pay = pay::per_block_pay( s.perblock_bucket, p.unpaid_blocks, s.total_unpaid_blocks );
+      const int64_t per_vote_pay  = pay::claim_vote_pay( p.votepay, s.votepay, s.pervote_bucket,
+                                                         votes::to_double( p.total_votes ), status, s.now );
+      p.last_claim_time = s.now;
+
+      s.pervote_bucket      -= per_vote_pay;
+      s.perblock_bucket     -= per_block_pay;
+      s.total_unpaid_blocks -= p.unpaid_blocks;
+      p.unpaid_blocks        = 0;
+
+      p.paid_bpay += per_block_pay;
+      p.paid_vpay += per_vote_pay;
+      s.bpay_paid += per_block_pay;
+      s.vpay_paid += per_vote_pay;
+      ++s.claims;
+   }
+
+   /// system_contract::apply_producer_deltas for a single producer
+   void change_votes( chain_state& s, producer& p, votes::change delta ) {
+      const votes::fixed init_votes = p.total_votes;
+      const auto         status     = p.votepay_status( s.now );
+
+      p.total_votes = votes::add( p.total_votes, delta );
+      pay::votepay_changes changes;
+      pay::change_votes( p.votepay, changes, init_votes, p.total_votes, status, s.now );
+      pay::apply_changes( s.votepay, changes, s.now );
+      ++s.vote_changes;
+   }
+
+   /// the name auction part of system_contract::onblock once every bid is in the closetime index
+   void close_names( chain_state& s, std::vector<name_bid>& bids ) {
+      if( bids.empty() || !pay::name_close_due( s.slot, s.last_name_close_slot ) )
+         return;
+
+      auto highest = std::max_element( bids.begin(), bids.end(), []( const auto& a, const auto& b ) { return a.high_bid < b.high_bid; } );
+      if( !pay::name_auction_closes( highest->high_bid, highest->last_bid_time, s.activated_time, s.now ) )
+         return;
+
+      // bids are appended as they are placed, so they are already in close time order
+      highest->high_bid = -highest->high_bid;
+      auto it = bids.begin();
+      pay::close_names( true, [&]() {
+         for( ; it != bids.end() && s.now - it->last_bid_time > pay::useconds_per_day; ++it ) {
+            if( it->high_bid > 0 ) {
+               it->high_bid = -it->high_bid;
+               ++it;
+               return true;
+            }
+         }
+         return false;
+      });
+      s.last_name_close_slot = s.slot;
+      s.names_closed += std::count_if( bids.begin(), bids.end(), []( const auto& b ) { return b.high_bid < 0; } );
+      bids.erase( std::remove_if( bids.begin(), bids.end(), []( const auto& b ) { return b.high_bid < 0; } ), bids.end() );
+   }
+
+   /// vote pay share of all producers brought up to now, what the global total must agree with
+   double sum_of_votepay_shares( const chain_state& s, const std::vector<producer>& producers ) {
+      double sum = 0;
+      for( const auto& p : producers ) {
+         const auto status = p.votepay_status( s.now );
+         sum += p.votepay.share + pay::accrued_share( status.updated_after_threshold ? 0.0 : votes::to_double( p.total_votes ),
+                                                      p.votepay.last_update, s.now );
+      }
+      return sum;
+   }
+
+   /// prints the state at the end of a year and returns the relative drift of the vote pay total
+   double print_year( uint32_t year, const chain_state& s, int64_t supply_at_start, const std::vector<producer>& producers ) {
+      pay::votepay_totals totals = s.votepay;
+      const double total_share = pay::update_totals( totals, s.now, 0.0, 0.0 );
+      const double sum_share   = sum_of_votepay_shares( s, producers );
+      const double drift       = total_share > 0 ? std::fabs( total_share - sum_share ) / total_share : 0.0;
+
+      std::printf( "%4u %20" PRId64 " %8.4f%% %18" PRId64 " %18" PRId64 " %16" PRId64 " %16" PRId64 " %18" PRId64 " %18" PRId64 " %10.3e\n",
+                   year, s.core_supply,
+                   100.0 * double(s.core_supply - supply_at_start) / double(supply_at_start),
+                   s.bpay_paid, s.vpay_paid, s.perblock_bucket, s.pervote_bucket,
+                   s.gov_fund, s.dev_fund, drift );
+      return drift;
+   }
+
+} /// namespace
+
+int main( int argc, char** argv ) {
+   const options opts = parse_options( argc, argv );
+   std::mt19937_64 rng( opts.seed );
+
+   chain_state s;
+   s.now                      = 1546300800 * int64_t(1000000); // 2019-01-01
+   s.slot                     = uint32_t( s.now / useconds_per_block );
+   s.activated_time           = s.now - 14 * pay::useconds_per_day - 1;
+   s.last_pervote_bucket_fill = s.now;
+   s.last_name_close_slot     = s.slot;
+   s.core_supply              = 1'000'000'000'0000;
+   s.votepay.last_update      = s.now;
+
+   std::uniform_real_distribution<double> unit( 0.0, 1.0 );
+   std::vector<producer> producers( opts.producers );
+   for( auto& p : producers ) {
+      p.total_votes               = votes::from_double( 1e15 * (0.1 + unit( rng )) );
+      p.last_claim_time           = s.now;
+      p.votepay.last_update       = s.now;
+      p.claim_interval_days       = unit( rng ) < 0.1 ? 4 : 1;
+      p.next_claim_time           = s.now + p.claim_interval_days * pay::useconds_per_day + int64_t( unit( rng ) * useconds_per_hour );
+      s.votepay.change_rate      += votes::to_double( p.total_votes );
+   }
+   std::vector<name_bid> bids;
+
+   std::printf( "rate %.6f producers %u seed %" PRIu64 " years %u\n", opts.rate, opts.producers, opts.seed, opts.years );
+   std::printf( "%4s %20s %9s %18s %18s %16s %16s %18s %18s %10s\n",
+                "year", "supply", "growth", "bpay paid", "vpay paid", "bpay bucket", "vpay bucket",
+                "gov fund", "dev fund", "vpay drift" );
+
+   const uint64_t rounds_per_year = uint64_t( pay::useconds_per_year ) / (schedule_size * blocks_per_producer * useconds_per_block);
+   const int64_t  initial_supply  = s.core_supply;
+   std::vector<uint32_t> schedule( producers.size() );
+
+   double max_drift = 0;
+   for( uint32_t year = 1; year <= opts.years; ++year ) {
+      const int64_t supply_at_start = s.core_supply;
+      for( uint64_t round = 0; round < rounds_per_year; ++round ) {
+         for( uint32_t i = 0; i < schedule.size(); ++i )
+            schedule[i] = i;
+         std::partial_sort( schedule.begin(), schedule.begin() + schedule_size, schedule.end(),
+                            [&]( uint32_t a, uint32_t b ) { return producers[a].total_votes > producers[b].total_votes; } );
+
+         for( uint32_t i = 0; i < schedule_size; ++i ) {
+            producers[schedule[i]].unpaid_blocks += blocks_per_producer;
+            s.total_unpaid_blocks                += blocks_per_producer;
+         }
+         s.slot += schedule_size * blocks_per_producer;
+         s.now  += schedule_size * blocks_per_producer * useconds_per_block;
+
+         if( unit( rng ) < 0.05 ) {
+            auto& p = producers[rng() % producers.size()];
+            // up to 10% more or less, in steps of a thousandth
+            const int64_t permille = int64_t( unit( rng ) * 200 ) - 100;
+            const votes::change delta = votes::change( p.total_votes / 1000 ) * permille;
+            change_votes( s, p, delta );
+         }
+
+         if( unit( rng ) < 0.01 ) {
+            name_bid b;
+            b.high_bid      = 1'0000 + int64_t( unit( rng ) * 1000'0000 );
+            b.last_bid_time = s.now;
+            bids.push_back( b );
+         }
+         close_names( s, bids );
+
+         for( auto& p : producers ) {
+            if( s.now < p.next_claim_time )
+               continue;
+            claimrewards( s, p, opts.rate );
+            p.next_claim_time = s.now + p.claim_interval_days * pay::useconds_per_day + int64_t( unit( rng ) * useconds_per_hour );
+         }
+      }
+      max_drift = std::max( max_drift, print_year( year, s, supply_at_start, producers ) );
+   }
+
+   const double annual_growth = std::pow( double(s.core_supply) / double(initial_supply), 1.0 / opts.years ) - 1.0;
+   std::printf( "claims %u vote changes %u names closed %u\n", s.claims, s.vote_changes, s.names_closed );
+   std::printf( "annual growth %.6f%%, continuous rate %.6f compounds to %.6f%%\n",
+                100.0 * annual_growth, opts.rate, 100.0 * std::expm1( opts.rate ) );
+
+   // the global vote pay total the contract divides by must follow the sum of the producer shares,
+   // a drift means producers are paid from a wrong total; buckets must never be overdrawn
+   if( max_drift > max_votepay_drift ) {
+      std::fprintf( stderr, "vote pay total drifted %.3e from the producer shares, more than %.3e\n", max_drift, max_votepay_drift );
+      return 1;
+   }
+   if( s.perblock_bucket < 0 || s.pervote_bucket < 0 ) {
+      std::fprintf( stderr, "a pay bucket is overdrawn\n" );
+      return 1;
+   }
+   return 0;
+}